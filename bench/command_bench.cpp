@@ -0,0 +1,144 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/shader.h>
+#include <custom/mesh.h>
+#include <custom/headless.h>
+#include <custom/command_buffer.h>
+#include <custom/job_system.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+
+const unsigned int MESHES = 64;
+const unsigned int DRAWS = 20000;
+const unsigned int REPEATS = 20;
+
+double timeMs(const std::function<void()> &function){
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < REPEATS; i++){
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / REPEATS;
+}
+
+Mesh makeCube(unsigned int texture){
+    std::vector<Vertex> vertices;
+    for (unsigned int i = 0; i < 8; i++){
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+        vertex.Normal = glm::normalize(vertex.Position);
+        vertices.push_back(vertex);
+    }
+    unsigned int faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                              2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    std::vector<unsigned int> indices(faces, faces + 36);
+    std::vector<Texture> textures(1, Texture{texture, "texture_diffuse", ""});
+    return Mesh(std::move(vertices), std::move(indices), std::move(textures));
+}
+
+int main(int argc, char** argv){
+    unsigned int threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+
+    HeadlessContext context;
+    if (!context.Valid() || !context.MakeCurrent()) return -1;
+    if (!gladLoadGLLoader(HeadlessContext::Loader())){
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    OffscreenTarget target(64, 64);
+    target.Bind();
+
+    Shader shader("src/shaders/object_vert.glsl", "src/shaders/object_frag.glsl");
+    DrawProgram program(shader);
+
+    std::vector<unsigned int> textures(MESHES / 4);
+    glCreateTextures(GL_TEXTURE_2D, textures.size(), textures.data());
+    for (unsigned int i = 0; i < textures.size(); i++){
+        unsigned char pixel[4] = {255, 255, 255, 255};
+        glTextureStorage2D(textures[i], 1, GL_RGBA8, 1, 1);
+        glTextureSubImage2D(textures[i], 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    }
+
+    std::vector<Mesh> meshes;
+    for (unsigned int i = 0; i < MESHES; i++){
+        meshes.push_back(makeCube(textures[i / 4]));
+    }
+
+    std::vector<unsigned int> drawMeshes(DRAWS);
+    std::vector<glm::mat4> drawTransforms(DRAWS);
+    std::vector<glm::mat3> drawNormals(DRAWS);
+    for (unsigned int i = 0; i < DRAWS; i++){
+        drawMeshes[i] = i * MESHES / DRAWS;
+        drawTransforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 100), (float)(i / 100), -50.0f));
+        drawNormals[i] = glm::mat3(glm::transpose(glm::inverse(drawTransforms[i])));
+    }
+
+    auto recordRange = [&](CommandBuffer &commands, unsigned int begin, unsigned int end){
+        commands.BindProgram(program);
+        for (unsigned int i = begin; i < end; i++){
+            commands.BindMaterial(meshes[drawMeshes[i]]);
+            commands.SetDrawData(drawTransforms[i], drawNormals[i]);
+            commands.Draw(meshes[drawMeshes[i]]);
+        }
+    };
+
+    double direct = timeMs([&](){
+        shader.use();
+        for (unsigned int i = 0; i < DRAWS; i++){
+            shader.setMat4("model", drawTransforms[i]);
+            shader.setMat3("normalMat", drawNormals[i]);
+            meshes[drawMeshes[i]].Draw(shader);
+        }
+        glFinish();
+    });
+
+    CommandBuffer single;
+    double recordSingle = timeMs([&](){
+        single.Reset();
+        recordRange(single, 0, DRAWS);
+    });
+
+    JobSystem jobs(threads);
+    std::vector<CommandBuffer> buffers(jobs.WorkerCount());
+    unsigned int grain = (DRAWS + buffers.size() - 1) / buffers.size();
+    double recordParallel = timeMs([&](){
+        jobs.ParallelFor(DRAWS, grain, [&](unsigned int begin, unsigned int end){
+            CommandBuffer &commands = buffers[begin / grain];
+            commands.Reset();
+            recordRange(commands, begin, end);
+        });
+    });
+
+    double replay = timeMs([&](){
+        for (unsigned int i = 0; i < buffers.size(); i++){
+            buffers[i].Execute();
+        }
+        glFinish();
+    });
+
+    std::cout << DRAWS << " draws over " << MESHES << " meshes, " << single.CommandCount() << " commands, "
+              << single.Size() / 1024 << " KiB" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(24) << std::left << "direct Mesh::Draw" << std::setw(10) << std::right << direct << " ms "
+              << std::setw(10) << DRAWS / direct << " draws/ms" << std::endl;
+    std::cout << std::setw(24) << std::left << "record 1 thread" << std::setw(10) << std::right << recordSingle << " ms "
+              << std::setw(10) << DRAWS / recordSingle << " draws/ms" << std::endl;
+    std::cout << std::setw(24) << std::left << ("record " + std::to_string(jobs.WorkerCount()) + " threads") << std::setw(10) << std::right << recordParallel << " ms "
+              << std::setw(10) << DRAWS / recordParallel << " draws/ms" << std::endl;
+    std::cout << std::setw(24) << std::left << "replay" << std::setw(10) << std::right << replay << " ms "
+              << std::setw(10) << DRAWS / replay << " draws/ms" << std::endl;
+
+    PerfPhaseTable().Report();
+
+    meshes.clear();
+    GpuRegistry().Flush();
+    context.ReleaseCurrent();
+    return 0;
+}
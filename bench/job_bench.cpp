@@ -0,0 +1,81 @@
+#include <custom/job_system.h>
+#include <custom/transform.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+const unsigned int ELEMENTS = 1 << 22;
+const unsigned int GRAIN = 16384;
+const unsigned int ROOTS = 256;
+const unsigned int CHILDREN = 256;
+const unsigned int REPEATS = 20;
+
+double timeMs(const std::function<void()> &function){
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < REPEATS; i++){
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / REPEATS;
+}
+
+int main(int argc, char** argv){
+    unsigned int maxThreads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<float> data(ELEMENTS);
+    for (unsigned int i = 0; i < ELEMENTS; i++){
+        data[i] = (float)i;
+    }
+
+    TransformHierarchy hierarchy;
+    unsigned int root = hierarchy.AddNode(-1);
+    for (unsigned int i = 0; i < ROOTS; i++){
+        unsigned int parent = hierarchy.AddNode(root);
+        for (unsigned int j = 0; j < CHILDREN; j++){
+            hierarchy.AddNode(parent, glm::translate(glm::mat4(1.0f), glm::vec3((float)j, 0.0f, 0.0f)));
+        }
+    }
+
+    std::cout << "threads  parallel_for_ms  speedup  transforms_ms  speedup  tiny_jobs_ms  speedup" << std::endl;
+    double baseFor = 0.0, baseTransforms = 0.0, baseJobs = 0.0;
+
+    for (unsigned int threads = 1; threads <= maxThreads; threads++){
+        JobSystem jobs(threads);
+
+        double forMs = timeMs([&](){
+            jobs.ParallelFor(ELEMENTS, GRAIN, [&data](unsigned int begin, unsigned int end){
+                for (unsigned int i = begin; i < end; i++){
+                    data[i] = std::sqrt(data[i] * data[i] + 1.0f);
+                }
+            });
+        });
+
+        double transformMs = timeMs([&](){
+            for (unsigned int i = 0; i < ROOTS; i++){
+                hierarchy.SetLocal(1 + i * (CHILDREN + 1), glm::rotate(glm::mat4(1.0f), 0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f)));
+            }
+            hierarchy.Update(jobs);
+        });
+
+        double jobMs = timeMs([&](){
+            JobCounter counter;
+            std::atomic<unsigned int> sum(0);
+            for (unsigned int i = 0; i < 10000; i++){
+                jobs.Run([&sum, i](){ sum.fetch_add(i & 7, std::memory_order_relaxed); }, &counter);
+            }
+            jobs.Wait(counter);
+        });
+
+        if (threads == 1) baseFor = forMs, baseTransforms = transformMs, baseJobs = jobMs;
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(3)
+                  << std::setw(17) << forMs << std::setw(9) << baseFor / forMs
+                  << std::setw(15) << transformMs << std::setw(9) << baseTransforms / transformMs
+                  << std::setw(14) << jobMs << std::setw(9) << baseJobs / jobMs << std::endl;
+    }
+    return 0;
+}
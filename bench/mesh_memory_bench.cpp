@@ -0,0 +1,82 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <custom/mesh.h>
+#include <custom/headless.h>
+#include <custom/alloc_tracker.h>
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+const unsigned int GRID_SIZE = 1024;
+
+// Builds one GRID_SIZE x GRID_SIZE grid, which is about the geometry of a large scanned model.
+Mesh makeGrid(unsigned int size){
+    std::vector<Vertex> vertices;
+    vertices.reserve(size * size);
+    for (unsigned int y = 0; y < size; y++){
+        for (unsigned int x = 0; x < size; x++){
+            Vertex vertex = {};
+            vertex.Position = glm::vec3((float)x, 0.0f, (float)y);
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoords = glm::vec2((float)x / size, (float)y / size);
+            vertices.push_back(vertex);
+        }
+    }
+
+    std::vector<unsigned int> indices;
+    indices.reserve((size - 1) * (size - 1) * 6);
+    for (unsigned int y = 0; y + 1 < size; y++){
+        for (unsigned int x = 0; x + 1 < size; x++){
+            unsigned int i = y * size + x;
+            unsigned int quad[6] = {i, i + size, i + 1, i + 1, i + size, i + size + 1};
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    return Mesh(std::move(vertices), std::move(indices), std::vector<Texture>());
+}
+
+size_t toKiB(size_t bytes){
+    return bytes / 1024;
+}
+
+int main(int argc, char** argv){
+    unsigned int meshCount = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    HeadlessContext context;
+    if (!context.Valid() || !context.MakeCurrent()) return -1;
+    if (!gladLoadGLLoader(HeadlessContext::Loader())){
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    {
+        size_t residentStart = AllocTracker::ResidentBytes();
+
+        std::vector<Mesh> meshes;
+        size_t geometry = 0;
+        for (unsigned int i = 0; i < meshCount; i++){
+            meshes.push_back(makeGrid(GRID_SIZE));
+            geometry += meshes.back().GeometryBytes();
+        }
+        glFinish();
+        size_t residentLoaded = AllocTracker::ResidentBytes();
+
+        for (unsigned int i = 0; i < meshes.size(); i++){
+            meshes[i].ReleaseGeometry();
+        }
+        size_t residentReleased = AllocTracker::ResidentBytes();
+
+        std::cout << meshCount << " meshes of " << GRID_SIZE * GRID_SIZE << " vertices, " << toKiB(geometry) << " KiB of CPU geometry" << std::endl;
+        std::cout << "resident before load      " << toKiB(residentStart) << " KiB" << std::endl;
+        std::cout << "resident with geometry    " << toKiB(residentLoaded) << " KiB" << std::endl;
+        std::cout << "resident after release    " << toKiB(residentReleased) << " KiB" << std::endl;
+        std::cout << "saved                     " << (long long)(toKiB(residentLoaded) - toKiB(residentReleased)) << " KiB" << std::endl;
+    }
+
+    GpuRegistry().Flush();
+    context.ReleaseCurrent();
+    return 0;
+}
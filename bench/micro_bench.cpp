@@ -0,0 +1,348 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/headless.h>
+#include <custom/shader.h>
+#include <custom/camera.h>
+#include <custom/model.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+const unsigned int SAMPLES = 15;
+const unsigned int SLOW_SAMPLES = 5;
+const double SAMPLE_MS = 20.0;
+const double SLOW_MS = 200.0;
+const unsigned int DRAW_BATCH = 1000;
+
+struct BenchResult{
+    std::string Name;
+    unsigned int Samples;
+    unsigned long long Iterations;
+    double MinNs;
+    double MedianNs;
+    double MeanNs;
+    double StddevNs;
+    double P95Ns;
+};
+
+std::vector<BenchResult> results;
+unsigned int samples = SAMPLES;
+const char* filter = NULL;
+volatile float sink = 0.0f;
+
+double nowNs(){
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void addResult(const std::string &name, std::vector<double> &perIteration, unsigned long long iterations){
+    std::sort(perIteration.begin(), perIteration.end());
+    double mean = 0.0;
+    for (unsigned int i = 0; i < perIteration.size(); i++) mean += perIteration[i];
+    mean /= perIteration.size();
+    double variance = 0.0;
+    for (unsigned int i = 0; i < perIteration.size(); i++) variance += (perIteration[i] - mean) * (perIteration[i] - mean);
+    variance /= std::max<size_t>(1, perIteration.size() - 1);
+
+    size_t p95 = std::min(perIteration.size() - 1, (size_t)std::ceil(0.95 * perIteration.size()) - 1);
+    BenchResult result = BenchResult{name, (unsigned int)perIteration.size(), iterations, perIteration.front(),
+                                     perIteration[perIteration.size() / 2], mean, std::sqrt(variance), perIteration[p95]};
+    results.push_back(result);
+
+    std::cout << std::setw(44) << std::left << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << result.MedianNs << std::setw(14) << result.MinNs << std::setw(14) << result.P95Ns
+              << std::setw(9) << (mean > 0.0 ? 100.0 * result.StddevNs / mean : 0.0) << "%" << std::setw(12) << iterations << std::endl;
+}
+
+bool selected(const std::string &name){
+    return !filter || name.find(filter) != std::string::npos;
+}
+
+// Batches repeat the function until a batch takes about SAMPLE_MS, every sample is one batch.
+template<typename Function>
+void measure(const std::string &name, const Function &function){
+    if (!selected(name)) return;
+
+    double begin = nowNs();
+    function();
+    double once = std::max(1.0, nowNs() - begin);
+    unsigned long long batch = std::max(1ull, (unsigned long long)(SAMPLE_MS * 1e6 / once));
+    unsigned int count = once > SLOW_MS * 1e6 ? std::min(samples, SLOW_SAMPLES) : samples;
+
+    std::vector<double> perIteration;
+    for (unsigned int s = 0; s < count; s++){
+        begin = nowNs();
+        for (unsigned long long i = 0; i < batch; i++) function();
+        perIteration.push_back((nowNs() - begin) / batch);
+    }
+    addResult(name, perIteration, batch * count);
+}
+
+// One timed call per sample, with untimed setup before each, for things that consume their input.
+template<typename Setup, typename Function>
+void measureEach(const std::string &name, const Setup &setup, const Function &function){
+    if (!selected(name)) return;
+
+    setup();
+    double begin = nowNs();
+    function();
+    unsigned int count = nowNs() - begin > SLOW_MS * 1e6 ? std::min(samples, SLOW_SAMPLES) : samples;
+
+    std::vector<double> perIteration;
+    for (unsigned int s = 0; s < count; s++){
+        setup();
+        begin = nowNs();
+        function();
+        perIteration.push_back(nowNs() - begin);
+    }
+    addResult(name, perIteration, count);
+}
+
+bool writeJson(const char* path, int cpu){
+    std::ofstream file(path);
+    if (!file){
+        std::cout << "ERROR::BENCH::FAILED_TO_OPEN\nPath: " << path << std::endl;
+        return false;
+    }
+    file << std::fixed << std::setprecision(1);
+    file << "{\n  \"cpu\": " << cpu << ",\n  \"results\": [";
+    for (unsigned int i = 0; i < results.size(); i++){
+        const BenchResult &result = results[i];
+        file << (i ? "," : "") << "\n    {\"name\": \"" << result.Name << "\", \"samples\": " << result.Samples << ", \"iterations\": " << result.Iterations
+             << ", \"min_ns\": " << result.MinNs << ", \"median_ns\": " << result.MedianNs << ", \"mean_ns\": " << result.MeanNs
+             << ", \"stddev_ns\": " << result.StddevNs << ", \"p95_ns\": " << result.P95Ns << "}";
+    }
+    file << "\n  ]\n}\n";
+    return true;
+}
+
+// Pins the calling thread only, driver threads started earlier keep their affinity.
+int pinThread(int cpu){
+#ifdef __linux__
+    if (cpu < 0) cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0){
+        std::cout << "ERROR::BENCH::PIN_FAILED cpu " << cpu << std::endl;
+        return -1;
+    }
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
+std::vector<std::string> findResources(const std::vector<std::string> &extensions){
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it("resource", error), end; !error && it != end; it.increment(error)){
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (it->is_regular_file() && std::find(extensions.begin(), extensions.end(), extension) != extensions.end()){
+            paths.push_back(it->path().generic_string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+Mesh makeCube(){
+    std::vector<Vertex> vertices;
+    for (unsigned int i = 0; i < 8; i++){
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+        vertex.Normal = glm::normalize(vertex.Position);
+        vertices.push_back(vertex);
+    }
+    unsigned int faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                              2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    return Mesh(std::move(vertices), std::vector<unsigned int>(faces, faces + 36), std::vector<Texture>());
+}
+
+// micro_bench [--samples N] [--cpu N] [--filter substring] [--json path]
+// Times are nanoseconds per call: median, min, p95 and the spread of the samples.
+int main(int argc, char** argv){
+    int cpu = -1;
+    const char* jsonPath = NULL;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = std::max(2, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) jsonPath = argv[++i];
+        else{
+            std::cout << "ERROR::ARGS::UNKNOWN_ARGUMENT " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+
+    HeadlessContext context;
+    if (!context.Valid() || !context.MakeCurrent()) return -1;
+    if (!gladLoadGLLoader(HeadlessContext::Loader())){
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    cpu = pinThread(cpu);
+    stbi_set_flip_vertically_on_load(true);
+
+    std::cout << std::setw(44) << std::left << "benchmark" << std::right << std::setw(14) << "median_ns" << std::setw(14) << "min_ns"
+              << std::setw(14) << "p95_ns" << std::setw(10) << "cv" << std::setw(12) << "iterations" << std::endl;
+    {
+        OffscreenTarget target(256, 256);
+        target.Bind();
+        GLState().Viewport(0, 0, 256, 256);
+
+        Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+        glm::mat4 model = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f)), 0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+        float angle = 0.0f;
+
+        measure("camera view matrix", [&](){
+            camera.Position.x += 1e-6f;
+            sink = sink + camera.GetViewMatrix()[3][0];
+        });
+        measure("camera projection", [&](){
+            angle += 1e-6f;
+            sink = sink + glm::perspective(glm::radians(45.0f + angle), 16.0f / 9.0f, 0.1f, 100.0f)[0][0];
+        });
+        measure("normal matrix mat3 inverse", [&](){
+            model[3][0] += 1e-6f;
+            sink = sink + glm::transpose(glm::inverse(glm::mat3(model)))[0][0];
+        });
+        measure("normal matrix mat4 inverse", [&](){
+            model[3][0] += 1e-6f;
+            sink = sink + glm::mat3(glm::transpose(glm::inverse(model)))[0][0];
+        });
+
+        measureEach("shader compile object", [](){ GpuRegistry().Flush(); }, [](){
+            Shader shader("src/shaders/object_vert.glsl", "src/shaders/object_frag.glsl");
+        });
+        measureEach("shader compile culled", [](){ GpuRegistry().Flush(); }, [](){
+            Shader shader("src/shaders/object_culled_vert.glsl", "src/shaders/object_frag.glsl");
+        });
+        measureEach("shader compile instanced", [](){ GpuRegistry().Flush(); }, [](){
+            Shader shader("src/shaders/object_instanced_vert.glsl", "src/shaders/object_frag.glsl");
+        });
+        measureEach("shader compile cull compute", [](){ GpuRegistry().Flush(); }, [](){
+            Shader shader("src/shaders/cull_comp.glsl");
+        });
+
+        Shader shader("src/shaders/object_vert.glsl", "src/shaders/object_frag.glsl");
+        shader.use();
+        glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
+        measure("uniform setMat4", [&](){ shader.setMat4("model", model); });
+        measure("uniform setMat3", [&](){ shader.setMat3("normalMat", normal); });
+        measure("uniform setVec3", [&](){ shader.setVec3("viewPos", camera.Position); });
+        measure("uniform setPointLight", [&](){
+            ThreadFrameArena().Reset();
+            shader.setPointLight("pointLights[0]", glm::vec3(0.0f, 0.0f, 3.0f));
+        });
+        measure("uniform setSpotLight", [&](){
+            ThreadFrameArena().Reset();
+            shader.setSpotLight("spotLights[0]", camera.Position, camera.Front);
+        });
+
+        // Per draw CPU cost, the GPU catches up between batches.
+        Mesh cube = makeCube();
+        shader.setMat4("projection", glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f));
+        shader.setMat4("view", camera.GetViewMatrix());
+        measure("Mesh::Draw x1000", [&](){
+            for (unsigned int i = 0; i < DRAW_BATCH; i++) cube.Draw(shader);
+            glFlush();
+        });
+        measure("Mesh::Draw + model/normal x1000", [&](){
+            for (unsigned int i = 0; i < DRAW_BATCH; i++){
+                shader.setMat4("model", model);
+                shader.setMat3("normalMat", normal);
+                cube.Draw(shader);
+            }
+            glFlush();
+        });
+
+        // The same cubes once per object with their own uniforms, and as one instanced draw
+        // reading the transforms from an SSBO, see Model::DrawInstanced. They sit behind the
+        // camera, so the submission is timed and not the rasterizer.
+        std::vector<Mesh> cubeMeshes;
+        cubeMeshes.push_back(makeCube());
+        Model cubes(std::move(cubeMeshes));
+        std::vector<glm::mat4> transforms;
+        for (unsigned int i = 0; i < DRAW_BATCH; i++){
+            transforms.push_back(glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 32) - 16.0f, (float)(i / 32) - 16.0f, 20.0f)));
+        }
+        measure("Model::Draw per object x1000", [&](){
+            for (unsigned int i = 0; i < DRAW_BATCH; i++){
+                cubes.SetTransform(transforms[i]);
+                cubes.Draw(shader);
+            }
+            glFlush();
+        });
+        cubes.SetTransform(glm::mat4(1.0f));
+        Shader instancedShader("src/shaders/object_instanced_vert.glsl", "src/shaders/object_frag.glsl");
+        instancedShader.use();
+        instancedShader.setMat4("projection", glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f));
+        instancedShader.setMat4("view", camera.GetViewMatrix());
+        measure("Model::DrawInstanced x1000", [&](){
+            cubes.DrawInstanced(instancedShader, transforms);
+            glFlush();
+        });
+        shader.use();
+        glFinish();
+
+        std::vector<std::string> images = findResources({".jpg", ".jpeg", ".png", ".tga", ".bmp"});
+        for (unsigned int i = 0; i < images.size(); i++){
+            std::string directory = images[i].substr(0, images[i].find_last_of('/'));
+            std::string file = images[i].substr(images[i].find_last_of('/') + 1);
+
+            measure("texture decode " + images[i], [&](){
+                TextureData texture = DecodeTexture(file.c_str(), directory, false);
+                stbi_image_free(texture.data);
+            });
+
+            TextureData decoded = DecodeTexture(file.c_str(), directory, false);
+            size_t bytes = (size_t)decoded.width * decoded.height * decoded.nrComponents;
+            TextureData copy = decoded;
+            measureEach("texture upload " + images[i], [&](){
+                GpuRegistry().Flush();
+                copy.data = (unsigned char*)std::malloc(bytes);
+                std::memcpy(copy.data, decoded.data, bytes);
+            }, [&](){
+                GpuResource texture = UploadTexture(copy, file.c_str());
+                glFinish();
+            });
+            stbi_image_free(decoded.data);
+
+            measureEach("TextureFromFile " + images[i], [](){ GpuRegistry().Flush(); }, [&](){
+                GpuResource texture = TextureFromFile(file.c_str(), directory);
+                glFinish();
+            });
+        }
+
+        JobSystem jobs;
+        std::vector<std::string> models = findResources({".obj", ".gltf", ".glb", ".fbx"});
+        for (unsigned int i = 0; i < models.size(); i++){
+            measureEach("model load " + models[i], [](){ GpuRegistry().Flush(); }, [&](){
+                Model loaded(models[i], false, &jobs);
+                glFinish();
+            });
+        }
+    }
+
+    GpuRegistry().Flush();
+    if (jsonPath) writeJson(jsonPath, cpu);
+    context.ReleaseCurrent();
+    return 0;
+}
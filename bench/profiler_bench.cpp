@@ -0,0 +1,95 @@
+#ifndef PROFILING
+#define PROFILING
+#endif
+#include <custom/profiler.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+const unsigned int ZONES = 1 << 14;
+const unsigned int BATCHES = 64;
+
+volatile unsigned int sink = 0;
+
+// Every batch fits the ring, it is drained between batches outside of the timed part.
+double nsPerIteration(bool zones){
+    double total = 0.0;
+    for (unsigned int batch = 0; batch < BATCHES; batch++){
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < ZONES; i++){
+            if (zones){
+                PROFILE_ZONE("bench zone");
+                sink = sink + i;
+            }else{
+                sink = sink + i;
+            }
+        }
+        total += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        Profiler::Clear();
+    }
+    return total / ((double)ZONES * BATCHES);
+}
+
+int main(int argc, char** argv){
+    unsigned int threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    const char* tracePath = argc > 2 ? argv[2] : NULL;
+
+    PROFILE_THREAD("bench");
+    nsPerIteration(true);
+
+    double empty = nsPerIteration(false);
+    double zoned = nsPerIteration(true);
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long ticks = 0;
+    for (unsigned int i = 0; i < ZONES; i++){
+        ticks += Profiler::Ticks();
+    }
+    double tickNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ZONES;
+    sink = sink + (unsigned int)ticks;
+
+    std::cout << std::fixed << std::setprecision(2);
+#ifdef PROFILE_RDTSC
+    std::cout << "timestamp source          rdtsc" << std::endl;
+#else
+    std::cout << "timestamp source          steady_clock" << std::endl;
+#endif
+    std::cout << "timestamp                 " << std::setw(8) << tickNs << " ns" << std::endl;
+    std::cout << "loop without zone         " << std::setw(8) << empty << " ns" << std::endl;
+    std::cout << "loop with zone            " << std::setw(8) << zoned << " ns" << std::endl;
+    std::cout << "zone overhead             " << std::setw(8) << zoned - empty << " ns" << std::endl;
+
+    // Threads record concurrently into their own rings while the main thread keeps draining them.
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> running(threads);
+    start = std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < threads; t++){
+        workers.push_back(std::thread([&running](){
+            PROFILE_THREAD("bench worker");
+            volatile unsigned int local = 0;
+            for (unsigned int i = 0; i < ZONES * 4; i++){
+                PROFILE_ZONE("worker zone");
+                local = local + i;
+            }
+            running--;
+        }));
+    }
+    while (running.load()){
+        Profiler::Collect();
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    for (unsigned int t = 0; t < threads; t++){
+        workers[t].join();
+    }
+    double threadedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << threads << " threads                 " << std::setw(8) << ZONES * 4.0 * threads / threadedMs << " zones/ms, "
+              << Profiler::Dropped() << " events dropped" << std::endl;
+
+    if (tracePath) Profiler::WriteChromeTrace(tracePath);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <custom/scene.h>
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// scene_gen [options] <output.scene|output.bscene>
+// scene_gen --convert <input> <output>     rewrites a scene as text or binary
+//   --model <path>            instance this model, can be repeated
+//   --model-scale <scale>     uniform scale of the model instances
+//   --instances <count>       instances of every model
+//   --meshes <count>          distinct procedural meshes (spheres, boxes, tori)
+//   --materials <count>       distinct checker materials, shared round robin by the meshes
+//   --mesh-instances <count>  instances of every procedural mesh
+//   --detail <min>:<max>      tessellation range of the procedural meshes
+//   --point-lights <count>, --spot-lights <count>
+//   --layers <count>          nested shells at the origin, 2 * count surfaces deep
+//   --layer-order <inside-out|outside-in>   worst or best case overdraw of the shells
+//   --coverage <fraction>     shell radius relative to the extent
+//   --extent <size>           half size of the box the instances are scattered over
+//   --seed <seed>
+// Outputs ending in .bscene are written in the binary format, which loads without parsing.
+// Sweeping one knob while keeping the seed gives comparable scenes, e.g.
+//   for n in 16 64 256 1024; do scene_gen --meshes 8 --mesh-instances $n stress_$n.scene; done
+int main(int argc, char** argv){
+    StressSceneSettings settings;
+    const char* outputPath = NULL;
+    const char* inputPath = NULL;
+    for (int i = 1; i < argc; i++){
+        bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--model") == 0 && value) settings.Models.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--model-scale") == 0 && value) settings.ModelScale = atof(argv[++i]);
+        else if (strcmp(argv[i], "--instances") == 0 && value) settings.ModelInstances = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--meshes") == 0 && value) settings.Meshes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--materials") == 0 && value) settings.Materials = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--mesh-instances") == 0 && value) settings.MeshInstances = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--point-lights") == 0 && value) settings.PointLights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spot-lights") == 0 && value) settings.SpotLights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--layers") == 0 && value) settings.Layers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--coverage") == 0 && value) settings.Coverage = atof(argv[++i]);
+        else if (strcmp(argv[i], "--extent") == 0 && value) settings.Extent = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && value) settings.Seed = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--convert") == 0 && value) inputPath = argv[++i];
+        else if (strcmp(argv[i], "--detail") == 0 && value){
+            if (sscanf(argv[++i], "%u:%u", &settings.MinDetail, &settings.MaxDetail) != 2 || settings.MinDetail > settings.MaxDetail){
+                std::cout << "ERROR::ARGS::INVALID_DETAIL " << argv[i] << ", expected <min>:<max>" << std::endl;
+                return -1;
+            }
+        }else if (strcmp(argv[i], "--layer-order") == 0 && value){
+            i++;
+            if (strcmp(argv[i], "inside-out") != 0 && strcmp(argv[i], "outside-in") != 0){
+                std::cout << "ERROR::ARGS::INVALID_LAYER_ORDER " << argv[i] << ", expected inside-out or outside-in" << std::endl;
+                return -1;
+            }
+            settings.LayersInsideOut = strcmp(argv[i], "inside-out") == 0;
+        }else if (argv[i][0] != '-' && !outputPath){
+            outputPath = argv[i];
+        }else{
+            std::cout << "ERROR::ARGS::UNKNOWN_ARGUMENT " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    if (!outputPath){
+        std::cout << "usage: scene_gen [options] <output.scene>, see bench/scene_gen.cpp" << std::endl;
+        return -1;
+    }
+
+    SceneDescription scene;
+    if (inputPath){
+        if (!scene.Load(inputPath)) return -1;
+    }else{
+        scene = GenerateStressScene(settings);
+    }
+
+    std::string output(outputPath);
+    bool binary = output.size() > 7 && output.compare(output.size() - 7, 7, ".bscene") == 0;
+    if (!(binary ? scene.SaveBinary(output) : scene.Save(output))) return -1;
+    std::cout << (inputPath ? "SCENE::CONVERTED " : "SCENE::GENERATED ") << outputPath << ": " << scene.Models.size() << " models, " << scene.Meshes.size() << " meshes, "
+              << scene.Materials.size() << " materials, " << scene.Instances.size() << " instances, " << scene.Lights.size() << " lights" << std::endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <custom/texture_baking.h>
+#include <custom/job_system.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+// texture_bake [options] <image|directory>...
+//   --fast                    BC1 (BC3 with alpha) instead of BC7 for color maps
+//   --kind <auto|color|normal|mask>   override the guess from the file name
+//   --uncompressed            R8, RGB8 or RGBA8 levels instead of BCn
+//   --no-mips                 only the top level
+//   --mip-filter <box|kaiser|lanczos>   downsampling filter of the mip chain, kaiser by default
+//   --linear                  filter color maps as stored instead of in linear light
+//   --force                   rebake images whose .ktx2 is newer than they are
+// Every image is written next to itself with .ktx2 appended, directories are searched
+// recursively for .png, .jpg, .jpeg, .tga and .bmp files. Models pick the bakes up on
+// load as long as they are newer than their source, e.g.
+//   texture_bake resource/
+int main(int argc, char** argv){
+    BakeSettings settings;
+    bool force = false;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++){
+        bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--fast") == 0) settings.FastColor = true;
+        else if (strcmp(argv[i], "--uncompressed") == 0) settings.Uncompressed = true;
+        else if (strcmp(argv[i], "--no-mips") == 0) settings.Mips = false;
+        else if (strcmp(argv[i], "--linear") == 0) settings.LinearColor = true;
+        else if (strcmp(argv[i], "--force") == 0) force = true;
+        else if (strcmp(argv[i], "--kind") == 0 && value){
+            i++;
+            unsigned int kind = 0;
+            while (kind < 4 && strcmp(argv[i], TEXTURE_KIND_NAMES[kind]) != 0) kind++;
+            if (kind == 4){
+                std::cout << "ERROR::ARGS::INVALID_KIND " << argv[i] << ", expected auto, color, normal or mask" << std::endl;
+                return -1;
+            }
+            settings.Kind = (TextureKind)kind;
+        }else if (strcmp(argv[i], "--mip-filter") == 0 && value){
+            i++;
+            unsigned int filter = 0;
+            while (filter < 3 && strcmp(argv[i], MIP_FILTER_NAMES[filter]) != 0) filter++;
+            if (filter == 3){
+                std::cout << "ERROR::ARGS::INVALID_MIP_FILTER " << argv[i] << ", expected box, kaiser or lanczos" << std::endl;
+                return -1;
+            }
+            settings.Filter = (MipFilter)filter;
+        }else if (argv[i][0] != '-'){
+            inputs.push_back(argv[i]);
+        }else{
+            std::cout << "ERROR::ARGS::UNKNOWN_ARGUMENT " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    if (inputs.empty()){
+        std::cout << "usage: texture_bake [options] <image|directory>..., see bench/texture_bake.cpp" << std::endl;
+        return -1;
+    }
+
+    const char* extensions[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+    auto isImage = [&extensions](const std::filesystem::path &path){
+        std::string extension = path.extension().string();
+        for (char &c : extension) c = (char)std::tolower((unsigned char)c);
+        for (const char* known : extensions) if (extension == known) return true;
+        return false;
+    };
+    std::vector<std::string> images;
+    for (const std::string &input : inputs){
+        std::error_code error;
+        if (std::filesystem::is_directory(input, error)){
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(input, error)){
+                if (entry.is_regular_file() && isImage(entry.path())) images.push_back(entry.path().string());
+            }
+        }else{
+            images.push_back(input);
+        }
+    }
+
+    JobSystem jobs;
+    unsigned int baked = 0, skipped = 0, failed = 0;
+    size_t sourceBytes = 0, bakedBytes = 0;
+    for (const std::string &image : images){
+        // Bakes from before the orientation key was written are upside down, they are redone.
+        Ktx2Texture existing;
+        if (!force && BakedTextureCurrent(image) && existing.Load(BakedTexturePath(image)) && existing.Orientation == BAKED_TEXTURE_ORIENTATION){
+            skipped++;
+            continue;
+        }
+        int width, height, components;
+        unsigned char* pixels = LoadBakeSource(image, width, height, components);
+        if (!pixels){
+            std::cout << "ERROR::TEXTURE::FAILED_TO_LOAD\nPath: " << image << std::endl;
+            failed++;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Ktx2Texture texture = BakeTexture(image, pixels, width, height, components, settings, &jobs);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stbi_image_free(pixels);
+        if (!texture.Save(BakedTexturePath(image))){
+            failed++;
+            continue;
+        }
+
+        size_t source = (size_t)width * height * components;
+        std::cout << "TEXTURE::BAKED " << image << " -> " << texture.Format()->Name << " " << width << "x" << height << ", " << texture.Levels.size() << " levels, "
+                  << source / 1024 << " KiB -> " << texture.Bytes() / 1024 << " KiB in " << ms << " ms" << std::endl;
+        sourceBytes += source;
+        bakedBytes += texture.Bytes();
+        baked++;
+    }
+    std::cout << "TEXTURE::BAKE " << baked << " baked, " << skipped << " up to date, " << failed << " failed, " << sourceBytes / 1024 << " KiB of top levels -> "
+              << bakedBytes / 1024 << " KiB with mips" << std::endl;
+    return failed ? -1 : 0;
+}
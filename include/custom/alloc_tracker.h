@@ -0,0 +1,344 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <cstddef>
+
+// FRAME_ARENA_DEBUG relies on the tracker's per thread counters.
+#if defined(FRAME_ARENA_DEBUG) && !defined(ALLOC_TRACKING)
+#define ALLOC_TRACKING
+#endif
+
+enum AllocTag{
+    ALLOC_UNTAGGED,
+    ALLOC_MODEL_LOAD,
+    ALLOC_SHADER,
+    ALLOC_MESH_DRAW,
+    ALLOC_RENDER,
+    ALLOC_SIMULATION,
+    ALLOC_TAG_COUNT
+};
+
+const char* const ALLOC_TAG_NAMES[ALLOC_TAG_COUNT] = {"untagged", "model load", "shader", "mesh draw", "render", "simulation"};
+
+struct AllocCounters{
+    unsigned long long Allocations;
+    unsigned long long Frees;
+    unsigned long long Bytes;
+};
+
+struct AllocFrameStats{
+    unsigned long long Allocations;
+    unsigned long long Bytes;
+    long long PeakLiveBytes;
+};
+
+// Global heap accounting. Building with ALLOC_TRACKING replaces operator
+// new/delete and, on glibc, malloc/calloc/realloc/free, the hooks live in
+// src/alloc_tracker.cpp. Every allocation is charged to the calling thread
+// and to the tag of its innermost AllocScope. Without the flag all counters
+// stay zero and the scopes compile away.
+class AllocTracker{
+    public:
+        static bool Enabled();
+
+        static AllocCounters Total();
+        static AllocCounters Tag(AllocTag tag);
+        static AllocCounters Thread();
+        static long long LiveBytes();
+        static long long PeakBytes();
+
+        static AllocTag CurrentTag();
+        static AllocTag SetTag(AllocTag tag);
+
+        // Frame counters are global, they include every thread that allocates between the two calls.
+        static void BeginFrame();
+        static AllocFrameStats EndFrame();
+
+        static void Report();
+
+        // Resident set size of the process, read from the OS so it also covers GL driver memory. Zero where unsupported.
+        static size_t ResidentBytes();
+};
+
+// Tags the allocations of the calling thread and counts what happened inside the scope.
+class AllocScope{
+    public:
+        AllocScope(AllocTag tag);
+        ~AllocScope();
+
+        AllocScope(const AllocScope&) = delete;
+        AllocScope& operator=(const AllocScope&) = delete;
+
+        unsigned long long Allocations() const;
+        unsigned long long Bytes() const;
+        // Highest amount of memory the calling thread held on top of what it held when the scope started.
+        long long PeakBytes() const;
+
+    private:
+        AllocTag previousTag;
+        AllocCounters start;
+        long long startLive;
+        long long previousPeak;
+};
+
+#ifdef ALLOC_TRACKING
+#define ALLOC_SCOPE(tag) AllocScope allocScope(tag)
+#else
+#define ALLOC_SCOPE(tag)
+#endif
+
+#ifdef ALLOC_TRACKER_IMPLEMENTATION
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <cerrno>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(_WIN32)
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#ifdef ALLOC_TRACKING
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define ALLOC_TRACK_MALLOC
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void* pointer);
+#define allocSystem(size) __libc_malloc(size)
+#define freeSystem(pointer) __libc_free(pointer)
+#define allocationSize(pointer) malloc_usable_size(pointer)
+#elif defined(_WIN32)
+#include <malloc.h>
+#define allocSystem(size) std::malloc(size)
+#define freeSystem(pointer) std::free(pointer)
+#define allocationSize(pointer) _msize(pointer)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define allocSystem(size) std::malloc(size)
+#define freeSystem(pointer) std::free(pointer)
+#define allocationSize(pointer) malloc_size(pointer)
+#endif
+#endif
+
+// Plain globals with constant initialization, the hooks can run before any constructor.
+static std::atomic<unsigned long long> allocTagAllocations[ALLOC_TAG_COUNT];
+static std::atomic<unsigned long long> allocTagFrees[ALLOC_TAG_COUNT];
+static std::atomic<unsigned long long> allocTagBytes[ALLOC_TAG_COUNT];
+static std::atomic<long long> allocLiveBytes(0);
+static std::atomic<long long> allocPeakBytes(0);
+static std::atomic<long long> allocFramePeakBytes(0);
+static AllocCounters allocFrameStart = {0, 0, 0};
+
+static thread_local AllocTag allocThreadTag = ALLOC_UNTAGGED;
+static thread_local AllocCounters allocThreadCounters = {0, 0, 0};
+static thread_local long long allocThreadLive = 0;
+static thread_local long long allocThreadPeak = 0;
+
+#ifdef ALLOC_TRACKING
+static void allocRaisePeak(std::atomic<long long> &peak, long long value){
+    long long current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)){}
+}
+
+static void allocRecord(size_t size){
+    allocTagAllocations[allocThreadTag].fetch_add(1, std::memory_order_relaxed);
+    allocTagBytes[allocThreadTag].fetch_add(size, std::memory_order_relaxed);
+    long long live = allocLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    allocRaisePeak(allocPeakBytes, live);
+    allocRaisePeak(allocFramePeakBytes, live);
+
+    allocThreadCounters.Allocations++;
+    allocThreadCounters.Bytes += size;
+    allocThreadLive += size;
+    if (allocThreadLive > allocThreadPeak) allocThreadPeak = allocThreadLive;
+}
+
+static void allocRelease(size_t size){
+    allocTagFrees[allocThreadTag].fetch_add(1, std::memory_order_relaxed);
+    allocLiveBytes.fetch_sub(size, std::memory_order_relaxed);
+    allocThreadCounters.Frees++;
+    allocThreadLive -= size;
+}
+#endif
+
+bool AllocTracker::Enabled(){
+#ifdef ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocCounters AllocTracker::Total(){
+    AllocCounters total = {0, 0, 0};
+    for (unsigned int i = 0; i < ALLOC_TAG_COUNT; i++){
+        AllocCounters tag = Tag((AllocTag)i);
+        total.Allocations += tag.Allocations;
+        total.Frees += tag.Frees;
+        total.Bytes += tag.Bytes;
+    }
+    return total;
+}
+
+AllocCounters AllocTracker::Tag(AllocTag tag){
+    return AllocCounters{allocTagAllocations[tag].load(std::memory_order_relaxed), allocTagFrees[tag].load(std::memory_order_relaxed),
+                         allocTagBytes[tag].load(std::memory_order_relaxed)};
+}
+
+AllocCounters AllocTracker::Thread(){ return allocThreadCounters; }
+long long AllocTracker::LiveBytes(){ return allocLiveBytes.load(std::memory_order_relaxed); }
+long long AllocTracker::PeakBytes(){ return allocPeakBytes.load(std::memory_order_relaxed); }
+AllocTag AllocTracker::CurrentTag(){ return allocThreadTag; }
+
+AllocTag AllocTracker::SetTag(AllocTag tag){
+    AllocTag previous = allocThreadTag;
+    allocThreadTag = tag;
+    return previous;
+}
+
+void AllocTracker::BeginFrame(){
+    allocFrameStart = Total();
+    allocFramePeakBytes.store(LiveBytes(), std::memory_order_relaxed);
+}
+
+AllocFrameStats AllocTracker::EndFrame(){
+    AllocCounters end = Total();
+    return AllocFrameStats{end.Allocations - allocFrameStart.Allocations, end.Bytes - allocFrameStart.Bytes,
+                           allocFramePeakBytes.load(std::memory_order_relaxed)};
+}
+
+void AllocTracker::Report(){
+    if (!Enabled()){
+        std::cout << "ALLOC::TRACKING disabled, build with ALLOC_TRACKING" << std::endl;
+        return;
+    }
+
+    std::cout << std::setw(12) << std::left << "tag" << std::right << std::setw(14) << "allocations" << std::setw(14) << "frees"
+              << std::setw(16) << "bytes" << std::endl;
+    for (unsigned int i = 0; i < ALLOC_TAG_COUNT; i++){
+        AllocCounters tag = Tag((AllocTag)i);
+        std::cout << std::setw(12) << std::left << ALLOC_TAG_NAMES[i] << std::right << std::setw(14) << tag.Allocations
+                  << std::setw(14) << tag.Frees << std::setw(16) << tag.Bytes << std::endl;
+    }
+    std::cout << "live " << LiveBytes() << " bytes, peak " << PeakBytes() << " bytes" << std::endl;
+}
+
+size_t AllocTracker::ResidentBytes(){
+#if defined(__linux__)
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    unsigned long pages = 0, resident = 0;
+    int read = std::fscanf(file, "%lu %lu", &pages, &resident);
+    std::fclose(file);
+    return read == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+#else
+    return 0;
+#endif
+}
+
+AllocScope::AllocScope(AllocTag tag){
+    previousTag = AllocTracker::SetTag(tag);
+    start = allocThreadCounters;
+    startLive = allocThreadLive;
+    previousPeak = allocThreadPeak;
+    allocThreadPeak = allocThreadLive;
+}
+
+AllocScope::~AllocScope(){
+    AllocTracker::SetTag(previousTag);
+    if (previousPeak > allocThreadPeak) allocThreadPeak = previousPeak;
+}
+
+unsigned long long AllocScope::Allocations() const{ return allocThreadCounters.Allocations - start.Allocations; }
+unsigned long long AllocScope::Bytes() const{ return allocThreadCounters.Bytes - start.Bytes; }
+long long AllocScope::PeakBytes() const{ return allocThreadPeak - startLive; }
+
+#ifdef ALLOC_TRACKING
+static void* allocTracked(size_t size){
+    void* pointer = allocSystem(size ? size : 1);
+    if (pointer) allocRecord(allocationSize(pointer));
+    return pointer;
+}
+
+static void freeTracked(void* pointer){
+    if (!pointer) return;
+    allocRelease(allocationSize(pointer));
+    freeSystem(pointer);
+}
+
+void* operator new(size_t size){
+    void* pointer = allocTracked(size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{ return allocTracked(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{ return allocTracked(size); }
+void operator delete(void* pointer) noexcept{ freeTracked(pointer); }
+void operator delete[](void* pointer) noexcept{ freeTracked(pointer); }
+void operator delete(void* pointer, size_t) noexcept{ freeTracked(pointer); }
+void operator delete[](void* pointer, size_t) noexcept{ freeTracked(pointer); }
+
+#ifdef ALLOC_TRACK_MALLOC
+extern "C" void* malloc(size_t size){
+    return allocTracked(size);
+}
+
+extern "C" void free(void* pointer){
+    freeTracked(pointer);
+}
+
+extern "C" void* calloc(size_t count, size_t size){
+    void* pointer = __libc_calloc(count, size);
+    if (pointer) allocRecord(allocationSize(pointer));
+    return pointer;
+}
+
+extern "C" void* realloc(void* pointer, size_t size){
+    size_t previous = pointer ? allocationSize(pointer) : 0;
+    void* result = __libc_realloc(pointer, size);
+    if (pointer && (result || !size)) allocRelease(previous);
+    if (result) allocRecord(allocationSize(result));
+    return result;
+}
+
+extern "C" void* memalign(size_t alignment, size_t size){
+    void* pointer = __libc_memalign(alignment, size);
+    if (pointer) allocRecord(allocationSize(pointer));
+    return pointer;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size){
+    return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** result, size_t alignment, size_t size){
+    void* pointer = memalign(alignment, size);
+    if (!pointer) return ENOMEM;
+    *result = pointer;
+    return 0;
+}
+#endif
+#endif
+
+#endif
+
+#endif
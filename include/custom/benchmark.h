@@ -0,0 +1,308 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <custom/camera.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+const float BENCHMARK_TIMESTEP = 1.0f / 60.0f;
+const unsigned int BENCHMARK_WARMUP_FRAMES = 60;
+const double BENCHMARK_TOLERANCE = 0.10;
+
+enum BenchmarkMetric{
+    BENCH_CPU,
+    BENCH_SIMULATION,
+    BENCH_FRAME,
+    BENCH_GPU,
+    BENCH_METRIC_COUNT
+};
+
+// CPU is the render thread's work per frame, frame the interval between two frame starts.
+const char* const BENCH_METRIC_NAMES[BENCH_METRIC_COUNT] = {"cpu", "simulation", "frame", "gpu"};
+
+struct CameraKey{
+    float Time;
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float Zoom;
+};
+
+// Scripted camera flight through keyframes, interpolated with a Catmull-Rom
+// spline so position, yaw, pitch and zoom change without kinks at the keys.
+class CameraPath{
+    public:
+        std::vector<CameraKey> Keys;
+
+        // One key per line: time position.x position.y position.z yaw pitch zoom, # starts a comment.
+        bool Load(const std::string &path){
+            std::ifstream file(path);
+            if (!file){
+                std::cout << "ERROR::BENCHMARK::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+
+            Keys.clear();
+            std::string line;
+            for (unsigned int number = 1; std::getline(file, line); number++){
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+                std::istringstream values(line);
+                CameraKey key;
+                if (!(values >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch >> key.Zoom)
+                    || (!Keys.empty() && key.Time <= Keys.back().Time)){
+                    std::cout << "ERROR::BENCHMARK::INVALID_CAMERA_KEY " << path << ":" << number << std::endl;
+                    return false;
+                }
+                Keys.push_back(key);
+            }
+            if (Keys.size() < 2){
+                std::cout << "ERROR::BENCHMARK::CAMERA_PATH_NEEDS_TWO_KEYS " << path << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        // Circles the center once while looking at it and zooming in and back out.
+        static CameraPath Orbit(glm::vec3 center, float radius, float height, float duration, unsigned int keys = 16){
+            CameraPath path;
+            for (unsigned int i = 0; i <= keys; i++){
+                float angle = glm::two_pi<float>() * i / keys;
+                CameraKey key;
+                key.Time = duration * i / keys;
+                key.Position = center + glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle));
+
+                glm::vec3 direction = glm::normalize(center - key.Position);
+                key.Yaw = glm::degrees(std::atan2(direction.z, direction.x));
+                key.Pitch = glm::degrees(std::asin(direction.y));
+                key.Zoom = ZOOM - 15.0f * std::sin(angle * 0.5f);
+
+                // Keeps the yaw continuous, atan2 jumps from 180 to -180 half way around.
+                if (!path.Keys.empty()){
+                    float previous = path.Keys.back().Yaw;
+                    while (key.Yaw - previous > 180.0f) key.Yaw -= 360.0f;
+                    while (key.Yaw - previous < -180.0f) key.Yaw += 360.0f;
+                }
+                path.Keys.push_back(key);
+            }
+            return path;
+        }
+
+        float Duration() const{
+            return Keys.empty() ? 0.0f : Keys.back().Time - Keys.front().Time;
+        }
+
+        // Time is relative to the first key and clamped to the path.
+        void Sample(float time, Camera &camera) const{
+            if (Keys.empty()) return;
+            time = glm::clamp(Keys.front().Time + time, Keys.front().Time, Keys.back().Time);
+
+            unsigned int segment = 0;
+            while (segment + 2 < Keys.size() && Keys[segment + 1].Time < time) segment++;
+            const CameraKey &p0 = Keys[segment > 0 ? segment - 1 : 0];
+            const CameraKey &p1 = Keys[segment];
+            const CameraKey &p2 = Keys[std::min(segment + 1, (unsigned int)Keys.size() - 1)];
+            const CameraKey &p3 = Keys[std::min(segment + 2, (unsigned int)Keys.size() - 1)];
+            float t = p2.Time > p1.Time ? (time - p1.Time) / (p2.Time - p1.Time) : 0.0f;
+
+            camera.Position = spline(p0.Position, p1.Position, p2.Position, p3.Position, t);
+            camera.Zoom = glm::clamp(spline(p0.Zoom, p1.Zoom, p2.Zoom, p3.Zoom, t), 1.0f, ZOOM);
+            camera.SetOrientation(spline(p0.Yaw, p1.Yaw, p2.Yaw, p3.Yaw, t), glm::clamp(spline(p0.Pitch, p1.Pitch, p2.Pitch, p3.Pitch, t), -89.9f, 89.9f));
+        }
+
+    private:
+        template<typename T>
+        static T spline(const T &p0, const T &p1, const T &p2, const T &p3, float t){
+            float t2 = t * t;
+            float t3 = t2 * t;
+            return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+        }
+};
+
+struct BenchmarkStats{
+    unsigned int Samples;
+    double Mean;
+    double Median;
+    double P95;
+    double P99;
+    double Max;
+};
+
+// Per frame timings of a benchmark run. Storage for every frame is reserved
+// up front so recording never allocates; frames before the warmup is over
+// are ignored. Missing samples (GPU readbacks that were skipped) stay
+// negative and are left out of the statistics.
+class BenchmarkRecorder{
+    public:
+        BenchmarkRecorder(unsigned int warmupFrames, unsigned int frames) : warmup(warmupFrames){
+            samples.assign(frames > warmupFrames ? frames - warmupFrames : 0, Sample());
+        }
+
+        void Record(unsigned long long frame, double cpuMs, double simulationMs, double frameMs){
+            if (Sample* sample = at(frame)){
+                sample->Ms[BENCH_CPU] = cpuMs;
+                sample->Ms[BENCH_SIMULATION] = simulationMs;
+                sample->Ms[BENCH_FRAME] = frameMs;
+            }
+        }
+
+        void RecordGpu(unsigned long long frame, double gpuMs){
+            if (Sample* sample = at(frame)) sample->Ms[BENCH_GPU] = gpuMs;
+        }
+
+        BenchmarkStats Stats(BenchmarkMetric metric) const{
+            std::vector<double> sorted;
+            sorted.reserve(samples.size());
+            for (unsigned int i = 0; i < samples.size(); i++){
+                if (samples[i].Ms[metric] >= 0.0) sorted.push_back(samples[i].Ms[metric]);
+            }
+
+            BenchmarkStats stats = BenchmarkStats{(unsigned int)sorted.size(), 0.0, 0.0, 0.0, 0.0, 0.0};
+            if (sorted.empty()) return stats;
+            std::sort(sorted.begin(), sorted.end());
+
+            double sum = 0.0;
+            for (unsigned int i = 0; i < sorted.size(); i++) sum += sorted[i];
+            stats.Mean = sum / sorted.size();
+            stats.Median = percentile(sorted, 0.5);
+            stats.P95 = percentile(sorted, 0.95);
+            stats.P99 = percentile(sorted, 0.99);
+            stats.Max = sorted.back();
+            return stats;
+        }
+
+        void Report() const{
+            std::cout << std::fixed << std::setprecision(3);
+            for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++){
+                BenchmarkStats stats = Stats((BenchmarkMetric)i);
+                if (!stats.Samples) continue;
+                std::cout << "BENCH::" << std::setw(11) << std::left << BENCH_METRIC_NAMES[i] << std::right
+                          << " mean " << stats.Mean << " median " << stats.Median << " p95 " << stats.P95
+                          << " p99 " << stats.P99 << " max " << stats.Max << "ms (" << stats.Samples << " frames)" << std::endl;
+            }
+            std::cout << std::defaultfloat;
+        }
+
+        bool WriteJson(const std::string &path) const{
+            std::ofstream file(path);
+            if (!file){
+                std::cout << "ERROR::BENCHMARK::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            file << std::fixed << std::setprecision(4);
+            file << "{\n  \"warmup\": " << warmup << ",\n  \"frames\": " << samples.size();
+            for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++){
+                BenchmarkStats stats = Stats((BenchmarkMetric)i);
+                file << ",\n  \"" << BENCH_METRIC_NAMES[i] << "\": {\"samples\": " << stats.Samples << ", \"mean\": " << stats.Mean
+                     << ", \"median\": " << stats.Median << ", \"p95\": " << stats.P95 << ", \"p99\": " << stats.P99 << ", \"max\": " << stats.Max << "}";
+            }
+            file << "\n}\n";
+            return true;
+        }
+
+        // One row per measured frame, missing GPU samples are left empty.
+        bool WriteCsv(const std::string &path) const{
+            std::ofstream file(path);
+            if (!file){
+                std::cout << "ERROR::BENCHMARK::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            file << std::fixed << std::setprecision(4);
+            file << "frame";
+            for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++) file << "," << BENCH_METRIC_NAMES[i] << "_ms";
+            file << "\n";
+            for (unsigned int frame = 0; frame < samples.size(); frame++){
+                file << warmup + frame;
+                for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++){
+                    file << ",";
+                    if (samples[frame].Ms[i] >= 0.0) file << samples[frame].Ms[i];
+                }
+                file << "\n";
+            }
+            return true;
+        }
+
+        // Compares against a JSON report of an earlier run. Mean, median, p95 and p99
+        // regress when they grew by more than the tolerance, max is too noisy to judge.
+        bool Compare(const std::string &baselinePath, double tolerance) const{
+            std::ifstream file(baselinePath);
+            if (!file){
+                std::cout << "ERROR::BENCHMARK::FAILED_TO_OPEN\nPath: " << baselinePath << std::endl;
+                return false;
+            }
+            std::string baseline((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            const char* keys[4] = {"mean", "median", "p95", "p99"};
+            bool passed = true;
+            std::cout << std::fixed << std::setprecision(3);
+            for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++){
+                BenchmarkStats stats = Stats((BenchmarkMetric)i);
+                double current[4] = {stats.Mean, stats.Median, stats.P95, stats.P99};
+                for (unsigned int k = 0; k < 4; k++){
+                    double before;
+                    if (!stats.Samples || !readValue(baseline, BENCH_METRIC_NAMES[i], keys[k], before) || before <= 0.0) continue;
+
+                    double change = current[k] / before - 1.0;
+                    if (change > tolerance){
+                        std::cout << "ERROR::BENCH::REGRESSION " << BENCH_METRIC_NAMES[i] << " " << keys[k] << " " << before << "ms -> "
+                                  << current[k] << "ms (+" << change * 100.0 << "%)" << std::endl;
+                        passed = false;
+                    }
+                }
+            }
+            if (passed) std::cout << "BENCH::BASELINE no regressions above " << tolerance * 100.0 << "% against " << baselinePath << std::endl;
+            std::cout << std::defaultfloat;
+            return passed;
+        }
+
+    private:
+        struct Sample{
+            double Ms[BENCH_METRIC_COUNT];
+
+            Sample(){
+                for (unsigned int i = 0; i < BENCH_METRIC_COUNT; i++) Ms[i] = -1.0;
+            }
+        };
+
+        unsigned int warmup;
+        std::vector<Sample> samples;
+
+        Sample* at(unsigned long long frame){
+            if (frame < warmup || frame - warmup >= samples.size()) return NULL;
+            return &samples[frame - warmup];
+        }
+
+        // Nearest rank, so every reported value is a frame that actually happened.
+        static double percentile(const std::vector<double> &sorted, double fraction){
+            size_t rank = (size_t)std::ceil(fraction * sorted.size());
+            return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+        }
+
+        // Only understands the flat layout WriteJson() produces.
+        static bool readValue(const std::string &json, const char* metric, const char* key, double &value){
+            size_t object = json.find("\"" + std::string(metric) + "\"");
+            if (object == std::string::npos) return false;
+            size_t end = json.find('}', object);
+            size_t at = json.find("\"" + std::string(key) + "\"", object);
+            if (at == std::string::npos || at > end) return false;
+            at = json.find(':', at);
+            if (at == std::string::npos || at > end) return false;
+            value = std::strtod(json.c_str() + at + 1, NULL);
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <custom/job_system.h>
+#include <custom/ktx2.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+// CPU encoders for the BCn formats the renderer uploads. Blocks are 4x4
+// texels of RGBA8 input, loaded into one float array per channel so the
+// per texel loops below are plain fixed length loops the compiler can
+// vectorize. Every encoder fits a line through the block's colors (PCA),
+// picks indices and refits the endpoints by least squares once, which is
+// good enough for baking and fast enough to run over a whole model.
+// BC7 only uses mode 6: one subset, RGBA endpoints and 4 bit indices.
+
+const unsigned int BC_PCA_ITERATIONS = 8;
+const unsigned int BC_REFINE_ITERATIONS = 2;
+
+struct ColorBlock{
+    float Channel[4][16];
+};
+
+inline float bcSquared(float value){ return value * value; }
+
+// Principal axis of the block through power iteration, channels at or past count are ignored.
+inline void bcPrincipalAxis(const ColorBlock &block, unsigned int count, float mean[4], float axis[4]){
+    float covariance[4][4] = {};
+    for (unsigned int c = 0; c < count; c++){
+        float sum = 0.0f;
+        for (unsigned int i = 0; i < 16; i++) sum += block.Channel[c][i];
+        mean[c] = sum / 16.0f;
+    }
+    for (unsigned int a = 0; a < count; a++){
+        for (unsigned int b = a; b < count; b++){
+            float sum = 0.0f;
+            for (unsigned int i = 0; i < 16; i++) sum += (block.Channel[a][i] - mean[a]) * (block.Channel[b][i] - mean[b]);
+            covariance[a][b] = covariance[b][a] = sum;
+        }
+    }
+
+    for (unsigned int c = 0; c < 4; c++) axis[c] = c < count ? 1.0f : 0.0f;
+    for (unsigned int iteration = 0; iteration < BC_PCA_ITERATIONS; iteration++){
+        float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        float length = 0.0f;
+        for (unsigned int a = 0; a < count; a++){
+            for (unsigned int b = 0; b < count; b++) next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f) break;
+        length = 1.0f / std::sqrt(length);
+        for (unsigned int c = 0; c < count; c++) axis[c] = next[c] * length;
+    }
+}
+
+// Least squares endpoints for fixed interpolation weights (weight of the second endpoint per texel).
+inline bool bcRefit(const ColorBlock &block, unsigned int count, const float weights[16], float e0[4], float e1[4]){
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (unsigned int i = 0; i < 16; i++){
+        float b = weights[i], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (unsigned int c = 0; c < count; c++){
+            ax[c] += a * block.Channel[c][i];
+            bx[c] += b * block.Channel[c][i];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) return false;
+    determinant = 1.0f / determinant;
+    for (unsigned int c = 0; c < count; c++){
+        e0[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) * determinant));
+        e1[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) * determinant));
+    }
+    return true;
+}
+
+class BlockBitWriter{
+    public:
+        BlockBitWriter(unsigned char* out, unsigned int bytes) : out(out), position(0){
+            std::memset(out, 0, bytes);
+        }
+
+        void Write(unsigned int value, unsigned int bits){
+            for (unsigned int i = 0; i < bits; i++, position++){
+                if (value >> i & 1) out[position / 8] |= 1 << (position % 8);
+            }
+        }
+
+    private:
+        unsigned char* out;
+        unsigned int position;
+};
+
+inline unsigned int bcPack565(const float color[4]){
+    unsigned int r = (unsigned int)(color[0] * 31.0f / 255.0f + 0.5f);
+    unsigned int g = (unsigned int)(color[1] * 63.0f / 255.0f + 0.5f);
+    unsigned int b = (unsigned int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return r << 11 | g << 5 | b;
+}
+
+inline void bcUnpack565(unsigned int color, float out[4]){
+    unsigned int r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+    out[0] = (float)(r << 3 | r >> 2);
+    out[1] = (float)(g << 2 | g >> 4);
+    out[2] = (float)(b << 3 | b >> 2);
+}
+
+// Four color BC1 indices for two 565 endpoints, returns the squared error.
+inline float bc1Indices(const ColorBlock &block, unsigned int c0, unsigned int c1, unsigned int indices[16]){
+    float palette[4][4];
+    bcUnpack565(c0, palette[0]);
+    bcUnpack565(c1, palette[1]);
+    for (unsigned int c = 0; c < 3; c++){
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    float error = 0.0f;
+    for (unsigned int i = 0; i < 16; i++){
+        float best = 1e30f;
+        for (unsigned int p = 0; p < 4; p++){
+            float distance = bcSquared(block.Channel[0][i] - palette[p][0]) + bcSquared(block.Channel[1][i] - palette[p][1]) + bcSquared(block.Channel[2][i] - palette[p][2]);
+            if (distance < best){
+                best = distance;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// The 8 value BC4 palette for a0 > a1, returns the squared error.
+inline float bc4Indices(const float values[16], unsigned int a0, unsigned int a1, unsigned int indices[16]){
+    float palette[8] = {(float)a0, (float)a1};
+    for (unsigned int p = 2; p < 8; p++) palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7.0f;
+    float error = 0.0f;
+    for (unsigned int i = 0; i < 16; i++){
+        float best = 1e30f;
+        for (unsigned int p = 0; p < 8; p++){
+            float distance = bcSquared(values[i] - palette[p]);
+            if (distance < best){
+                best = distance;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+const unsigned int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Mode 6 endpoints are 7 bits per channel plus one shared low bit per endpoint.
+inline void bc7Quantize(const float endpoint[4], unsigned int quantized[4], unsigned int &pbit){
+    float bestError = 1e30f;
+    for (unsigned int p = 0; p < 2; p++){
+        unsigned int candidate[4];
+        float error = 0.0f;
+        for (unsigned int c = 0; c < 4; c++){
+            int q = (int)std::floor((endpoint[c] - p) / 2.0f + 0.5f);
+            candidate[c] = (unsigned int)std::min(127, std::max(0, q));
+            error += bcSquared((float)(candidate[c] << 1 | p) - endpoint[c]);
+        }
+        if (error < bestError){
+            bestError = error;
+            pbit = p;
+            std::memcpy(quantized, candidate, sizeof(candidate));
+        }
+    }
+}
+
+inline float bc7Indices(const ColorBlock &block, const unsigned int q0[4], unsigned int p0, const unsigned int q1[4], unsigned int p1, unsigned int indices[16]){
+    float palette[16][4];
+    for (unsigned int c = 0; c < 4; c++){
+        unsigned int e0 = q0[c] << 1 | p0, e1 = q1[c] << 1 | p1;
+        for (unsigned int p = 0; p < 16; p++) palette[p][c] = (float)(((64 - BC7_WEIGHTS[p]) * e0 + BC7_WEIGHTS[p] * e1 + 32) >> 6);
+    }
+    float error = 0.0f;
+    for (unsigned int i = 0; i < 16; i++){
+        float best = 1e30f;
+        for (unsigned int p = 0; p < 16; p++){
+            float distance = 0.0f;
+            for (unsigned int c = 0; c < 4; c++) distance += bcSquared(block.Channel[c][i] - palette[p][c]);
+            if (distance < best){
+                best = distance;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// 8 bytes, opaque four color blocks.
+inline void EncodeBC1(const ColorBlock &block, unsigned char out[8]){
+    float mean[4], axis[4], e0[4] = {}, e1[4] = {};
+    bcPrincipalAxis(block, 3, mean, axis);
+    float low = 1e30f, high = -1e30f;
+    for (unsigned int i = 0; i < 16; i++){
+        float t = 0.0f;
+        for (unsigned int c = 0; c < 3; c++) t += (block.Channel[c][i] - mean[c]) * axis[c];
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    for (unsigned int c = 0; c < 3; c++){
+        e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+        e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+    }
+
+    unsigned int c0 = bcPack565(e0), c1 = bcPack565(e1), indices[16];
+    float error = bc1Indices(block, c0, c1, indices);
+    for (unsigned int iteration = 0; iteration < BC_REFINE_ITERATIONS; iteration++){
+        const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        float texelWeights[16];
+        for (unsigned int i = 0; i < 16; i++) texelWeights[i] = weights[indices[i]];
+        if (!bcRefit(block, 3, texelWeights, e0, e1)) break;
+        unsigned int r0 = bcPack565(e0), r1 = bcPack565(e1), refined[16];
+        float refinedError = bc1Indices(block, r0, r1, refined);
+        if (refinedError >= error) break;
+        error = refinedError;
+        c0 = r0;
+        c1 = r1;
+        std::memcpy(indices, refined, sizeof(refined));
+    }
+
+    // c0 > c1 selects the four color mode, swapping the endpoints mirrors the indices.
+    if (c0 < c1){
+        std::swap(c0, c1);
+        const unsigned int mirrored[4] = {1, 0, 3, 2};
+        for (unsigned int i = 0; i < 16; i++) indices[i] = mirrored[indices[i]];
+    }else if (c0 == c1){
+        for (unsigned int i = 0; i < 16; i++) indices[i] = 0;
+    }
+    BlockBitWriter bits(out, 8);
+    bits.Write(c0, 16);
+    bits.Write(c1, 16);
+    for (unsigned int i = 0; i < 16; i++) bits.Write(indices[i], 2);
+}
+
+// 8 bytes, one channel.
+inline void EncodeBC4(const float values[16], unsigned char out[8]){
+    float low = 255.0f, high = 0.0f;
+    for (unsigned int i = 0; i < 16; i++){
+        low = std::min(low, values[i]);
+        high = std::max(high, values[i]);
+    }
+    unsigned int a0 = (unsigned int)(high + 0.5f), a1 = (unsigned int)(low + 0.5f), indices[16];
+    float error = bc4Indices(values, a0, a1, indices);
+    // Pulling the endpoints in by a step often beats the extremes, the outliers are rarely worth it.
+    for (unsigned int iteration = 0; iteration < BC_REFINE_ITERATIONS && a0 > a1 + 1; iteration++){
+        const float weights[8] = {0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f};
+        ColorBlock block;
+        float texelWeights[16], e0[4], e1[4];
+        for (unsigned int i = 0; i < 16; i++){
+            block.Channel[0][i] = values[i];
+            texelWeights[i] = weights[indices[i]];
+        }
+        if (!bcRefit(block, 1, texelWeights, e0, e1)) break;
+        unsigned int r0 = (unsigned int)(e0[0] + 0.5f), r1 = (unsigned int)(e1[0] + 0.5f), refined[16];
+        if (r0 <= r1) break;
+        float refinedError = bc4Indices(values, r0, r1, refined);
+        if (refinedError >= error) break;
+        error = refinedError;
+        a0 = r0;
+        a1 = r1;
+        std::memcpy(indices, refined, sizeof(refined));
+    }
+
+    BlockBitWriter bits(out, 8);
+    bits.Write(a0, 8);
+    bits.Write(a1, 8);
+    for (unsigned int i = 0; i < 16; i++) bits.Write(a0 == a1 ? 0 : indices[i], 3);
+}
+
+// 16 bytes, BC4 alpha followed by a BC1 color block.
+inline void EncodeBC3(const ColorBlock &block, unsigned char out[16]){
+    EncodeBC4(block.Channel[3], out);
+    EncodeBC1(block, out + 8);
+}
+
+// 16 bytes, two independent BC4 channels.
+inline void EncodeBC5(const ColorBlock &block, unsigned char out[16]){
+    EncodeBC4(block.Channel[0], out);
+    EncodeBC4(block.Channel[1], out + 8);
+}
+
+// 16 bytes, mode 6.
+inline void EncodeBC7(const ColorBlock &block, unsigned char out[16]){
+    float mean[4], axis[4], e0[4], e1[4];
+    bcPrincipalAxis(block, 4, mean, axis);
+    float low = 1e30f, high = -1e30f;
+    for (unsigned int i = 0; i < 16; i++){
+        float t = 0.0f;
+        for (unsigned int c = 0; c < 4; c++) t += (block.Channel[c][i] - mean[c]) * axis[c];
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    for (unsigned int c = 0; c < 4; c++){
+        e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+        e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+    }
+
+    unsigned int q0[4], q1[4], p0 = 0, p1 = 0, indices[16];
+    bc7Quantize(e0, q0, p0);
+    bc7Quantize(e1, q1, p1);
+    float error = bc7Indices(block, q0, p0, q1, p1, indices);
+    for (unsigned int iteration = 0; iteration < BC_REFINE_ITERATIONS; iteration++){
+        float texelWeights[16];
+        for (unsigned int i = 0; i < 16; i++) texelWeights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+        if (!bcRefit(block, 4, texelWeights, e0, e1)) break;
+        unsigned int r0[4], r1[4], rp0 = 0, rp1 = 0, refined[16];
+        bc7Quantize(e0, r0, rp0);
+        bc7Quantize(e1, r1, rp1);
+        float refinedError = bc7Indices(block, r0, rp0, r1, rp1, refined);
+        if (refinedError >= error) break;
+        error = refinedError;
+        std::memcpy(q0, r0, sizeof(r0));
+        std::memcpy(q1, r1, sizeof(r1));
+        p0 = rp0;
+        p1 = rp1;
+        std::memcpy(indices, refined, sizeof(refined));
+    }
+
+    // The first index is stored without its top bit, swapping the endpoints mirrors the weights.
+    if (indices[0] & 8){
+        for (unsigned int c = 0; c < 4; c++) std::swap(q0[c], q1[c]);
+        std::swap(p0, p1);
+        for (unsigned int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+    BlockBitWriter bits(out, 16);
+    bits.Write(1 << 6, 7);
+    for (unsigned int c = 0; c < 4; c++){
+        bits.Write(q0[c], 7);
+        bits.Write(q1[c], 7);
+    }
+    bits.Write(p0, 1);
+    bits.Write(p1, 1);
+    bits.Write(indices[0], 3);
+    for (unsigned int i = 1; i < 16; i++) bits.Write(indices[i], 4);
+}
+
+// Compresses one RGBA8 image into the blocks of format, one job per row of blocks. channels picks
+// the source channel of every block channel, e.g. {1, 2, 0, 0} stores green and blue as BC5.
+// Partial blocks at the right and bottom edge repeat the last texel.
+inline std::vector<unsigned char> CompressImage(const Ktx2Format &format, const unsigned char* rgba, unsigned int width, unsigned int height,
+                                                JobSystem* jobs, const unsigned int channels[4]){
+    unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    std::vector<unsigned char> out((size_t)blocksX * blocksY * format.BlockBytes);
+    auto encodeRows = [&](unsigned int begin, unsigned int end){
+        ColorBlock block;
+        for (unsigned int by = begin; by < end; by++){
+            for (unsigned int bx = 0; bx < blocksX; bx++){
+                for (unsigned int i = 0; i < 16; i++){
+                    unsigned int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                    const unsigned char* texel = rgba + ((size_t)y * width + x) * 4;
+                    for (unsigned int c = 0; c < 4; c++) block.Channel[c][i] = texel[channels[c]];
+                }
+                unsigned char* target = &out[((size_t)by * blocksX + bx) * format.BlockBytes];
+                switch (format.VkFormat){
+                    case KTX2_BC1_RGB_UNORM: EncodeBC1(block, target); break;
+                    case KTX2_BC3_UNORM: EncodeBC3(block, target); break;
+                    case KTX2_BC4_UNORM: EncodeBC4(block.Channel[0], target); break;
+                    case KTX2_BC5_UNORM: EncodeBC5(block, target); break;
+                    case KTX2_BC7_UNORM: EncodeBC7(block, target); break;
+                    default: break;
+                }
+            }
+        }
+    };
+    if (jobs) jobs->ParallelFor(blocksY, 1, encodeRows);
+    else encodeRows(0, blocksY);
+    return out;
+}
+
+#endif
@@ -76,6 +76,12 @@ class Camera{
             else if (Zoom > 45.0f) Zoom = 45.0f;
         }
 
+        void SetOrientation(float yaw, float pitch){
+            Yaw = yaw;
+            Pitch = pitch;
+            updateVectors();
+        }
+
     private:
         void updateVectors(){
             glm::vec3 direction;
@@ -0,0 +1,225 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <custom/mesh.h>
+#include <custom/shader.h>
+#include <custom/gl_state.h>
+#include <custom/perf_counters.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+const unsigned int COMMAND_BUFFER_SIZE = 64 * 1024;
+const unsigned int COMMAND_ALIGNMENT = 16;
+const unsigned int COMMAND_MAX_TEXTURES = 16;
+const unsigned int COMMAND_TYPE_TEXTURES = 4;
+const unsigned int COMMAND_TEXTURE_TYPES = 4;
+
+enum CommandType{
+    CMD_BIND_PROGRAM,
+    CMD_BIND_MATERIAL,
+    CMD_SET_DRAW_DATA,
+    CMD_DRAW
+};
+
+// Uniform locations of a shader, resolved once on the GL thread so that
+// recording threads never have to query GL.
+struct DrawProgram{
+    unsigned int Program;
+    int Model;
+    int NormalMat;
+    int Shininess;
+    int Samplers[COMMAND_TEXTURE_TYPES * COMMAND_TYPE_TEXTURES];
+
+    DrawProgram(const Shader &shader){
+        static const char* types[COMMAND_TEXTURE_TYPES] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+
+        Program = shader.ID;
+        Model = glGetUniformLocation(Program, "model");
+        NormalMat = glGetUniformLocation(Program, "normalMat");
+        Shininess = glGetUniformLocation(Program, "material.shininess");
+        for (unsigned int t = 0; t < COMMAND_TEXTURE_TYPES; t++){
+            for (unsigned int i = 0; i < COMMAND_TYPE_TEXTURES; i++){
+                std::string name = std::string("material.") + types[t] + "[" + std::to_string(i) + "]";
+                Samplers[t * COMMAND_TYPE_TEXTURES + i] = glGetUniformLocation(Program, name.c_str());
+            }
+        }
+    }
+};
+
+struct CommandHeader{
+    unsigned int Type;
+    unsigned int Size;
+};
+
+struct BindProgramCommand{
+    CommandHeader Header;
+    const DrawProgram* Program;
+};
+
+struct BindMaterialCommand{
+    CommandHeader Header;
+    unsigned int Count;
+    unsigned int Textures[COMMAND_MAX_TEXTURES];
+    unsigned char Samplers[COMMAND_MAX_TEXTURES];
+    float Shininess;
+};
+
+struct SetDrawDataCommand{
+    CommandHeader Header;
+    glm::mat4 Model;
+    glm::mat3 NormalMat;
+};
+
+struct DrawCommand{
+    CommandHeader Header;
+    unsigned int VAO;
+    unsigned int Count;
+    unsigned int Instances;
+};
+
+// Records POD draw commands into one linear allocation without touching GL,
+// so any thread can fill a buffer. Execute() replays them on the GL thread.
+// Reset() keeps the allocation, a buffer that is reused every frame stops
+// allocating once it has grown to the largest frame.
+class CommandBuffer{
+    public:
+        CommandBuffer(size_t capacity = COMMAND_BUFFER_SIZE) : used(0), commands(0), program(NULL), material(NULL){
+            storage.resize(capacity);
+        }
+
+        void Reset(){
+            used = 0;
+            commands = 0;
+            program = NULL;
+            material = NULL;
+        }
+
+        void BindProgram(const DrawProgram &drawProgram){
+            if (program == &drawProgram) return;
+            BindProgramCommand* command = allocate<BindProgramCommand>(CMD_BIND_PROGRAM);
+            command->Program = &drawProgram;
+            program = &drawProgram;
+            material = NULL;
+        }
+
+        // Consecutive meshes that share their textures only bind them once.
+        void BindMaterial(const Mesh &mesh){
+            if (material && material->textures.size() == mesh.textures.size()){
+                bool same = true;
+                for (unsigned int i = 0; i < mesh.textures.size() && same; i++){
+                    same = material->textures[i].id == mesh.textures[i].id;
+                }
+                if (same) return;
+            }
+
+            BindMaterialCommand* command = allocate<BindMaterialCommand>(CMD_BIND_MATERIAL);
+            unsigned int numbers[COMMAND_TEXTURE_TYPES] = {0, 0, 0, 0};
+            command->Count = 0;
+            command->Shininess = 32.0f;
+            for (unsigned int i = 0; i < mesh.textures.size() && command->Count < COMMAND_MAX_TEXTURES; i++){
+                int type = textureType(mesh.textures[i].type);
+                if (type < 0 || numbers[type] >= COMMAND_TYPE_TEXTURES) continue;
+
+                command->Textures[command->Count] = mesh.textures[i].id;
+                command->Samplers[command->Count] = type * COMMAND_TYPE_TEXTURES + numbers[type]++;
+                command->Count++;
+            }
+            material = &mesh;
+        }
+
+        void SetDrawData(const glm::mat4 &model, const glm::mat3 &normalMat){
+            SetDrawDataCommand* command = allocate<SetDrawDataCommand>(CMD_SET_DRAW_DATA);
+            command->Model = model;
+            command->NormalMat = normalMat;
+        }
+
+        void Draw(const Mesh &mesh, unsigned int instances = 1){
+            DrawCommand* command = allocate<DrawCommand>(CMD_DRAW);
+            command->VAO = mesh.VAO;
+            command->Count = mesh.IndexCount;
+            command->Instances = instances;
+        }
+
+        void Execute() const{
+            PROFILE_ZONE("execute commands");
+            PERF_PHASE("submit");
+            const DrawProgram* current = NULL;
+            for (size_t offset = 0; offset < used; ){
+                const CommandHeader* header = (const CommandHeader*)&storage[offset];
+                switch (header->Type){
+                    case CMD_BIND_PROGRAM:{
+                        current = ((const BindProgramCommand*)header)->Program;
+                        GLState().UseProgram(current->Program);
+                        break;
+                    }
+                    case CMD_BIND_MATERIAL:{
+                        const BindMaterialCommand* command = (const BindMaterialCommand*)header;
+                        for (unsigned int i = 0; i < command->Count; i++){
+                            GLState().BindTexture(i, command->Textures[i]);
+                            glUniform1i(current->Samplers[command->Samplers[i]], i);
+                        }
+                        glUniform1f(current->Shininess, command->Shininess);
+                        break;
+                    }
+                    case CMD_SET_DRAW_DATA:{
+                        const SetDrawDataCommand* command = (const SetDrawDataCommand*)header;
+                        glUniformMatrix4fv(current->Model, 1, GL_FALSE, glm::value_ptr(command->Model));
+                        glUniformMatrix3fv(current->NormalMat, 1, GL_FALSE, glm::value_ptr(command->NormalMat));
+                        break;
+                    }
+                    case CMD_DRAW:{
+                        const DrawCommand* command = (const DrawCommand*)header;
+                        GLState().BindVertexArray(command->VAO);
+                        if (command->Instances == 1) glDrawElements(GL_TRIANGLES, command->Count, GL_UNSIGNED_INT, 0);
+                        else glDrawElementsInstanced(GL_TRIANGLES, command->Count, GL_UNSIGNED_INT, 0, command->Instances);
+                        break;
+                    }
+                }
+                offset += header->Size;
+            }
+        }
+
+        size_t Size() const{ return used; }
+        unsigned int CommandCount() const{ return commands; }
+
+    private:
+        std::vector<unsigned char> storage;
+        size_t used;
+        unsigned int commands;
+        const DrawProgram* program;
+        const Mesh* material;
+
+        template<typename T>
+        T* allocate(unsigned int type){
+            size_t size = (sizeof(T) + COMMAND_ALIGNMENT - 1) & ~(size_t)(COMMAND_ALIGNMENT - 1);
+            if (used + size > storage.size()){
+                storage.resize(std::max(storage.size() * 2, used + size));
+            }
+
+            T* command = (T*)&storage[used];
+            command->Header.Type = type;
+            command->Header.Size = size;
+            used += size;
+            commands++;
+            return command;
+        }
+
+        static int textureType(const std::string &type){
+            if (type == "texture_diffuse") return 0;
+            if (type == "texture_specular") return 1;
+            if (type == "texture_normal") return 2;
+            if (type == "texture_height") return 3;
+            return -1;
+        }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <glm/glm.hpp>
+
+#include <custom/mesh.h>
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+const unsigned int FRAME_PACKET_SLOTS = 3;
+const double FRAME_REPORT_INTERVAL = 1000.0;
+
+// Color scales the default diffuse and specular of the light setters, white keeps them.
+struct PointLightState{
+    glm::vec3 Position;
+    glm::vec3 Color;
+};
+
+struct SpotLightState{
+    glm::vec3 Position;
+    glm::vec3 Direction;
+    glm::vec3 Color;
+};
+
+struct DrawItem{
+    unsigned int Object;
+    unsigned int Cell;
+    glm::mat4 Transform;
+};
+
+// Everything the render thread needs for one frame. Packets are reused, so
+// the vectors keep their capacity and steady state frames do not allocate.
+struct FramePacket{
+    unsigned long long Frame;
+    unsigned int Width;
+    unsigned int Height;
+
+    glm::mat4 View;
+    glm::mat4 Projection;
+    glm::vec3 ViewPos;
+    glm::vec3 ViewVelocity;
+
+    std::vector<PointLightState> PointLights;
+    std::vector<SpotLightState> SpotLights;
+    std::vector<DrawItem> Draws;
+
+    double SimulationBegin;
+    double SimulationEnd;
+};
+
+inline double FrameTimeMs(){
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline bool FrustumVisible(const glm::mat4 &viewProjection, const AABB &bounds){
+    glm::mat4 m = glm::transpose(viewProjection);
+    glm::vec4 planes[6] = {m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]};
+
+    for (unsigned int i = 0; i < 6; i++){
+        glm::vec3 v(planes[i].x > 0.0f ? bounds.Max.x : bounds.Min.x,
+                    planes[i].y > 0.0f ? bounds.Max.y : bounds.Min.y,
+                    planes[i].z > 0.0f ? bounds.Max.z : bounds.Min.z);
+        if (glm::dot(glm::vec3(planes[i]), v) + planes[i].w < 0.0f) return false;
+    }
+    return true;
+}
+
+// Triple buffered hand off between the simulation and the render thread. The
+// producer may run at most one packet ahead of the consumer: while packet N
+// is rendered, packet N + 1 is being written and the third slot holds the
+// packet that was published last.
+class FrameMailbox{
+    public:
+        double ProducerWaitMs;
+        double ConsumerWaitMs;
+
+        FrameMailbox() : ProducerWaitMs(0.0), ConsumerWaitMs(0.0), write(0), ready(1), read(2), fresh(false), closed(false){}
+
+        FrameMailbox(const FrameMailbox&) = delete;
+        FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+        // Returns NULL once the mailbox is closed.
+        FramePacket* BeginWrite(){
+            std::unique_lock<std::mutex> lock(mutex);
+            double begin = FrameTimeMs();
+            condition.wait(lock, [this](){ return !fresh || closed; });
+            ProducerWaitMs += FrameTimeMs() - begin;
+            return closed ? NULL : &packets[write];
+        }
+
+        void Publish(){
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(write, ready);
+            fresh = true;
+            condition.notify_all();
+        }
+
+        // Blocks until a new packet is published, returns NULL once the mailbox is closed and drained.
+        const FramePacket* Acquire(){
+            std::unique_lock<std::mutex> lock(mutex);
+            double begin = FrameTimeMs();
+            condition.wait(lock, [this](){ return fresh || closed; });
+            ConsumerWaitMs += FrameTimeMs() - begin;
+            if (!fresh) return NULL;
+
+            std::swap(read, ready);
+            fresh = false;
+            condition.notify_all();
+            return &packets[read];
+        }
+
+        void Close(){
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            condition.notify_all();
+        }
+
+        bool IsClosed(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return closed;
+        }
+
+    private:
+        FramePacket packets[FRAME_PACKET_SLOTS];
+        unsigned int write;
+        unsigned int ready;
+        unsigned int read;
+        bool fresh;
+        bool closed;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+};
+
+struct FrameTiming{
+    unsigned int Frames;
+    double SimulationMs;
+    double RenderMs;
+    double FrameMs;
+    double OverlapMs;
+};
+
+// Measures how much simulation and rendering run concurrently. Packet N + 1
+// is simulated while packet N is rendered, so every simulation interval is
+// intersected with the render interval of the previous packet.
+class FrameTimeline{
+    public:
+        FrameTiming Last;
+
+        FrameTimeline() : Last(FrameTiming{0, 0.0, 0.0, 0.0, 0.0}), current(Last), previousBegin(-1.0), previousEnd(-1.0), reportBegin(-1.0){}
+
+        // Returns true when this frame closed a report interval.
+        bool Record(const FramePacket &packet, double renderBegin, double renderEnd){
+            if (reportBegin < 0.0) reportBegin = renderBegin;
+
+            current.Frames++;
+            current.SimulationMs += packet.SimulationEnd - packet.SimulationBegin;
+            current.RenderMs += renderEnd - renderBegin;
+            if (previousBegin >= 0.0){
+                current.FrameMs += renderBegin - previousBegin;
+                current.OverlapMs += std::max(0.0, std::min(packet.SimulationEnd, previousEnd) - std::max(packet.SimulationBegin, previousBegin));
+            }
+            previousBegin = renderBegin;
+            previousEnd = renderEnd;
+
+            if (renderEnd - reportBegin >= FRAME_REPORT_INTERVAL){
+                Last = current;
+                current = FrameTiming{0, 0.0, 0.0, 0.0, 0.0};
+                reportBegin = renderEnd;
+                Report();
+                return true;
+            }
+            return false;
+        }
+
+        // Overlap is the share of simulation time that ran while the previous frame was rendering.
+        void Report() const{
+            if (!Last.Frames) return;
+            double frames = Last.Frames;
+            double overlap = Last.SimulationMs > 0.0 ? 100.0 * Last.OverlapMs / Last.SimulationMs : 0.0;
+            std::cout << "FRAME::TIMING sim " << Last.SimulationMs / frames << "ms render " << Last.RenderMs / frames
+                      << "ms frame " << Last.FrameMs / frames << "ms overlap " << overlap << "%" << std::endl;
+        }
+
+    private:
+        FrameTiming current;
+        double previousBegin;
+        double previousEnd;
+        double reportBegin;
+};
+
+#endif
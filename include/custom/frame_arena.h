@@ -0,0 +1,157 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <cstddef>
+#include <cassert>
+#include <iostream>
+
+#include <custom/alloc_tracker.h>
+
+const size_t FRAME_ARENA_SIZE = 256 * 1024;
+const unsigned int FRAME_ARENA_WARMUP_FRAMES = 8;
+
+// Bump allocator for data that only lives until the end of the frame. Each
+// thread with a frame loop owns one (see ThreadFrameArena) and resets it when
+// its frame starts. Allocations that do not fit the block go to overflow
+// blocks, and the next Reset() replaces everything by one block of the high
+// water mark, so steady state frames never reach the heap.
+class FrameArena{
+    public:
+        FrameArena(size_t size = FRAME_ARENA_SIZE) : block(NULL), capacity(0), used(0), overflowUsed(0), highWater(0){
+            grow(size);
+        }
+
+        ~FrameArena(){
+            release();
+            std::free(block);
+        }
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)){
+            size_t offset = (used + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= capacity){
+                used = offset + size;
+                updateHighWater();
+                return block + offset;
+            }
+
+            // The overflow block is sized for the alignment so the result can be aligned inside it.
+            void* overflow = std::malloc(size + alignment);
+            overflows.push_back(overflow);
+            overflowUsed += size + alignment;
+            updateHighWater();
+
+            size_t address = ((size_t)overflow + alignment - 1) & ~(alignment - 1);
+            return (void*)address;
+        }
+
+        void Reset(){
+            if (!overflows.empty()){
+                release();
+                grow(highWater);
+            }
+            used = 0;
+        }
+
+        size_t Used() const{ return used + overflowUsed; }
+        size_t Capacity() const{ return capacity; }
+        size_t HighWater() const{ return highWater; }
+
+    private:
+        char* block;
+        size_t capacity;
+        size_t used;
+        size_t overflowUsed;
+        size_t highWater;
+        std::vector<void*> overflows;
+
+        void grow(size_t size){
+            std::free(block);
+            block = (char*)std::malloc(size);
+            capacity = size;
+        }
+
+        void release(){
+            for (unsigned int i = 0; i < overflows.size(); i++){
+                std::free(overflows[i]);
+            }
+            overflows.clear();
+            overflowUsed = 0;
+        }
+
+        void updateHighWater(){
+            if (used + overflowUsed > highWater) highWater = used + overflowUsed;
+        }
+};
+
+inline FrameArena& ThreadFrameArena(){
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+// STL allocator on top of the calling thread's frame arena, deallocate is a no-op.
+template<typename T>
+class FrameAllocator{
+    public:
+        typedef T value_type;
+
+        FrameAllocator() : arena(&ThreadFrameArena()){}
+        FrameAllocator(FrameArena &arena) : arena(&arena){}
+        template<typename U>
+        FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena){}
+
+        T* allocate(size_t count){
+            return (T*)arena->Allocate(count * sizeof(T), alignof(T));
+        }
+
+        void deallocate(T*, size_t){}
+
+        template<typename U>
+        bool operator==(const FrameAllocator<U> &other) const{ return arena == other.arena; }
+        template<typename U>
+        bool operator!=(const FrameAllocator<U> &other) const{ return arena != other.arena; }
+
+    private:
+        FrameArena* arena;
+
+        template<typename U>
+        friend class FrameAllocator;
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocator<char>> FrameString;
+
+// Asserts that the enclosing scope did not allocate on the heap from the calling thread,
+// FRAME_ARENA_DEBUG turns on the allocation tracker to count them.
+class FrameAllocationCheck{
+    public:
+        FrameAllocationCheck(const char* scope, bool enabled = true) : scope(scope), enabled(enabled), start(AllocTracker::Thread().Allocations){}
+
+        ~FrameAllocationCheck(){
+            unsigned long long allocations = AllocTracker::Thread().Allocations - start;
+            if (enabled && allocations){
+                std::cout << "ERROR::FRAME_ARENA::HEAP_ALLOCATION_IN_STEADY_STATE " << scope << " made " << allocations << " allocations" << std::endl;
+                assert(false);
+            }
+        }
+
+    private:
+        const char* scope;
+        bool enabled;
+        unsigned long long start;
+};
+
+#ifdef FRAME_ARENA_DEBUG
+#define FRAME_NO_HEAP_ALLOCATIONS(scope, enabled) FrameAllocationCheck frameAllocationCheck(scope, enabled)
+#else
+#define FRAME_NO_HEAP_ALLOCATIONS(scope, enabled)
+#endif
+
+#endif
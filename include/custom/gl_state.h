@@ -0,0 +1,272 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+const unsigned int GL_STATE_TEXTURE_UNITS = 32;
+const unsigned int GL_STATE_BUFFER_BINDINGS = 16;
+const unsigned int GL_STATE_UNKNOWN = 0xFFFFFFFF;
+
+enum GLStateCall{
+    GL_STATE_PROGRAM,
+    GL_STATE_VERTEX_ARRAY,
+    GL_STATE_TEXTURE,
+    GL_STATE_BUFFER,
+    GL_STATE_CAPABILITY,
+    GL_STATE_DEPTH_BLEND,
+    GL_STATE_VIEWPORT,
+    GL_STATE_FRAMEBUFFER,
+    GL_STATE_CALL_COUNT
+};
+
+const char* const GL_STATE_CALL_NAMES[GL_STATE_CALL_COUNT] = {"program", "vertex array", "texture", "buffer", "enable/disable", "depth/blend", "viewport", "framebuffer"};
+
+struct GLStateStats{
+    unsigned long long Issued[GL_STATE_CALL_COUNT];
+    unsigned long long Elided[GL_STATE_CALL_COUNT];
+
+    unsigned long long TotalIssued() const{
+        unsigned long long total = 0;
+        for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++) total += Issued[i];
+        return total;
+    }
+    unsigned long long TotalElided() const{
+        unsigned long long total = 0;
+        for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++) total += Elided[i];
+        return total;
+    }
+};
+
+// Shadows the GL state the renderer touches and drops calls that would not
+// change it. Everything on the GL thread has to go through here for the
+// shadow to stay right; after anything else touched GL state, call
+// Invalidate(). Textures are always bound with glBindTextureUnit, so the
+// active texture unit stays GL_TEXTURE0.
+class GLStateCache{
+    public:
+        GLStateCache(){
+            Invalidate();
+            clear(frame);
+            clear(window);
+            windowFrames = 0;
+        }
+
+        GLStateCache(const GLStateCache&) = delete;
+        GLStateCache& operator=(const GLStateCache&) = delete;
+
+        void Invalidate(){
+            program = GL_STATE_UNKNOWN;
+            vertexArray = GL_STATE_UNKNOWN;
+            for (unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) textures[i] = GL_STATE_UNKNOWN;
+            arrayBuffer = indirectBuffer = storageBuffer = GL_STATE_UNKNOWN;
+            for (unsigned int i = 0; i < GL_STATE_BUFFER_BINDINGS; i++) storageBindings[i] = GL_STATE_UNKNOWN;
+            depthTest = blend = cullFace = -1;
+            depthFunc = blendSource = blendDestination = GL_STATE_UNKNOWN;
+            depthMask = -1;
+            viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+            framebuffer = GL_STATE_UNKNOWN;
+        }
+
+        // Deleting a bound object unbinds it, and its name can come back from the next glGen*.
+        void ForgetProgram(unsigned int id){
+            if (program == id) program = GL_STATE_UNKNOWN;
+        }
+        void ForgetVertexArray(unsigned int id){
+            if (vertexArray == id) vertexArray = GL_STATE_UNKNOWN;
+        }
+        void ForgetTexture(unsigned int id){
+            for (unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++){
+                if (textures[i] == id) textures[i] = GL_STATE_UNKNOWN;
+            }
+        }
+        void ForgetBuffer(unsigned int id){
+            if (arrayBuffer == id) arrayBuffer = GL_STATE_UNKNOWN;
+            if (indirectBuffer == id) indirectBuffer = GL_STATE_UNKNOWN;
+            if (storageBuffer == id) storageBuffer = GL_STATE_UNKNOWN;
+            for (unsigned int i = 0; i < GL_STATE_BUFFER_BINDINGS; i++){
+                if (storageBindings[i] == id) storageBindings[i] = GL_STATE_UNKNOWN;
+            }
+        }
+        void ForgetFramebuffer(unsigned int id){
+            if (framebuffer == id) framebuffer = GL_STATE_UNKNOWN;
+        }
+
+        void UseProgram(unsigned int id){
+            if (!track(GL_STATE_PROGRAM, program, id)) return;
+            glUseProgram(id);
+        }
+        // GL_STATE_UNKNOWN until a program went through UseProgram.
+        unsigned int Program() const{
+            return program;
+        }
+
+        // The element buffer belongs to the VAO, binding one is left to the caller.
+        void BindVertexArray(unsigned int id){
+            if (!track(GL_STATE_VERTEX_ARRAY, vertexArray, id)) return;
+            glBindVertexArray(id);
+        }
+
+        void BindTexture(unsigned int unit, unsigned int id){
+            if (unit < GL_STATE_TEXTURE_UNITS && !track(GL_STATE_TEXTURE, textures[unit], id)) return;
+            if (unit >= GL_STATE_TEXTURE_UNITS) frame.Issued[GL_STATE_TEXTURE]++;
+            glBindTextureUnit(unit, id);
+        }
+
+        void BindBuffer(GLenum target, unsigned int id){
+            unsigned int* bound = buffer(target);
+            if (bound && !track(GL_STATE_BUFFER, *bound, id)) return;
+            if (!bound) frame.Issued[GL_STATE_BUFFER]++;
+            glBindBuffer(target, id);
+        }
+
+        // Indexed binds also replace the generic binding point of the target.
+        void BindBufferBase(GLenum target, unsigned int index, unsigned int id){
+            if (target == GL_SHADER_STORAGE_BUFFER && index < GL_STATE_BUFFER_BINDINGS){
+                storageBuffer = id;
+                if (!track(GL_STATE_BUFFER, storageBindings[index], id)) return;
+            }else{
+                if (unsigned int* bound = buffer(target)) *bound = id;
+                frame.Issued[GL_STATE_BUFFER]++;
+            }
+            glBindBufferBase(target, index, id);
+        }
+
+        // Binds for drawing and reading at once, 0 is the default framebuffer.
+        void BindFramebuffer(unsigned int id){
+            if (!track(GL_STATE_FRAMEBUFFER, framebuffer, id)) return;
+            glBindFramebuffer(GL_FRAMEBUFFER, id);
+        }
+
+        void Enable(GLenum capability){ setCapability(capability, true); }
+        void Disable(GLenum capability){ setCapability(capability, false); }
+
+        void DepthFunc(GLenum function){
+            if (!track(GL_STATE_DEPTH_BLEND, depthFunc, function)) return;
+            glDepthFunc(function);
+        }
+
+        void DepthMask(bool write){
+            if (!track(GL_STATE_DEPTH_BLEND, depthMask, (int)write)) return;
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+        }
+
+        void BlendFunc(GLenum source, GLenum destination){
+            if (blendSource == source && blendDestination == destination){
+                frame.Elided[GL_STATE_DEPTH_BLEND]++;
+                return;
+            }
+            blendSource = source;
+            blendDestination = destination;
+            frame.Issued[GL_STATE_DEPTH_BLEND]++;
+            glBlendFunc(source, destination);
+        }
+
+        void Viewport(int x, int y, int width, int height){
+            if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height){
+                frame.Elided[GL_STATE_VIEWPORT]++;
+                return;
+            }
+            viewport[0] = x;
+            viewport[1] = y;
+            viewport[2] = width;
+            viewport[3] = height;
+            frame.Issued[GL_STATE_VIEWPORT]++;
+            glViewport(x, y, width, height);
+        }
+
+        // Returns the counts of the frame that just ended and adds them to the report window.
+        GLStateStats EndFrame(){
+            GLStateStats last = frame;
+            for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++){
+                window.Issued[i] += frame.Issued[i];
+                window.Elided[i] += frame.Elided[i];
+            }
+            windowFrames++;
+            clear(frame);
+            return last;
+        }
+
+        // Prints the per frame averages since the last report.
+        void Report(){
+            if (!windowFrames) return;
+            double frames = windowFrames;
+            unsigned long long issued = window.TotalIssued();
+            unsigned long long elided = window.TotalElided();
+            double share = issued + elided ? 100.0 * elided / (issued + elided) : 0.0;
+
+            std::cout << "GLSTATE::CALLS issued " << issued / frames << " elided " << elided / frames << " per frame (" << share << "% elided)";
+            for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++){
+                if (window.Issued[i] + window.Elided[i] == 0) continue;
+                std::cout << ", " << GL_STATE_CALL_NAMES[i] << " " << window.Issued[i] / frames << "/" << window.Elided[i] / frames;
+            }
+            std::cout << std::endl;
+
+            clear(window);
+            windowFrames = 0;
+        }
+
+    private:
+        unsigned int program;
+        unsigned int vertexArray;
+        unsigned int textures[GL_STATE_TEXTURE_UNITS];
+        unsigned int arrayBuffer, indirectBuffer, storageBuffer;
+        unsigned int storageBindings[GL_STATE_BUFFER_BINDINGS];
+        int depthTest, blend, cullFace;
+        unsigned int depthFunc, blendSource, blendDestination;
+        int depthMask;
+        int viewport[4];
+        unsigned int framebuffer;
+
+        GLStateStats frame;
+        GLStateStats window;
+        unsigned int windowFrames;
+
+        template<typename T>
+        bool track(GLStateCall call, T &current, T value){
+            if (current == value){
+                frame.Elided[call]++;
+                return false;
+            }
+            current = value;
+            frame.Issued[call]++;
+            return true;
+        }
+
+        unsigned int* buffer(GLenum target){
+            switch (target){
+                case GL_ARRAY_BUFFER: return &arrayBuffer;
+                case GL_DRAW_INDIRECT_BUFFER: return &indirectBuffer;
+                case GL_SHADER_STORAGE_BUFFER: return &storageBuffer;
+                default: return NULL;
+            }
+        }
+
+        void setCapability(GLenum capability, bool enabled){
+            int* current = NULL;
+            if (capability == GL_DEPTH_TEST) current = &depthTest;
+            else if (capability == GL_BLEND) current = &blend;
+            else if (capability == GL_CULL_FACE) current = &cullFace;
+
+            if (current && !track(GL_STATE_CAPABILITY, *current, (int)enabled)) return;
+            if (!current) frame.Issued[GL_STATE_CAPABILITY]++;
+            if (enabled) glEnable(capability);
+            else glDisable(capability);
+        }
+
+        static void clear(GLStateStats &stats){
+            for (unsigned int i = 0; i < GL_STATE_CALL_COUNT; i++){
+                stats.Issued[i] = 0;
+                stats.Elided[i] = 0;
+            }
+        }
+};
+
+// The state of the context current on the render thread.
+inline GLStateCache& GLState(){
+    static GLStateCache cache;
+    return cache;
+}
+
+#endif
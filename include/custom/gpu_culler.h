@@ -0,0 +1,430 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <custom/mesh.h>
+#include <custom/shader.h>
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+enum GpuCullState{
+    CULL_FRUSTUM = 0,
+    CULL_EARLY_VISIBLE = 1,
+    CULL_OCCLUDED = 2,
+    CULL_LATE_VISIBLE = 3
+};
+
+struct GpuInstance{
+    glm::vec4 BoundsMin;
+    glm::vec4 BoundsMax;
+    unsigned int Mesh;
+    unsigned int Transform;
+    unsigned int pad[2];
+};
+
+struct DrawElementsIndirectCommand{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+struct GpuCullStats{
+    unsigned int Instances;
+    unsigned int EarlyVisible;
+    unsigned int LateVisible;
+    unsigned int FramesBehind;
+};
+
+const unsigned int GPU_CULL_READBACK_FRAMES = 3;
+
+// Two phase GPU culling. The early phase tests every instance against the
+// Hi-Z pyramid of the previous frame and draws the survivors, the pyramid is
+// then rebuilt from that depth and the late phase retests only what the early
+// phase rejected, so nothing that became visible this frame is missed.
+// The cull and Hi-Z passes rebind whatever program was bound before them,
+// so the draw shader stays bound across CullEarly, BuildHiZ and CullLate.
+class GpuCuller{
+    public:
+        GpuCullStats Stats;
+
+        GpuCuller(unsigned int width, unsigned int height) : cullShader("src/shaders/cull_comp.glsl"), hizShader("src/shaders/hiz_comp.glsl"){
+            recreate(counterBuffer, 2 * sizeof(unsigned int), NULL, GL_DYNAMIC_STORAGE_BIT);
+            for (unsigned int i = 0; i < GPU_CULL_READBACK_FRAMES; i++){
+                recreate(readbackBuffers[i], 2 * sizeof(unsigned int), NULL, 0);
+                readbackFences[i] = 0;
+            }
+
+            frame = 0;
+            Stats = GpuCullStats{0, 0, 0, 0};
+            Resize(width, height);
+        }
+
+        // Buffers, textures and programs are released to the GPU resource registry by their owners.
+        ~GpuCuller(){
+            for (unsigned int i = 0; i < GPU_CULL_READBACK_FRAMES; i++){
+                if (readbackFences[i]) glDeleteSync(readbackFences[i]);
+            }
+        }
+
+        GpuCuller(const GpuCuller&) = delete;
+        GpuCuller& operator=(const GpuCuller&) = delete;
+
+        // The pyramid is the largest power of two that fits in the window, so every texel of a
+        // level covers exactly 2x2 texels of the one below and uv maps straight to texels.
+        void Resize(unsigned int width, unsigned int height){
+            this->width = width;
+            this->height = height;
+            hizWidth = floorPowerOfTwo(width);
+            hizHeight = floorPowerOfTwo(height);
+            levels = 1 + (unsigned int)std::floor(std::log2((float)std::max(hizWidth, hizHeight)));
+
+            unsigned int id;
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            glTextureStorage2D(id, 1, GL_DEPTH_COMPONENT24, width, height);
+            depthTexture = GpuResource(GPU_TEXTURE, id, TextureBytes(width, height, 4, false), GPU_CATEGORY_CULLING);
+            glTextureParameteri(depthTexture.Id(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(depthTexture.Id(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            glTextureStorage2D(id, levels, GL_R32F, hizWidth, hizHeight);
+            hizTexture = GpuResource(GPU_TEXTURE, id, TextureBytes(hizWidth, hizHeight, 4, true), GPU_CATEGORY_CULLING);
+            glTextureParameteri(hizTexture.Id(), GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTextureParameteri(hizTexture.Id(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            float farDepth = 1.0f;
+            for (unsigned int i = 0; i < levels; i++){
+                glClearTexImage(hizTexture.Id(), i, GL_RED, GL_FLOAT, &farDepth);
+            }
+        }
+
+        // meshTransforms optionally places every mesh inside an instance, e.g. its node transform in the model.
+        void SetInstances(const std::vector<Mesh> &meshes, const std::vector<glm::mat4> &transforms,
+                          const std::vector<glm::mat4> &meshTransforms = std::vector<glm::mat4>()){
+            SetInstances(std::vector<const std::vector<Mesh>*>(1, &meshes), std::vector<std::vector<glm::mat4>>(1, meshTransforms),
+                         transforms, std::vector<unsigned int>(transforms.size(), 0));
+        }
+
+        // Several models at once: transforms[t] places an instance of models[instanceModels[t]], meshTransforms[i]
+        // holds the node transforms of model i's meshes. The meshes of all models share one command list,
+        // model i's start at MeshBase(i), and the instances of every mesh are contiguous.
+        void SetInstances(const std::vector<const std::vector<Mesh>*> &models, const std::vector<std::vector<glm::mat4>> &meshTransforms,
+                          const std::vector<glm::mat4> &transforms, const std::vector<unsigned int> &instanceModels){
+            std::vector<std::vector<unsigned int>> modelInstances(models.size());
+            for (unsigned int t = 0; t < transforms.size(); t++){
+                if (instanceModels[t] < models.size()) modelInstances[instanceModels[t]].push_back(t);
+            }
+
+            meshBases.clear();
+            meshCount = 0;
+            instances.clear();
+            std::vector<unsigned int> meshFirst, meshIndexCounts;
+            for (unsigned int i = 0; i < models.size(); i++){
+                meshBases.push_back(meshCount);
+                if (!models[i]) continue;
+                const std::vector<Mesh> &meshes = *models[i];
+                for (unsigned int m = 0; m < meshes.size(); m++){
+                    meshFirst.push_back(instances.size());
+                    meshIndexCounts.push_back(meshes[m].IndexCount);
+                    for (unsigned int j = 0; j < modelInstances[i].size(); j++){
+                        unsigned int t = modelInstances[i][j];
+                        glm::mat4 transform = m < meshTransforms[i].size() ? transforms[t] * meshTransforms[i][m] : transforms[t];
+                        AABB bounds = TransformAABB(meshes[m].Bounds, transform);
+                        GpuInstance instance;
+                        instance.BoundsMin = glm::vec4(bounds.Min, 1.0f);
+                        instance.BoundsMax = glm::vec4(bounds.Max, 1.0f);
+                        instance.Mesh = meshCount;
+                        instance.Transform = t;
+                        instance.pad[0] = instance.pad[1] = 0;
+                        instances.push_back(instance);
+                    }
+                    meshCount++;
+                }
+            }
+
+            commands.clear();
+            for (unsigned int phase = 0; phase < 2; phase++){
+                for (unsigned int m = 0; m < meshCount; m++){
+                    DrawElementsIndirectCommand command;
+                    command.count = meshIndexCounts[m];
+                    command.instanceCount = 0;
+                    command.firstIndex = 0;
+                    command.baseVertex = 0;
+                    command.baseInstance = phase * instances.size() + meshFirst[m];
+                    commands.push_back(command);
+                }
+            }
+
+            unsigned int count = std::max((size_t)1, instances.size());
+            std::vector<unsigned int> states(count, CULL_EARLY_VISIBLE);
+
+            recreate(instanceBuffer, count * sizeof(GpuInstance), instances.data(), 0);
+            recreate(commandBuffer, std::max((size_t)1, commands.size()) * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_STORAGE_BIT);
+            recreate(visibleBuffer, 2 * count * sizeof(unsigned int), NULL, 0);
+            recreate(stateBuffer, count * sizeof(unsigned int), states.data(), 0);
+            recreate(transformBuffer, std::max((size_t)1, transforms.size()) * sizeof(glm::mat4), transforms.data(), 0);
+            Stats.Instances = instances.size();
+        }
+
+        unsigned int MeshBase(unsigned int model) const{
+            return model < meshBases.size() ? meshBases[model] : 0;
+        }
+
+        void CullEarly(const glm::mat4 &viewProjection){
+            PROFILE_ZONE("gpu cull early");
+            this->viewProjection = viewProjection;
+            extractPlanes(viewProjection, planes);
+
+            unsigned int zero[2] = {0, 0};
+            glNamedBufferSubData(counterBuffer.Id(), 0, sizeof(zero), zero);
+            if (!commands.empty())
+                glNamedBufferSubData(commandBuffer.Id(), 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+
+            dispatchCull(0);
+        }
+
+        void CullLate(){
+            PROFILE_ZONE("gpu cull late");
+            dispatchCull(1);
+        }
+
+        // Copies the depth attachment of the current read framebuffer and reduces it into the pyramid.
+        void BuildHiZ(){
+            PROFILE_ZONE("build hi-z");
+            glCopyTextureSubImage2D(depthTexture.Id(), 0, 0, 0, 0, 0, width, height);
+
+            unsigned int previous = GLState().Program();
+            hizShader.use();
+            hizShader.setInt("src", 0);
+
+            for (unsigned int level = 0; level < levels; level++){
+                unsigned int w = std::max(1u, hizWidth >> level);
+                unsigned int h = std::max(1u, hizHeight >> level);
+
+                GLState().BindTexture(0, level == 0 ? depthTexture.Id() : hizTexture.Id());
+                hizShader.setInt("srcLevel", (int)level - 1);
+                glUniform2i(glGetUniformLocation(hizShader.ID, "dstSize"), w, h);
+                glBindImageTexture(0, hizTexture.Id(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+                glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+            }
+            restoreProgram(previous);
+        }
+
+        void EndFrame(){
+            BuildHiZ();
+
+            unsigned int slot = frame % GPU_CULL_READBACK_FRAMES;
+            if (readbackFences[slot]){
+                readStats(slot);
+            }
+            glCopyNamedBufferSubData(counterBuffer.Id(), readbackBuffers[slot].Id(), 0, 0, 2 * sizeof(unsigned int));
+            readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readbackFrames[slot] = frame;
+            frame++;
+
+            for (unsigned int i = 1; i < GPU_CULL_READBACK_FRAMES; i++){
+                unsigned int older = (slot + i) % GPU_CULL_READBACK_FRAMES;
+                if (readbackFences[older] && glClientWaitSync(readbackFences[older], 0, 0) != GL_TIMEOUT_EXPIRED){
+                    readStats(older);
+                }
+            }
+        }
+
+        void Report() const{
+            std::cout << "GPU_CULL::INSTANCES " << Stats.Instances << " mesh instances, " << Stats.EarlyVisible << " drawn early, "
+                      << Stats.LateVisible << " late, read back " << Stats.FramesBehind << " frames behind" << std::endl;
+        }
+
+        void Bind(){
+            GLState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, transformBuffer.Id());
+        }
+
+        unsigned int CommandOffset(int phase, unsigned int mesh) const{
+            return (phase * meshCount + mesh) * sizeof(DrawElementsIndirectCommand);
+        }
+
+        // The GpuCullState of every instance after the last cull phase, in SetInstances order. Stalls.
+        std::vector<unsigned int> ReadStates() const{
+            std::vector<unsigned int> states(instances.size());
+            if (!states.empty())
+                glGetNamedBufferSubData(stateBuffer.Id(), 0, states.size() * sizeof(unsigned int), states.data());
+            return states;
+        }
+
+        const std::vector<GpuInstance>& GetInstances() const{
+            return instances;
+        }
+
+        // Reads back the pyramid and the per instance states right after a cull phase and
+        // returns how many instances the GPU classified differently from the CPU references.
+        unsigned int Verify(int phase){
+            std::vector<unsigned int> states = ReadStates();
+
+            std::vector<std::vector<float>> pyramid(levels);
+            for (unsigned int level = 0; level < levels; level++){
+                unsigned int w = std::max(1u, hizWidth >> level);
+                unsigned int h = std::max(1u, hizHeight >> level);
+                pyramid[level].resize(w * h);
+                glGetTextureImage(hizTexture.Id(), level, GL_RED, GL_FLOAT, pyramid[level].size() * sizeof(float), pyramid[level].data());
+            }
+
+            unsigned int mismatches = 0;
+            for (unsigned int i = 0; i < instances.size(); i++){
+                if (phase == 0){
+                    unsigned int expected = CULL_FRUSTUM;
+                    if (FrustumReference(instances[i], planes))
+                        expected = OcclusionReference(instances[i], viewProjection, pyramid, hizWidth, hizHeight) ? CULL_EARLY_VISIBLE : CULL_OCCLUDED;
+                    if (states[i] != expected) mismatches++;
+                }else if (states[i] == CULL_OCCLUDED || states[i] == CULL_LATE_VISIBLE){
+                    unsigned int expected = OcclusionReference(instances[i], viewProjection, pyramid, hizWidth, hizHeight) ? CULL_LATE_VISIBLE : CULL_OCCLUDED;
+                    if (states[i] != expected) mismatches++;
+                }
+            }
+            return mismatches;
+        }
+
+        static bool FrustumReference(const GpuInstance &instance, const glm::vec4 planes[6]){
+            for (int i = 0; i < 6; i++){
+                glm::vec3 v(planes[i].x > 0.0f ? instance.BoundsMax.x : instance.BoundsMin.x,
+                            planes[i].y > 0.0f ? instance.BoundsMax.y : instance.BoundsMin.y,
+                            planes[i].z > 0.0f ? instance.BoundsMax.z : instance.BoundsMin.z);
+                if (glm::dot(glm::vec3(planes[i]), v) + planes[i].w < 0.0f) return false;
+            }
+            return true;
+        }
+
+        // width and height are the size of the pyramid's first level.
+        static bool OcclusionReference(const GpuInstance &instance, const glm::mat4 &viewProjection,
+                                       const std::vector<std::vector<float>> &pyramid, unsigned int width, unsigned int height){
+            glm::vec2 uvMin(1.0f), uvMax(0.0f);
+            float minZ = 1.0f;
+
+            for (int i = 0; i < 8; i++){
+                glm::vec3 corner((i & 1) ? instance.BoundsMax.x : instance.BoundsMin.x,
+                                 (i & 2) ? instance.BoundsMax.y : instance.BoundsMin.y,
+                                 (i & 4) ? instance.BoundsMax.z : instance.BoundsMin.z);
+                glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+                if (clip.w <= 0.0f || clip.z < -clip.w) return true;
+
+                glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                glm::vec2 uv = glm::vec2(ndc) * 0.5f + 0.5f;
+                uvMin = glm::min(uvMin, uv);
+                uvMax = glm::max(uvMax, uv);
+                minZ = std::min(minZ, ndc.z * 0.5f + 0.5f);
+            }
+
+            uvMin = glm::clamp(uvMin, 0.0f, 1.0f);
+            uvMax = glm::clamp(uvMax, 0.0f, 1.0f);
+
+            glm::vec2 extent = (uvMax - uvMin) * glm::vec2(width, height);
+            int lod = (int)std::ceil(std::log2(std::max(std::max(extent.x, extent.y), 1.0f)));
+            lod = std::min(std::max(lod, 0), (int)pyramid.size() - 1);
+
+            int w = std::max(1, (int)width >> lod);
+            int h = std::max(1, (int)height >> lod);
+            int x0 = std::min((int)(uvMin.x * w), w - 1), y0 = std::min((int)(uvMin.y * h), h - 1);
+            int x1 = std::min((int)(uvMax.x * w), w - 1), y1 = std::min((int)(uvMax.y * h), h - 1);
+
+            const std::vector<float> &level = pyramid[lod];
+            float maxDepth = std::max(std::max(level[y0 * w + x0], level[y0 * w + x1]), std::max(level[y1 * w + x0], level[y1 * w + x1]));
+            return minZ <= maxDepth;
+        }
+
+    private:
+        Shader cullShader;
+        Shader hizShader;
+
+        GpuResource instanceBuffer, commandBuffer, visibleBuffer, stateBuffer, transformBuffer, counterBuffer;
+        GpuResource readbackBuffers[GPU_CULL_READBACK_FRAMES];
+        GLsync readbackFences[GPU_CULL_READBACK_FRAMES];
+        unsigned int readbackFrames[GPU_CULL_READBACK_FRAMES];
+        GpuResource depthTexture, hizTexture;
+
+        unsigned int width, height, levels;
+        unsigned int hizWidth, hizHeight;
+        unsigned int meshCount = 0;
+        std::vector<unsigned int> meshBases;
+        unsigned int frame;
+
+        glm::mat4 viewProjection;
+        glm::vec4 planes[6];
+        std::vector<GpuInstance> instances;
+        std::vector<DrawElementsIndirectCommand> commands;
+
+        // The previous buffer may still be read by frames in flight, the registry deletes it once they are done.
+        void recreate(GpuResource &buffer, size_t size, const void* data, GLbitfield flags){
+            unsigned int id;
+            glCreateBuffers(1, &id);
+            glNamedBufferStorage(id, size, data, flags);
+            buffer = GpuResource(GPU_BUFFER, id, size, GPU_CATEGORY_CULLING);
+        }
+
+        void readStats(unsigned int slot){
+            unsigned int counts[2];
+            glGetNamedBufferSubData(readbackBuffers[slot].Id(), 0, sizeof(counts), counts);
+            glDeleteSync(readbackFences[slot]);
+            readbackFences[slot] = 0;
+
+            Stats.EarlyVisible = counts[0];
+            Stats.LateVisible = counts[1];
+            Stats.FramesBehind = frame - readbackFrames[slot];
+        }
+
+        static unsigned int floorPowerOfTwo(unsigned int value){
+            unsigned int power = 1;
+            while (power <= value / 2) power *= 2;
+            return power;
+        }
+
+        void restoreProgram(unsigned int previous){
+            if (previous != GL_STATE_UNKNOWN) GLState().UseProgram(previous);
+        }
+
+        void dispatchCull(int phase){
+            unsigned int previous = GLState().Program();
+            cullShader.use();
+            cullShader.setMat4("viewProjection", viewProjection);
+            glUniform4fv(glGetUniformLocation(cullShader.ID, "frustumPlanes"), 6, &planes[0].x);
+            cullShader.setInt("phase", phase);
+            cullShader.setInt("instanceCount", instances.size());
+            cullShader.setInt("meshCount", meshCount);
+            cullShader.setInt("hiz", 0);
+            GLState().BindTexture(0, hizTexture.Id());
+
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, stateBuffer.Id());
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, counterBuffer.Id());
+
+            glDispatchCompute((instances.size() + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+            restoreProgram(previous);
+        }
+
+        static void extractPlanes(const glm::mat4 &m, glm::vec4 planes[6]){
+            glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+            glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+            glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+            glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+            planes[0] = row3 + row0;
+            planes[1] = row3 - row0;
+            planes[2] = row3 + row1;
+            planes[3] = row3 - row1;
+            planes[4] = row3 + row2;
+            planes[5] = row3 - row2;
+        }
+};
+
+#endif
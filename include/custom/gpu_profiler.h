@@ -0,0 +1,295 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <custom/profiler.h>
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+const unsigned int GPU_PROFILE_FRAMES = 4;
+const unsigned int GPU_PROFILE_SCOPES = 32;
+const unsigned int GPU_PROFILE_DEPTH = 8;
+const unsigned int GPU_PROFILE_REJECTED = ~0u;     // stack entry of a scope that got no queries
+const unsigned int GPU_PROFILE_HISTORY = 240;
+const unsigned int GPU_PROFILE_TRACK = 1000;
+
+struct GpuScopeStats{
+    const char* Name;
+    unsigned int Samples;
+    double MinMs;
+    double AvgMs;
+    double P99Ms;
+};
+
+// GPU time of a whole frame, from the first scope's begin to the last scope's end.
+struct GpuFrameTime{
+    unsigned long long Frame;
+    double Ms;
+};
+
+// Times named GPU scopes with GL_TIMESTAMP queries. Every frame writes into
+// its own slot of a ring, and a slot is only read back GPU_PROFILE_FRAMES - 1
+// frames later once its queries are available, so reading never stalls.
+// Timestamps instead of GL_TIME_ELAPSED let scopes nest. Results are kept as
+// rolling min/avg/p99 per scope name and, with PROFILING, handed to the CPU
+// trace on a "gpu" track.
+class GpuProfiler{
+    public:
+        unsigned int SkippedReadbacks;
+
+        GpuProfiler() : SkippedReadbacks(0), frame(0), depth(0), overflow(0), spanCount(0), readCount(0), gpuToSteadyNs(0){
+            for (unsigned int i = 0; i < GPU_PROFILE_FRAMES; i++){
+                glGenQueries(GPU_PROFILE_SCOPES * 2, frames[i].Queries);
+                frames[i].Count = 0;
+                frames[i].Pending = false;
+            }
+            names.reserve(GPU_PROFILE_SCOPES);
+            spans.resize(GPU_PROFILE_FRAMES * GPU_PROFILE_SCOPES);
+            Calibrate();
+        }
+
+        ~GpuProfiler(){
+            for (unsigned int i = 0; i < GPU_PROFILE_FRAMES; i++){
+                glDeleteQueries(GPU_PROFILE_SCOPES * 2, frames[i].Queries);
+            }
+        }
+
+        GpuProfiler(const GpuProfiler&) = delete;
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+        // Maps GPU timestamps onto steady_clock, GL_TIMESTAMP queried directly is the GPU time right now.
+        // Clocks drift apart, so call it again now and then.
+        void Calibrate(){
+            GLint64 gpuNow;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            long long steadyNow = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            gpuToSteadyNs = steadyNow - gpuNow;
+        }
+
+        // Frames are numbered from 0 in the order they begin.
+        void BeginFrame(){
+            Frame &slot = frames[frame % GPU_PROFILE_FRAMES];
+            readCount = 0;
+            if (slot.Pending) readBack(slot);
+            slot.Count = 0;
+            slot.Number = frame;
+            depth = 0;
+            overflow = 0;
+        }
+
+        // Waits for the GPU and reads back every frame still in flight, e.g. at the end of a benchmark.
+        void Finish(){
+            glFinish();
+            readCount = 0;
+            for (unsigned int i = 0; i < GPU_PROFILE_FRAMES; i++){
+                Frame &slot = frames[(frame + i) % GPU_PROFILE_FRAMES];
+                if (slot.Pending) readBack(slot);
+            }
+        }
+
+        // Frames read back by the last BeginFrame() or Finish().
+        unsigned int ReadCount() const{
+            return readCount;
+        }
+        GpuFrameTime ReadFrame(unsigned int index) const{
+            return readFrames[index];
+        }
+
+        // Scopes past GPU_PROFILE_SCOPES or nested deeper than GPU_PROFILE_DEPTH are not timed,
+        // but still have to be closed with End() so the scopes around them stay paired.
+        void Begin(const char* name){
+            Frame &slot = frames[frame % GPU_PROFILE_FRAMES];
+            if (depth >= GPU_PROFILE_DEPTH){
+                overflow++;
+                return;
+            }
+            if (slot.Count >= GPU_PROFILE_SCOPES){
+                stack[depth++] = GPU_PROFILE_REJECTED;
+                return;
+            }
+
+            unsigned int scope = slot.Count++;
+            slot.Names[scope] = name;
+            glQueryCounter(slot.Queries[scope * 2], GL_TIMESTAMP);
+            stack[depth++] = scope;
+        }
+
+        void End(){
+            if (overflow){
+                overflow--;
+                return;
+            }
+            if (!depth) return;
+            unsigned int scope = stack[--depth];
+            if (scope == GPU_PROFILE_REJECTED) return;
+            Frame &slot = frames[frame % GPU_PROFILE_FRAMES];
+            glQueryCounter(slot.Queries[scope * 2 + 1], GL_TIMESTAMP);
+        }
+
+        void EndFrame(){
+            frames[frame % GPU_PROFILE_FRAMES].Pending = true;
+            frame++;
+        }
+
+        GpuScopeStats Stats(const char* name) const{
+            for (unsigned int i = 0; i < names.size(); i++){
+                if (std::strcmp(names[i].Name, name) == 0) return stats(names[i]);
+            }
+            return GpuScopeStats{name, 0, 0.0, 0.0, 0.0};
+        }
+
+        void Report() const{
+            std::cout << "GPU::TIMING";
+            std::cout << std::fixed << std::setprecision(3);
+            for (unsigned int i = 0; i < names.size(); i++){
+                GpuScopeStats scope = stats(names[i]);
+                if (!scope.Samples) continue;
+                std::cout << " " << scope.Name << " " << scope.MinMs << "/" << scope.AvgMs << "/" << scope.P99Ms << "ms";
+            }
+            std::cout << " (min/avg/p99)";
+            if (SkippedReadbacks) std::cout << ", " << SkippedReadbacks << " frames not ready in time";
+            std::cout << std::defaultfloat << std::endl;
+        }
+
+        // Hands the spans read back since the last call to the CPU trace. The trace
+        // allocates, so call it next to PROFILE_COLLECT() instead of mid frame.
+        void FlushToTrace(){
+            for (unsigned int i = 0; i < spanCount; i++){
+                Profiler::AddSpan("gpu", GPU_PROFILE_TRACK, spans[i].Name, spans[i].BeginMicroseconds, spans[i].EndMicroseconds);
+            }
+            spanCount = 0;
+        }
+
+    private:
+        struct Frame{
+            GLuint Queries[GPU_PROFILE_SCOPES * 2];
+            const char* Names[GPU_PROFILE_SCOPES];
+            unsigned int Count;
+            unsigned long long Number;
+            bool Pending;
+        };
+
+        struct History{
+            const char* Name;
+            double Samples[GPU_PROFILE_HISTORY];
+            unsigned int Count;
+            unsigned int Next;
+        };
+
+        struct Span{
+            const char* Name;
+            double BeginMicroseconds;
+            double EndMicroseconds;
+        };
+
+        Frame frames[GPU_PROFILE_FRAMES];
+        unsigned long long frame;
+        unsigned int stack[GPU_PROFILE_DEPTH];
+        unsigned int depth;
+        unsigned int overflow;
+
+        std::vector<History> names;
+        std::vector<Span> spans;
+        unsigned int spanCount;
+
+        GpuFrameTime readFrames[GPU_PROFILE_FRAMES];
+        unsigned int readCount;
+
+        long long gpuToSteadyNs;
+
+        void readBack(Frame &slot){
+            slot.Pending = false;
+            if (!slot.Count) return;
+
+            for (unsigned int i = 0; i < slot.Count * 2; i++){
+                GLint available = 0;
+                glGetQueryObjectiv(slot.Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available){
+                    SkippedReadbacks++;
+                    return;
+                }
+            }
+
+            GLuint64 frameBegin = ~(GLuint64)0, frameEnd = 0;
+            for (unsigned int i = 0; i < slot.Count; i++){
+                GLuint64 begin, end;
+                glGetQueryObjectui64v(slot.Queries[i * 2], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(slot.Queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+                if (end < begin) continue;
+                frameBegin = std::min(frameBegin, begin);
+                frameEnd = std::max(frameEnd, end);
+
+                record(slot.Names[i], (end - begin) / 1000000.0);
+                if (Profiler::Enabled() && spanCount < spans.size()){
+                    spans[spanCount++] = Span{slot.Names[i], toTrace(begin), toTrace(end)};
+                }
+            }
+            if (frameEnd > frameBegin && readCount < GPU_PROFILE_FRAMES){
+                readFrames[readCount++] = GpuFrameTime{slot.Number, (frameEnd - frameBegin) / 1000000.0};
+            }
+        }
+
+        void record(const char* name, double ms){
+            History* history = NULL;
+            for (unsigned int i = 0; i < names.size() && !history; i++){
+                if (names[i].Name == name || std::strcmp(names[i].Name, name) == 0) history = &names[i];
+            }
+            if (!history){
+                if (names.size() >= GPU_PROFILE_SCOPES) return;
+                names.push_back(History{name, {}, 0, 0});
+                history = &names.back();
+            }
+
+            history->Samples[history->Next] = ms;
+            history->Next = (history->Next + 1) % GPU_PROFILE_HISTORY;
+            history->Count = std::min(history->Count + 1, GPU_PROFILE_HISTORY);
+        }
+
+        GpuScopeStats stats(const History &history) const{
+            GpuScopeStats result = GpuScopeStats{history.Name, history.Count, 0.0, 0.0, 0.0};
+            if (!history.Count) return result;
+
+            double sorted[GPU_PROFILE_HISTORY];
+            std::copy(history.Samples, history.Samples + history.Count, sorted);
+            std::sort(sorted, sorted + history.Count);
+
+            double sum = 0.0;
+            for (unsigned int i = 0; i < history.Count; i++) sum += sorted[i];
+            result.MinMs = sorted[0];
+            result.AvgMs = sum / history.Count;
+            result.P99Ms = sorted[std::min(history.Count - 1, (unsigned int)(history.Count * 0.99))];
+            return result;
+        }
+
+        double toTrace(GLuint64 gpuNs) const{
+            std::chrono::steady_clock::time_point time{std::chrono::nanoseconds((long long)gpuNs + gpuToSteadyNs)};
+            return Profiler::SteadyMicroseconds(time);
+        }
+};
+
+class GpuProfileScope{
+    public:
+        GpuProfileScope(GpuProfiler &profiler, const char* name) : profiler(profiler){
+            profiler.Begin(name);
+        }
+
+        ~GpuProfileScope(){
+            profiler.End();
+        }
+
+        GpuProfileScope(const GpuProfileScope&) = delete;
+        GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+    private:
+        GpuProfiler &profiler;
+};
+
+#define GPU_PROFILE_SCOPE(profiler, name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, name)
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <custom/gl_state.h>
+
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+enum GpuResourceType{
+    GPU_BUFFER,
+    GPU_TEXTURE,
+    GPU_PROGRAM,
+    GPU_VERTEX_ARRAY,
+    GPU_FRAMEBUFFER,
+    GPU_RESOURCE_TYPE_COUNT
+};
+
+enum GpuCategory{
+    GPU_CATEGORY_MESH,
+    GPU_CATEGORY_TEXTURE,
+    GPU_CATEGORY_SHADER,
+    GPU_CATEGORY_INSTANCING,
+    GPU_CATEGORY_CULLING,
+    GPU_CATEGORY_OTHER,
+    GPU_CATEGORY_COUNT
+};
+
+const char* const GPU_RESOURCE_TYPE_NAMES[GPU_RESOURCE_TYPE_COUNT] = {"buffer", "texture", "program", "vertex array", "framebuffer"};
+const char* const GPU_CATEGORY_NAMES[GPU_CATEGORY_COUNT] = {"mesh", "texture", "shader", "instancing", "culling", "other"};
+
+// A stale handle never resolves: releasing a slot bumps its generation, so a
+// handle kept after release cannot reach whatever reuses the slot.
+struct GpuHandle{
+    unsigned int Index;
+    unsigned int Generation;
+};
+
+struct GpuMemoryStats{
+    size_t TypeBytes[GPU_RESOURCE_TYPE_COUNT];
+    unsigned int TypeCount[GPU_RESOURCE_TYPE_COUNT];
+    size_t CategoryBytes[GPU_CATEGORY_COUNT];
+    size_t TotalBytes;
+    size_t PendingBytes;
+    unsigned int PendingCount;
+    size_t Budget;
+};
+
+inline size_t TextureBytes(unsigned int width, unsigned int height, unsigned int bytesPerPixel, bool mipmapped){
+    size_t bytes = (size_t)width * height * bytesPerPixel;
+    return mipmapped ? bytes * 4 / 3 : bytes;
+}
+
+// Registry of every GL object the renderer creates, only used from the GL
+// thread. Released objects are deleted once a fence placed at the end of the
+// frame they were released in has signaled, so the GPU is never still
+// reading from a name the driver could hand out again.
+class GpuResources{
+    public:
+        GpuResources() : budget(0){}
+
+        GpuResources(const GpuResources&) = delete;
+        GpuResources& operator=(const GpuResources&) = delete;
+
+        GpuHandle Register(GpuResourceType type, unsigned int id, size_t bytes, GpuCategory category){
+            unsigned int index;
+            if (!freeSlots.empty()){
+                index = freeSlots.back();
+                freeSlots.pop_back();
+            }else{
+                index = slots.size();
+                slots.push_back(Slot{GPU_BUFFER, GPU_CATEGORY_OTHER, 0, 0, 1, false});
+            }
+
+            Slot &slot = slots[index];
+            slot.Type = type;
+            slot.Category = category;
+            slot.Id = id;
+            slot.Bytes = bytes;
+            slot.Alive = true;
+            return GpuHandle{index, slot.Generation};
+        }
+
+        bool IsValid(GpuHandle handle) const{
+            return handle.Index < slots.size() && slots[handle.Index].Alive && slots[handle.Index].Generation == handle.Generation;
+        }
+
+        unsigned int Id(GpuHandle handle) const{
+            return IsValid(handle) ? slots[handle.Index].Id : 0;
+        }
+
+        size_t Bytes(GpuHandle handle) const{
+            return IsValid(handle) ? slots[handle.Index].Bytes : 0;
+        }
+
+        void SetBytes(GpuHandle handle, size_t bytes){
+            if (IsValid(handle)) slots[handle.Index].Bytes = bytes;
+        }
+
+        // The handle is dead right away, the GL object itself goes once the GPU is done with the current frame.
+        void Release(GpuHandle handle){
+            if (!IsValid(handle)) return;
+
+            Slot &slot = slots[handle.Index];
+            pending.push_back(Pending{slot.Type, slot.Id, slot.Bytes, 0});
+            slot.Alive = false;
+            slot.Generation++;
+            freeSlots.push_back(handle.Index);
+        }
+
+        // Call once per frame after the last draw: fences this frame's releases and deletes the ones whose fence signaled.
+        void EndFrame(){
+            GLsync fence = 0;
+            for (unsigned int i = 0; i < pending.size(); i++){
+                if (pending[i].Fence) continue;
+                if (!fence) fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                pending[i].Fence = fence;
+            }
+
+            while (!pending.empty() && pending.front().Fence){
+                GLsync front = pending.front().Fence;
+                GLenum status = glClientWaitSync(front, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+                while (!pending.empty() && pending.front().Fence == front){
+                    destroy(pending.front());
+                    pending.pop_front();
+                }
+                glDeleteSync(front);
+            }
+        }
+
+        // Deletes everything that is pending without waiting for fences, e.g. before the context goes away.
+        void Flush(){
+            glFinish();
+            GLsync last = 0;
+            while (!pending.empty()){
+                if (pending.front().Fence && pending.front().Fence != last){
+                    last = pending.front().Fence;
+                    glDeleteSync(last);
+                }
+                destroy(pending.front());
+                pending.pop_front();
+            }
+        }
+
+        void SetBudget(size_t bytes){ budget = bytes; }
+
+        unsigned int LiveCount() const{
+            return slots.size() - freeSlots.size();
+        }
+
+        GpuMemoryStats Stats() const{
+            GpuMemoryStats stats;
+            std::memset(&stats, 0, sizeof(stats));
+            for (unsigned int i = 0; i < slots.size(); i++){
+                if (!slots[i].Alive) continue;
+                stats.TypeBytes[slots[i].Type] += slots[i].Bytes;
+                stats.TypeCount[slots[i].Type]++;
+                stats.CategoryBytes[slots[i].Category] += slots[i].Bytes;
+                stats.TotalBytes += slots[i].Bytes;
+            }
+            for (unsigned int i = 0; i < pending.size(); i++){
+                stats.PendingBytes += pending[i].Bytes;
+                stats.PendingCount++;
+            }
+            stats.Budget = budget;
+            return stats;
+        }
+
+        void Report() const{
+            GpuMemoryStats stats = Stats();
+            std::cout << "GPU::MEMORY " << stats.TotalBytes / 1024 << " KiB live";
+            if (stats.Budget) std::cout << " of " << stats.Budget / 1024 << " KiB budget";
+            std::cout << ", " << stats.PendingCount << " pending deletions (" << stats.PendingBytes / 1024 << " KiB)" << std::endl;
+
+            for (unsigned int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++){
+                std::cout << "  " << std::setw(14) << std::left << GPU_RESOURCE_TYPE_NAMES[i] << std::right << std::setw(6) << stats.TypeCount[i]
+                          << std::setw(12) << stats.TypeBytes[i] / 1024 << " KiB" << std::endl;
+            }
+            for (unsigned int i = 0; i < GPU_CATEGORY_COUNT; i++){
+                std::cout << "  " << std::setw(20) << std::left << GPU_CATEGORY_NAMES[i] << std::right << std::setw(12) << stats.CategoryBytes[i] / 1024 << " KiB" << std::endl;
+            }
+            if (stats.Budget && stats.TotalBytes > stats.Budget){
+                std::cout << "ERROR::GPU::OVER_BUDGET by " << (stats.TotalBytes - stats.Budget) / 1024 << " KiB" << std::endl;
+            }
+        }
+
+    private:
+        struct Slot{
+            GpuResourceType Type;
+            GpuCategory Category;
+            unsigned int Id;
+            size_t Bytes;
+            unsigned int Generation;
+            bool Alive;
+        };
+
+        struct Pending{
+            GpuResourceType Type;
+            unsigned int Id;
+            size_t Bytes;
+            GLsync Fence;
+        };
+
+        std::vector<Slot> slots;
+        std::vector<unsigned int> freeSlots;
+        std::deque<Pending> pending;
+        size_t budget;
+
+        static void destroy(const Pending &resource){
+            switch (resource.Type){
+                case GPU_BUFFER: GLState().ForgetBuffer(resource.Id); glDeleteBuffers(1, &resource.Id); break;
+                case GPU_TEXTURE: GLState().ForgetTexture(resource.Id); glDeleteTextures(1, &resource.Id); break;
+                case GPU_PROGRAM: GLState().ForgetProgram(resource.Id); glDeleteProgram(resource.Id); break;
+                case GPU_VERTEX_ARRAY: GLState().ForgetVertexArray(resource.Id); glDeleteVertexArrays(1, &resource.Id); break;
+                case GPU_FRAMEBUFFER: GLState().ForgetFramebuffer(resource.Id); glDeleteFramebuffers(1, &resource.Id); break;
+                default: break;
+            }
+        }
+};
+
+inline GpuResources& GpuRegistry(){
+    static GpuResources registry;
+    return registry;
+}
+
+// Owns one registered GL object and releases it when it goes out of scope.
+class GpuResource{
+    public:
+        GpuResource() : handle(GpuHandle{0, 0}), id(0){}
+
+        GpuResource(GpuResourceType type, unsigned int id, size_t bytes, GpuCategory category) : handle(GpuHandle{0, 0}), id(id){
+            if (id) handle = GpuRegistry().Register(type, id, bytes, category);
+        }
+
+        ~GpuResource(){
+            Reset();
+        }
+
+        GpuResource(const GpuResource&) = delete;
+        GpuResource& operator=(const GpuResource&) = delete;
+
+        GpuResource(GpuResource &&other) noexcept : handle(other.handle), id(other.id){
+            other.handle = GpuHandle{0, 0};
+            other.id = 0;
+        }
+
+        GpuResource& operator=(GpuResource &&other) noexcept{
+            if (this != &other){
+                Reset();
+                handle = other.handle;
+                id = other.id;
+                other.handle = GpuHandle{0, 0};
+                other.id = 0;
+            }
+            return *this;
+        }
+
+        void Reset(){
+            if (id) GpuRegistry().Release(handle);
+            handle = GpuHandle{0, 0};
+            id = 0;
+        }
+
+        void SetBytes(size_t bytes){ GpuRegistry().SetBytes(handle, bytes); }
+
+        unsigned int Id() const{ return id; }
+        GpuHandle Handle() const{ return handle; }
+
+    private:
+        GpuHandle handle;
+        unsigned int id;
+};
+
+#endif
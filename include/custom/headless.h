@@ -0,0 +1,297 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <custom/gpu_resources.h>
+#include <custom/gl_state.h>
+
+// EGL on Linux runs without a display server, elsewhere a hidden GLFW window
+// stands in. Define HEADLESS_GLFW to force the window on Linux as well.
+#if defined(__linux__) && !defined(HEADLESS_GLFW)
+#define HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <glfw/glfw3.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+const unsigned int HEADLESS_FRAMES_IN_FLIGHT = 2;
+
+// A GL context without a window. With EGL it prefers Mesa's surfaceless
+// platform, then the first EGL device, then the default display, and asks
+// for 4.6 core before falling back to 4.5 (llvmpipe stops at 4.5). The
+// context is created on the calling thread but not left current, so the
+// render thread can take it with MakeCurrent().
+class HeadlessContext{
+    public:
+        HeadlessContext(){
+#ifdef HEADLESS_EGL
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+            surface = EGL_NO_SURFACE;
+            valid = createEGL();
+#else
+            window = NULL;
+            valid = createGLFW();
+#endif
+        }
+
+        ~HeadlessContext(){
+#ifdef HEADLESS_EGL
+            if (display == EGL_NO_DISPLAY) return;
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+            if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+            eglTerminate(display);
+#else
+            if (window) glfwDestroyWindow(window);
+            glfwTerminate();
+#endif
+        }
+
+        HeadlessContext(const HeadlessContext&) = delete;
+        HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+        bool Valid() const{
+            return valid;
+        }
+
+        bool MakeCurrent(){
+#ifdef HEADLESS_EGL
+            eglBindAPI(EGL_OPENGL_API);
+            return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+#else
+            glfwMakeContextCurrent(window);
+            return true;
+#endif
+        }
+
+        void ReleaseCurrent(){
+#ifdef HEADLESS_EGL
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#else
+            glfwMakeContextCurrent(NULL);
+#endif
+        }
+
+        static GLADloadproc Loader(){
+#ifdef HEADLESS_EGL
+            return (GLADloadproc) eglGetProcAddress;
+#else
+            return (GLADloadproc) glfwGetProcAddress;
+#endif
+        }
+
+    private:
+        bool valid;
+#ifdef HEADLESS_EGL
+        EGLDisplay display;
+        EGLContext context;
+        EGLSurface surface;
+
+        bool createEGL(){
+            const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+            if (getPlatformDisplay && hasExtension(extensions, "EGL_MESA_platform_surfaceless")){
+                display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            }
+            if (display == EGL_NO_DISPLAY && getPlatformDisplay && hasExtension(extensions, "EGL_EXT_platform_device")){
+                PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+                EGLDeviceEXT device;
+                EGLint devices = 0;
+                if (queryDevices && queryDevices(1, &device, &devices) && devices > 0){
+                    display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+                }
+            }
+            if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)){
+                std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+                display = EGL_NO_DISPLAY;
+                return false;
+            }
+            if (!eglBindAPI(EGL_OPENGL_API)){
+                std::cout << "ERROR::HEADLESS::NO_DESKTOP_GL" << std::endl;
+                return false;
+            }
+
+            // Rendering goes to an FBO, the pbuffer only exists for drivers without surfaceless contexts.
+            const EGLint configAttributes[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                EGL_NONE
+            };
+            EGLConfig config;
+            EGLint configs = 0;
+            if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0){
+                std::cout << "ERROR::HEADLESS::NO_EGL_CONFIG" << std::endl;
+                return false;
+            }
+
+            const EGLint versions[][2] = {{4, 6}, {4, 5}};
+            for (unsigned int i = 0; i < 2 && context == EGL_NO_CONTEXT; i++){
+                const EGLint contextAttributes[] = {
+                    EGL_CONTEXT_MAJOR_VERSION, versions[i][0],
+                    EGL_CONTEXT_MINOR_VERSION, versions[i][1],
+                    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                    EGL_NONE
+                };
+                context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            }
+            if (context == EGL_NO_CONTEXT){
+                std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+                return false;
+            }
+
+            if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")){
+                const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+                surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+                if (surface == EGL_NO_SURFACE){
+                    std::cout << "ERROR::HEADLESS::PBUFFER_CREATION_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool hasExtension(const char* extensions, const char* name){
+            if (!extensions) return false;
+            size_t length = std::strlen(name);
+            for (const char* at = std::strstr(extensions, name); at; at = std::strstr(at + length, name)){
+                if ((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0')) return true;
+            }
+            return false;
+        }
+#else
+        GLFWwindow* window;
+
+        bool createGLFW(){
+            glfwInit();
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            window = glfwCreateWindow(64, 64, "headless", NULL, NULL);
+            if (window == NULL){
+                std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << std::endl;
+                return false;
+            }
+            return true;
+        }
+#endif
+};
+
+// Color and depth target the headless renderer draws into in place of the
+// default framebuffer. Present() stands in for the swap: it keeps at most
+// HEADLESS_FRAMES_IN_FLIGHT frames queued on the GPU, which a swap chain
+// would otherwise do.
+class OffscreenTarget{
+    public:
+        OffscreenTarget(unsigned int width, unsigned int height) : width(0), height(0), frame(0){
+            for (unsigned int i = 0; i < HEADLESS_FRAMES_IN_FLIGHT; i++) fences[i] = 0;
+            Resize(width, height);
+        }
+
+        ~OffscreenTarget(){
+            for (unsigned int i = 0; i < HEADLESS_FRAMES_IN_FLIGHT; i++){
+                if (fences[i]) glDeleteSync(fences[i]);
+            }
+        }
+
+        OffscreenTarget(const OffscreenTarget&) = delete;
+        OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+        unsigned int Width() const{ return width; }
+        unsigned int Height() const{ return height; }
+
+        void Resize(unsigned int newWidth, unsigned int newHeight){
+            if (newWidth == width && newHeight == height) return;
+            width = newWidth;
+            height = newHeight;
+
+            unsigned int id;
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            glTextureStorage2D(id, 1, GL_RGBA8, width, height);
+            color = GpuResource(GPU_TEXTURE, id, TextureBytes(width, height, 4, false), GPU_CATEGORY_OTHER);
+
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            glTextureStorage2D(id, 1, GL_DEPTH_COMPONENT24, width, height);
+            depth = GpuResource(GPU_TEXTURE, id, TextureBytes(width, height, 4, false), GPU_CATEGORY_OTHER);
+
+            glCreateFramebuffers(1, &id);
+            glNamedFramebufferTexture(id, GL_COLOR_ATTACHMENT0, color.Id(), 0);
+            glNamedFramebufferTexture(id, GL_DEPTH_ATTACHMENT, depth.Id(), 0);
+            framebuffer = GpuResource(GPU_FRAMEBUFFER, id, 0, GPU_CATEGORY_OTHER);
+
+            if (glCheckNamedFramebufferStatus(id, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+                std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            }
+        }
+
+        void Bind(){
+            GLState().BindFramebuffer(framebuffer.Id());
+        }
+
+        void Present(){
+            unsigned int slot = frame++ % HEADLESS_FRAMES_IN_FLIGHT;
+            if (fences[slot]){
+                glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fences[slot]);
+            }
+            fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+
+        // Reads the color attachment back, bottom row first like glReadPixels.
+        void ReadPixels(std::vector<unsigned char> &pixels){
+            pixels.resize((size_t)width * height * 4);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTextureImage(color.Id(), 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)pixels.size(), pixels.data());
+        }
+
+        // Binary PPM, readable by about every image tool without pulling in an encoder.
+        bool WritePPM(const std::string &path){
+            std::vector<unsigned char> pixels;
+            ReadPixels(pixels);
+
+            std::ofstream file(path, std::ios::binary);
+            if (!file){
+                std::cout << "ERROR::HEADLESS::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            file << "P6\n" << width << " " << height << "\n255\n";
+            std::vector<unsigned char> row(width * 3);
+            for (unsigned int y = height; y-- > 0;){
+                for (unsigned int x = 0; x < width; x++){
+                    const unsigned char* pixel = &pixels[((size_t)y * width + x) * 4];
+                    row[x * 3] = pixel[0];
+                    row[x * 3 + 1] = pixel[1];
+                    row[x * 3 + 2] = pixel[2];
+                }
+                file.write((const char*)row.data(), row.size());
+            }
+            std::cout << "HEADLESS::OUTPUT " << width << "x" << height << " written to " << path << std::endl;
+            return true;
+        }
+
+    private:
+        GpuResource color;
+        GpuResource depth;
+        GpuResource framebuffer;
+        unsigned int width;
+        unsigned int height;
+
+        GLsync fences[HEADLESS_FRAMES_IN_FLIGHT];
+        unsigned long long frame;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+const unsigned int INPUT_KEYS = 512;
+const unsigned int INPUT_FLUSH_BYTES = 1 << 16;
+const unsigned char INPUT_LOG_VERSION = 1;
+const char INPUT_LOG_MAGIC[8] = {'O', 'G', 'L', 'I', 'N', 'P', 'U', 'T'};
+
+enum InputEventType{
+    INPUT_FRAME,
+    INPUT_KEY,
+    INPUT_MOUSE,
+    INPUT_SCROLL,
+    INPUT_RESIZE,
+    INPUT_EVENT_TYPE_COUNT
+};
+
+// X/Y hold the cursor position, the scroll offsets or the framebuffer size.
+// A frame event closes the events of one frame and carries its delta time.
+struct InputEvent{
+    unsigned int Type;
+    double Seconds;
+    int Key;
+    int Action;
+    double X;
+    double Y;
+    float DeltaTime;
+};
+
+// Applies replayed events the same way the live callbacks would.
+struct InputHandlers{
+    void (*Mouse)(double x, double y);
+    void (*Scroll)(double x, double y);
+    void (*Resize)(int width, int height);
+};
+
+// Sits between the window callbacks and the code that reacts to input, so a
+// session can be written to a log and later fed back without a window. The
+// log is a header followed by one record per event: a type byte, the time
+// since the previous event in microseconds as a varint, then the payload.
+// Positions and offsets are stored as doubles so a replay hands the camera
+// bit for bit the values it got live.
+class InputLayer{
+    public:
+        InputLayer() : handlers(InputHandlers{NULL, NULL, NULL}), recording(false), replaying(false), finished(false), frames(0), read(0), lastMicroseconds(0){
+            std::memset(keys, 0, sizeof(keys));
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~InputLayer(){
+            if (recording) flush();
+        }
+
+        InputLayer(const InputLayer&) = delete;
+        InputLayer& operator=(const InputLayer&) = delete;
+
+        void SetHandlers(const InputHandlers &inputHandlers){
+            handlers = inputHandlers;
+        }
+
+        bool Record(const std::string &path){
+            file.open(path, std::ios::binary);
+            if (!file){
+                std::cout << "ERROR::INPUT::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            file.write(INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC));
+            file.put((char)INPUT_LOG_VERSION);
+            buffer.reserve(INPUT_FLUSH_BYTES + 64);
+            recording = true;
+            return true;
+        }
+
+        bool Replay(const std::string &path){
+            std::ifstream log(path, std::ios::binary);
+            if (!log){
+                std::cout << "ERROR::INPUT::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            buffer.assign(std::istreambuf_iterator<char>(log), std::istreambuf_iterator<char>());
+            if (buffer.size() < sizeof(INPUT_LOG_MAGIC) + 1 || std::memcmp(buffer.data(), INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC)) != 0
+                || buffer[sizeof(INPUT_LOG_MAGIC)] != INPUT_LOG_VERSION){
+                std::cout << "ERROR::INPUT::NOT_AN_INPUT_LOG " << path << std::endl;
+                return false;
+            }
+
+            read = sizeof(INPUT_LOG_MAGIC) + 1;
+            InputEvent event;
+            while (decode(event)){
+                if (event.Type == INPUT_FRAME) frames++;
+            }
+            if (read != buffer.size()){
+                std::cout << "ERROR::INPUT::TRUNCATED_LOG " << path << ", replaying " << frames << " frames" << std::endl;
+            }
+            read = sizeof(INPUT_LOG_MAGIC) + 1;
+            lastMicroseconds = 0;
+            replaying = true;
+            return true;
+        }
+
+        bool Replaying() const{ return replaying; }
+
+        // True once a replay ran out of frames.
+        bool Finished() const{ return finished; }
+
+        unsigned long long ReplayFrames() const{ return frames; }
+
+        bool KeyDown(int key) const{
+            return key >= 0 && key < (int)INPUT_KEYS && keys[key];
+        }
+
+        // Live events from the window, ignored while replaying.
+        void Key(int key, int action){
+            if (replaying) return;
+            InputEvent event = InputEvent{INPUT_KEY, 0.0, key, action, 0.0, 0.0, 0.0f};
+            apply(event);
+            write(event);
+        }
+        void Mouse(double x, double y){
+            if (replaying) return;
+            InputEvent event = InputEvent{INPUT_MOUSE, 0.0, 0, 0, x, y, 0.0f};
+            apply(event);
+            write(event);
+        }
+        void Scroll(double x, double y){
+            if (replaying) return;
+            InputEvent event = InputEvent{INPUT_SCROLL, 0.0, 0, 0, x, y, 0.0f};
+            apply(event);
+            write(event);
+        }
+        void Resize(int width, int height){
+            if (replaying) return;
+            InputEvent event = InputEvent{INPUT_RESIZE, 0.0, 0, 0, (double)width, (double)height, 0.0f};
+            apply(event);
+            write(event);
+        }
+
+        // Closes the frame and returns the delta time it runs with. Live, that is the
+        // measured one, which gets recorded; a replay applies everything recorded
+        // for the frame and hands back the delta time of the original run.
+        float Frame(float deltaTime){
+            if (!replaying){
+                write(InputEvent{INPUT_FRAME, 0.0, 0, 0, 0.0, 0.0, deltaTime});
+                return deltaTime;
+            }
+
+            InputEvent event;
+            while (decode(event)){
+                if (event.Type == INPUT_FRAME) return event.DeltaTime;
+                apply(event);
+            }
+            finished = true;
+            return 0.0f;
+        }
+
+    private:
+        InputHandlers handlers;
+        bool keys[INPUT_KEYS];
+
+        bool recording;
+        bool replaying;
+        bool finished;
+        unsigned long long frames;
+
+        std::ofstream file;
+        std::vector<unsigned char> buffer;
+        size_t read;
+        unsigned long long lastMicroseconds;
+        std::chrono::steady_clock::time_point start;
+
+        void apply(const InputEvent &event){
+            switch (event.Type){
+                case INPUT_KEY:
+                    // GLFW_RELEASE is 0, press and repeat both hold the key down.
+                    if (event.Key >= 0 && event.Key < (int)INPUT_KEYS) keys[event.Key] = event.Action != 0;
+                    break;
+                case INPUT_MOUSE: if (handlers.Mouse) handlers.Mouse(event.X, event.Y); break;
+                case INPUT_SCROLL: if (handlers.Scroll) handlers.Scroll(event.X, event.Y); break;
+                case INPUT_RESIZE: if (handlers.Resize) handlers.Resize((int)event.X, (int)event.Y); break;
+            }
+        }
+
+        void write(const InputEvent &event){
+            if (!recording) return;
+            unsigned long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            buffer.push_back((unsigned char)event.Type);
+            putVarint(now - lastMicroseconds);
+            lastMicroseconds = now;
+
+            switch (event.Type){
+                case INPUT_FRAME: putBytes(&event.DeltaTime, sizeof(float)); break;
+                case INPUT_KEY:
+                    putVarint((unsigned int)event.Key);
+                    buffer.push_back((unsigned char)event.Action);
+                    break;
+                case INPUT_MOUSE:
+                case INPUT_SCROLL:
+                    putBytes(&event.X, sizeof(double));
+                    putBytes(&event.Y, sizeof(double));
+                    break;
+                case INPUT_RESIZE:
+                    putVarint((unsigned int)event.X);
+                    putVarint((unsigned int)event.Y);
+                    break;
+            }
+            if (buffer.size() >= INPUT_FLUSH_BYTES) flush();
+        }
+
+        void flush(){
+            file.write((const char*)buffer.data(), buffer.size());
+            file.flush();
+            buffer.clear();
+        }
+
+        void putVarint(unsigned long long value){
+            while (value >= 0x80){
+                buffer.push_back((unsigned char)(value | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back((unsigned char)value);
+        }
+
+        void putBytes(const void* data, size_t size){
+            const unsigned char* bytes = (const unsigned char*)data;
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+
+        // Returns false at the end of the log or at a record cut short.
+        bool decode(InputEvent &event){
+            if (read >= buffer.size()) return false;
+            size_t at = read;
+            unsigned long long delta, a, b;
+
+            event = InputEvent{buffer[at++], 0.0, 0, 0, 0.0, 0.0, 0.0f};
+            if (event.Type >= INPUT_EVENT_TYPE_COUNT || !getVarint(at, delta)) return false;
+            switch (event.Type){
+                case INPUT_FRAME:
+                    if (!getBytes(at, &event.DeltaTime, sizeof(float))) return false;
+                    break;
+                case INPUT_KEY:
+                    if (!getVarint(at, a) || at >= buffer.size()) return false;
+                    event.Key = (int)a;
+                    event.Action = buffer[at++];
+                    break;
+                case INPUT_MOUSE:
+                case INPUT_SCROLL:
+                    if (!getBytes(at, &event.X, sizeof(double)) || !getBytes(at, &event.Y, sizeof(double))) return false;
+                    break;
+                case INPUT_RESIZE:
+                    if (!getVarint(at, a) || !getVarint(at, b)) return false;
+                    event.X = (double)a;
+                    event.Y = (double)b;
+                    break;
+            }
+            lastMicroseconds += delta;
+            event.Seconds = lastMicroseconds / 1000000.0;
+            read = at;
+            return true;
+        }
+
+        bool getVarint(size_t &at, unsigned long long &value){
+            value = 0;
+            for (unsigned int shift = 0; at < buffer.size() && shift < 64; shift += 7){
+                unsigned char byte = buffer[at++];
+                value |= (unsigned long long)(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        bool getBytes(size_t &at, void* data, size_t size){
+            if (at + size > buffer.size()) return false;
+            std::memcpy(data, &buffer[at], size);
+            at += size;
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,417 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include <custom/profiler.h>
+
+const unsigned int JOB_DEQUE_SIZE = 4096;
+const unsigned int JOB_POOL_SIZE = 4096;
+
+struct JobCounter{
+    std::atomic<int> Value;
+
+    JobCounter() : Value(0){}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+};
+
+struct Job{
+    std::function<void()> Function;
+    JobCounter* Counter;
+    JobCounter* Dependency;
+    bool Owned;
+    std::atomic<bool>* Slot;
+};
+
+// Chase-Lev deque: the owning worker pushes and pops at the bottom, other workers steal from the top.
+class JobDeque{
+    public:
+        JobDeque() : top(0), bottom(0){
+            for (unsigned int i = 0; i < JOB_DEQUE_SIZE; i++){
+                buffer[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        bool Push(Job* job){
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= (int64_t)JOB_DEQUE_SIZE) return false;
+
+            buffer[b & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        Job* Pop(){
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            if (t > b){
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* job = buffer[b & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+            if (t == b){
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* Steal(){
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return nullptr;
+
+            Job* job = buffer[t & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+            return job;
+        }
+
+    private:
+        std::atomic<int64_t> top;
+        std::atomic<int64_t> bottom;
+        std::atomic<Job*> buffer[JOB_DEQUE_SIZE];
+};
+
+// Work stealing scheduler. The thread that creates the JobSystem becomes worker 0
+// and is the only one that runs jobs queued with RunOnMainThread, so GL calls can
+// be scheduled from anywhere but still execute on the context thread.
+// A job whose dependency has not reached zero yet is parked off the queues and
+// put back when the counter it waits for drops to zero.
+class JobSystem{
+    public:
+        JobSystem(unsigned int threads = 0) : running(true), queued(0), sleepers(0), parkedCount(0){
+            unsigned int count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned int i = 0; i < count; i++){
+                workers.emplace_back(new Worker());
+            }
+
+            currentSystem() = this;
+            currentWorker() = 0;
+            mainThread = std::this_thread::get_id();
+
+            for (unsigned int i = 1; i < count; i++){
+                workerThreads.emplace_back(&JobSystem::workerLoop, this, i);
+            }
+        }
+
+        ~JobSystem(){
+            running.store(false);
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                sleepCondition.notify_all();
+            }
+            for (unsigned int i = 0; i < workerThreads.size(); i++){
+                workerThreads[i].join();
+            }
+            if (currentSystem() == this) currentSystem() = nullptr;
+        }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        unsigned int WorkerCount() const{ return workers.size(); }
+        bool IsMainThread() const{ return std::this_thread::get_id() == mainThread; }
+
+        // The job does not start before dependency reaches zero.
+        void Run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr){
+            if (counter) counter->Value.fetch_add(1, std::memory_order_relaxed);
+
+            int index = workerIndex();
+            if (index >= 0){
+                Worker &worker = *workers[index];
+                unsigned int slot = worker.Next++ & (JOB_POOL_SIZE - 1);
+
+                // A pool slot can still be running on a thief when a worker has queued more than JOB_POOL_SIZE jobs.
+                Job* job;
+                if (!worker.Busy[slot].exchange(true, std::memory_order_acquire)){
+                    job = &worker.Pool[slot];
+                    job->Function = std::move(function);
+                    job->Counter = counter;
+                    job->Dependency = dependency;
+                    job->Owned = false;
+                    job->Slot = &worker.Busy[slot];
+                }else{
+                    job = new Job{std::move(function), counter, dependency, true, nullptr};
+                }
+
+                queued.fetch_add(1);
+                if (!worker.Queue.Push(job)){
+                    queued.fetch_sub(1);
+                    execute(job);
+                    return;
+                }
+                wake();
+            }else{
+                inject(new Job{std::move(function), counter, dependency, true, nullptr});
+            }
+        }
+
+        // For long running work like streaming loads: only the worker threads take these, so
+        // the main thread never picks one up while it helps out in Wait(). Without worker
+        // threads the function runs right away.
+        void RunBackground(std::function<void()> function, JobCounter* counter = nullptr){
+            if (workers.size() < 2){
+                function();
+                return;
+            }
+            if (counter) counter->Value.fetch_add(1, std::memory_order_relaxed);
+            queued.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(backgroundMutex);
+                background.push_back(new Job{std::move(function), counter, nullptr, true, nullptr});
+            }
+            wake();
+        }
+
+        void RunOnMainThread(std::function<void()> function, JobCounter* counter = nullptr){
+            if (counter) counter->Value.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(mainMutex);
+            mainJobs.push_back(new Job{std::move(function), counter, nullptr, true, nullptr});
+        }
+
+        // Runs the jobs queued for the main thread, call this once per frame from the GL thread.
+        void PumpMainThread(){
+            std::vector<Job*> jobs;
+            {
+                std::lock_guard<std::mutex> lock(mainMutex);
+                jobs.swap(mainJobs);
+            }
+            for (unsigned int i = 0; i < jobs.size(); i++){
+                jobs[i]->Function();
+                finish(jobs[i]->Counter);
+                delete jobs[i];
+            }
+        }
+
+        // Helps executing other jobs until the counter drops to zero instead of blocking.
+        void Wait(JobCounter &counter){
+            while (counter.Value.load(std::memory_order_acquire) > 0){
+                if (IsMainThread()) PumpMainThread();
+                if (!runOne()) std::this_thread::yield();
+            }
+        }
+
+        // Templated on the callable so a capturing lambda is not wrapped into a heap allocated std::function.
+        template<typename Function>
+        void ParallelFor(unsigned int count, unsigned int grain, const Function &function){
+            if (count == 0) return;
+            grain = std::max(1u, grain);
+            if (count <= grain){
+                function(0, count);
+                return;
+            }
+
+            JobCounter counter;
+            for (unsigned int begin = grain; begin < count; begin += grain){
+                unsigned int end = std::min(count, begin + grain);
+                Run([&function, begin, end](){ function(begin, end); }, &counter);
+            }
+            function(0, grain);
+            Wait(counter);
+        }
+
+    private:
+        struct Worker{
+            JobDeque Queue;
+            Job Pool[JOB_POOL_SIZE];
+            std::atomic<bool> Busy[JOB_POOL_SIZE];
+            unsigned int Next = 0;
+
+            Worker(){
+                for (unsigned int i = 0; i < JOB_POOL_SIZE; i++){
+                    Busy[i].store(false, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> workerThreads;
+        std::thread::id mainThread;
+
+        std::atomic<bool> running;
+        std::atomic<int> queued;        // jobs sitting in a deque, injected or background, what sleepers wake up for
+        std::atomic<int> sleepers;
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+
+        std::mutex injectMutex;
+        std::deque<Job*> injected;
+
+        std::mutex mainMutex;
+        std::vector<Job*> mainJobs;
+
+        std::mutex backgroundMutex;
+        std::deque<Job*> background;
+
+        std::mutex parkMutex;
+        std::vector<Job*> parked;
+        std::atomic<int> parkedCount;
+
+        static JobSystem*& currentSystem(){
+            static thread_local JobSystem* system = nullptr;
+            return system;
+        }
+
+        static int& currentWorker(){
+            static thread_local int worker = -1;
+            return worker;
+        }
+
+        int workerIndex() const{
+            return currentSystem() == this ? currentWorker() : -1;
+        }
+
+        void workerLoop(unsigned int index){
+            currentSystem() = this;
+            currentWorker() = index;
+            PROFILE_THREAD("job worker");
+
+            while (running.load(std::memory_order_relaxed)){
+                if (runOne()) continue;
+
+                sleepers.fetch_add(1);
+                {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    sleepCondition.wait_for(lock, std::chrono::milliseconds(1), [this](){
+                        return queued.load() > 0 || !running.load(std::memory_order_relaxed);
+                    });
+                }
+                sleepers.fetch_sub(1);
+            }
+        }
+
+        void wake(){
+            if (sleepers.load() > 0){
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                sleepCondition.notify_one();
+            }
+        }
+
+        bool runOne(){
+            Job* job = nullptr;
+            int index = workerIndex();
+            if (index >= 0) job = workers[index]->Queue.Pop();
+
+            if (!job){
+                std::lock_guard<std::mutex> lock(injectMutex);
+                if (!injected.empty()){
+                    job = injected.front();
+                    injected.pop_front();
+                }
+            }
+
+            for (unsigned int i = 1; !job && i <= workers.size(); i++){
+                unsigned int victim = (index + i) % workers.size();
+                if ((int)victim != index) job = workers[victim]->Queue.Steal();
+            }
+
+            if (!job && index > 0){
+                std::lock_guard<std::mutex> lock(backgroundMutex);
+                if (!background.empty()){
+                    job = background.front();
+                    background.pop_front();
+                }
+            }
+
+            if (!job) return false;
+            queued.fetch_sub(1);
+            execute(job);
+            return true;
+        }
+
+        void execute(Job* job){
+            if (job->Dependency && job->Dependency->Value.load(std::memory_order_acquire) > 0){
+                park(job);
+                return;
+            }
+
+            {
+                PROFILE_ZONE("job");
+                job->Function();
+            }
+
+            JobCounter* counter = job->Counter;
+            if (job->Owned) delete job;
+            else job->Slot->store(false, std::memory_order_release);
+            finish(counter);
+        }
+
+        void inject(Job* job){
+            {
+                std::lock_guard<std::mutex> lock(injectMutex);
+                injected.push_back(job);
+            }
+            queued.fetch_add(1);
+            wake();
+        }
+
+        // Parked jobs are owned, so they do not hold on to a pool slot for as long as they wait.
+        // The dependency is checked again under the lock, release() takes it after the counter
+        // drops, so either this sees zero or release() sees the job.
+        void park(Job* job){
+            if (!job->Owned){
+                Job* owned = new Job{std::move(job->Function), job->Counter, job->Dependency, true, nullptr};
+                job->Slot->store(false, std::memory_order_release);
+                job = owned;
+            }
+            {
+                std::lock_guard<std::mutex> lock(parkMutex);
+                parkedCount.fetch_add(1);
+                if (job->Dependency->Value.load() > 0){
+                    parked.push_back(job);
+                    return;
+                }
+                parkedCount.fetch_sub(1);
+            }
+            inject(job);
+        }
+
+        void finish(JobCounter* counter){
+            if (counter && counter->Value.fetch_sub(1) == 1) release(counter);
+        }
+
+        // Only compares the address, the counter may already be gone. A job released for a
+        // counter that was reused in the meantime is parked again by execute().
+        void release(JobCounter* counter){
+            if (parkedCount.load() == 0) return;
+            unsigned int count = 0;
+            {
+                std::lock_guard<std::mutex> parkLock(parkMutex);
+                std::lock_guard<std::mutex> injectLock(injectMutex);
+                for (unsigned int i = 0; i < parked.size(); ){
+                    if (parked[i]->Dependency != counter){
+                        i++;
+                        continue;
+                    }
+                    injected.push_back(parked[i]);
+                    parked[i] = parked.back();
+                    parked.pop_back();
+                    count++;
+                }
+                parkedCount.fetch_sub(count);
+            }
+            if (!count) return;
+            queued.fetch_add(count);
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            sleepCondition.notify_all();
+        }
+};
+
+#endif
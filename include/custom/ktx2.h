@@ -0,0 +1,287 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+// S3TC is an extension, the generated loader only has the core formats.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+const unsigned int KTX2_HEADER_SIZE = 80;
+const unsigned int KTX2_LEVEL_INDEX_SIZE = 24;
+const char* const KTX2_ORIENTATION_KEY = "KTXorientation";
+const char* const KTX2_SWIZZLE_KEY = "KTXswizzle";
+
+// The formats the baker writes and the renderer uploads, by Vulkan format number.
+enum Ktx2VkFormat{
+    KTX2_R8_UNORM = 9,
+    KTX2_R8G8_UNORM = 16,
+    KTX2_R8G8B8_UNORM = 23,
+    KTX2_R8G8B8A8_UNORM = 37,
+    KTX2_BC1_RGB_UNORM = 131,
+    KTX2_BC3_UNORM = 137,
+    KTX2_BC4_UNORM = 139,
+    KTX2_BC5_UNORM = 141,
+    KTX2_BC7_UNORM = 145
+};
+
+struct Ktx2Format{
+    unsigned int VkFormat;
+    const char* Name;
+    bool Compressed;
+    unsigned int BlockBytes;    // per 4x4 block when compressed, per texel otherwise
+    GLenum InternalFormat;
+    GLenum Format;              // pixel format of uncompressed uploads
+    unsigned int ColorModel;    // Khronos data format model, for the descriptor
+};
+
+const unsigned int KTX2_FORMAT_COUNT = 9;
+const Ktx2Format KTX2_FORMATS[KTX2_FORMAT_COUNT] = {
+    {KTX2_R8_UNORM, "R8", false, 1, GL_R8, GL_RED, 1},
+    {KTX2_R8G8_UNORM, "RG8", false, 2, GL_RG8, GL_RG, 1},
+    {KTX2_R8G8B8_UNORM, "RGB8", false, 3, GL_RGB8, GL_RGB, 1},
+    {KTX2_R8G8B8A8_UNORM, "RGBA8", false, 4, GL_RGBA8, GL_RGBA, 1},
+    {KTX2_BC1_RGB_UNORM, "BC1", true, 8, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 128},
+    {KTX2_BC3_UNORM, "BC3", true, 16, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 130},
+    {KTX2_BC4_UNORM, "BC4", true, 8, GL_COMPRESSED_RED_RGTC1, 0, 131},
+    {KTX2_BC5_UNORM, "BC5", true, 16, GL_COMPRESSED_RG_RGTC2, 0, 132},
+    {KTX2_BC7_UNORM, "BC7", true, 16, GL_COMPRESSED_RGBA_BPTC_UNORM, 0, 134}
+};
+
+inline const Ktx2Format* FindKtx2Format(unsigned int vkFormat){
+    for (unsigned int i = 0; i < KTX2_FORMAT_COUNT; i++){
+        if (KTX2_FORMATS[i].VkFormat == vkFormat) return &KTX2_FORMATS[i];
+    }
+    return NULL;
+}
+
+// One mip level, block compressed or tightly packed rows.
+struct TextureLevel{
+    unsigned int Width, Height;
+    std::vector<unsigned char> Pixels;
+};
+
+inline size_t Ktx2LevelBytes(const Ktx2Format &format, unsigned int width, unsigned int height){
+    if (format.Compressed) return (size_t)((width + 3) / 4) * ((height + 3) / 4) * format.BlockBytes;
+    return (size_t)width * height * format.BlockBytes;
+}
+
+// A 2D texture with its mip chain in a KTX2 file: no array layers, faces or
+// supercompression. Levels are kept finest first, the file stores them the
+// other way round as the format asks. The swizzle ("rgba", "rrr1", ...) is
+// the KTXswizzle key, it tells the loader how the stored channels map to
+// what the shaders sample. The orientation is the KTXorientation key, "rd"
+// when the first row is the top of the image and "ru" when it is the bottom.
+class Ktx2Texture{
+    public:
+        unsigned int VkFormat;
+        unsigned int Width, Height;
+        std::string Swizzle;
+        std::string Orientation;
+        std::vector<TextureLevel> Levels;
+
+        Ktx2Texture() : VkFormat(0), Width(0), Height(0), Swizzle("rgba"), Orientation("rd"){}
+
+        const Ktx2Format* Format() const{ return FindKtx2Format(VkFormat); }
+
+        size_t Bytes() const{
+            size_t bytes = 0;
+            for (unsigned int i = 0; i < Levels.size(); i++) bytes += Levels[i].Pixels.size();
+            return bytes;
+        }
+
+        bool Save(const std::string &path) const{
+            const Ktx2Format* format = Format();
+            if (!format || Levels.empty()){
+                std::cout << "ERROR::KTX2::NOTHING_TO_SAVE " << path << std::endl;
+                return false;
+            }
+
+            std::vector<unsigned char> dfd = descriptor(*format);
+            std::vector<unsigned char> kvd;
+            if (Orientation != "rd") keyValue(kvd, KTX2_ORIENTATION_KEY, Orientation);
+            if (Swizzle != "rgba") keyValue(kvd, KTX2_SWIZZLE_KEY, Swizzle);
+
+            size_t dfdOffset = KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * Levels.size();
+            size_t kvdOffset = dfdOffset + dfd.size();
+            size_t alignment = format->BlockBytes % 4 == 0 ? format->BlockBytes : format->BlockBytes * (format->BlockBytes % 2 ? 4 : 2);
+            std::vector<uint64_t> offsets(Levels.size());
+            size_t end = kvdOffset + kvd.size();
+            for (unsigned int i = Levels.size(); i-- > 0; ){
+                end = (end + alignment - 1) / alignment * alignment;
+                offsets[i] = end;
+                end += Levels[i].Pixels.size();
+            }
+
+            std::vector<unsigned char> file(end, 0);
+            std::memcpy(&file[0], KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+            uint32_t header[9] = {VkFormat, 1, Width, Height, 0, 0, 1, (uint32_t)Levels.size(), 0};
+            std::memcpy(&file[12], header, sizeof(header));
+            uint32_t index[4] = {(uint32_t)dfdOffset, (uint32_t)dfd.size(), kvd.empty() ? 0u : (uint32_t)kvdOffset, (uint32_t)kvd.size()};
+            std::memcpy(&file[48], index, sizeof(index));
+            for (unsigned int i = 0; i < Levels.size(); i++){
+                uint64_t level[3] = {offsets[i], Levels[i].Pixels.size(), Levels[i].Pixels.size()};
+                std::memcpy(&file[KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * i], level, sizeof(level));
+                std::memcpy(&file[offsets[i]], Levels[i].Pixels.data(), Levels[i].Pixels.size());
+            }
+            std::memcpy(&file[dfdOffset], dfd.data(), dfd.size());
+            if (!kvd.empty()) std::memcpy(&file[kvdOffset], kvd.data(), kvd.size());
+
+            std::ofstream out(path, std::ios::binary);
+            out.write((const char*)file.data(), file.size());
+            if (!out){
+                std::cout << "ERROR::KTX2::FAILED_TO_WRITE " << path << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        bool Load(const std::string &path){
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in){
+                std::cout << "ERROR::KTX2::FAILED_TO_OPEN " << path << std::endl;
+                return false;
+            }
+            std::vector<unsigned char> file((size_t)in.tellg());
+            in.seekg(0);
+            in.read((char*)file.data(), file.size());
+            if (!in || file.size() < KTX2_HEADER_SIZE || std::memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0){
+                std::cout << "ERROR::KTX2::NOT_A_KTX2_FILE " << path << std::endl;
+                return false;
+            }
+
+            uint32_t header[9], index[4];
+            std::memcpy(header, &file[12], sizeof(header));
+            std::memcpy(index, &file[48], sizeof(index));
+            const Ktx2Format* format = FindKtx2Format(header[0]);
+            if (!format || header[4] > 1 || header[5] > 1 || header[6] != 1 || header[7] == 0 || header[8] != 0 || !header[2] || !header[3]){
+                std::cout << "ERROR::KTX2::UNSUPPORTED " << path << ": format " << header[0] << ", only 2D textures without supercompression" << std::endl;
+                return false;
+            }
+            VkFormat = header[0];
+            Width = header[2];
+            Height = header[3];
+            unsigned int levelCount = header[7];
+            unsigned int maxLevels = 1;
+            while (maxLevels < 32 && (std::max(Width, Height) >> maxLevels) > 0) maxLevels++;
+            if (levelCount > maxLevels){
+                std::cout << "ERROR::KTX2::BAD_LEVEL_COUNT " << levelCount << " levels for " << Width << "x" << Height << " in " << path << std::endl;
+                return false;
+            }
+            if (KTX2_HEADER_SIZE + (size_t)KTX2_LEVEL_INDEX_SIZE * levelCount > file.size() || (size_t)index[2] + index[3] > file.size()){
+                std::cout << "ERROR::KTX2::TRUNCATED " << path << std::endl;
+                return false;
+            }
+
+            Levels.clear();
+            for (unsigned int i = 0; i < levelCount; i++){
+                uint64_t level[3];
+                std::memcpy(level, &file[KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * i], sizeof(level));
+                unsigned int width = std::max(1u, Width >> i), height = std::max(1u, Height >> i);
+                if (level[1] != Ktx2LevelBytes(*format, width, height) || level[0] > file.size() || level[1] > file.size() - level[0]){
+                    std::cout << "ERROR::KTX2::BAD_LEVEL " << i << " of " << path << std::endl;
+                    return false;
+                }
+                Levels.push_back(TextureLevel{width, height, std::vector<unsigned char>(file.begin() + level[0], file.begin() + level[0] + level[1])});
+            }
+
+            Swizzle = "rgba";
+            std::string swizzle = findKey(file, index[2], index[3], KTX2_SWIZZLE_KEY);
+            if (swizzle.size() == 4) Swizzle = swizzle;
+            Orientation = "rd";
+            std::string orientation = findKey(file, index[2], index[3], KTX2_ORIENTATION_KEY);
+            if (orientation.size() == 2) Orientation = orientation;
+            return true;
+        }
+
+        // GL_TEXTURE_SWIZZLE_RGBA values of the swizzle.
+        void GLSwizzle(GLint swizzle[4]) const{
+            for (unsigned int i = 0; i < 4; i++){
+                char c = i < Swizzle.size() ? Swizzle[i] : "rgba"[i];
+                swizzle[i] = c == 'r' ? GL_RED : c == 'g' ? GL_GREEN : c == 'b' ? GL_BLUE : c == 'a' ? GL_ALPHA : c == '0' ? GL_ZERO : GL_ONE;
+            }
+        }
+
+    private:
+        // A basic data format descriptor: linear, BT.709 primaries, one sample per channel or block plane.
+        static std::vector<unsigned char> descriptor(const Ktx2Format &format){
+            struct Sample{ unsigned int Offset, Bits, Channel, Upper; };
+            std::vector<Sample> samples;
+            if (!format.Compressed){
+                const unsigned int channels[4] = {0, 1, 2, 15};
+                for (unsigned int c = 0; c < format.BlockBytes; c++) samples.push_back(Sample{c * 8, 8, channels[c], 255});
+            }else if (format.VkFormat == KTX2_BC3_UNORM){
+                samples.push_back(Sample{0, 64, 15, 0xFFFFFFFF});
+                samples.push_back(Sample{64, 64, 0, 0xFFFFFFFF});
+            }else if (format.VkFormat == KTX2_BC5_UNORM){
+                samples.push_back(Sample{0, 64, 0, 0xFFFFFFFF});
+                samples.push_back(Sample{64, 64, 1, 0xFFFFFFFF});
+            }else{
+                samples.push_back(Sample{0, format.BlockBytes * 8, 0, 0xFFFFFFFF});
+            }
+
+            unsigned int blockSize = 24 + 16 * samples.size();
+            std::vector<unsigned char> dfd(4 + blockSize, 0);
+            uint32_t words[2] = {(uint32_t)dfd.size(), 0};
+            std::memcpy(&dfd[0], words, sizeof(words));
+            uint32_t version = 2 | (blockSize << 16);
+            std::memcpy(&dfd[8], &version, 4);
+            dfd[12] = format.ColorModel;
+            dfd[13] = 1;
+            dfd[14] = 1;
+            dfd[15] = 0;
+            if (format.Compressed){
+                dfd[16] = 3;
+                dfd[17] = 3;
+            }
+            dfd[20] = format.BlockBytes;
+            for (unsigned int i = 0; i < samples.size(); i++){
+                unsigned char* sample = &dfd[28 + 16 * i];
+                uint16_t offset = samples[i].Offset;
+                std::memcpy(sample, &offset, 2);
+                sample[2] = samples[i].Bits - 1;
+                sample[3] = samples[i].Channel;
+                std::memcpy(sample + 12, &samples[i].Upper, 4);
+            }
+            return dfd;
+        }
+
+        static void keyValue(std::vector<unsigned char> &kvd, const std::string &key, const std::string &value){
+            uint32_t length = key.size() + 1 + value.size() + 1;
+            size_t start = kvd.size();
+            kvd.resize(start + 4 + (length + 3) / 4 * 4, 0);
+            std::memcpy(&kvd[start], &length, 4);
+            std::memcpy(&kvd[start + 4], key.c_str(), key.size() + 1);
+            std::memcpy(&kvd[start + 4 + key.size() + 1], value.c_str(), value.size() + 1);
+        }
+
+        static std::string findKey(const std::vector<unsigned char> &file, size_t offset, size_t length, const std::string &key){
+            size_t end = offset + length;
+            while (offset + 4 <= end){
+                uint32_t size;
+                std::memcpy(&size, &file[offset], 4);
+                if (size > end - offset - 4) break;
+                const char* entry = (const char*)&file[offset + 4];
+                size_t keyLength = strnlen(entry, size);
+                if (keyLength < size && key == std::string(entry, keyLength)){
+                    std::string value(entry + keyLength + 1, size - keyLength - 1);
+                    return value.substr(0, value.find('\0'));
+                }
+                offset += 4 + (size + 3) / 4 * 4;
+            }
+            return std::string();
+        }
+};
+
+#endif
@@ -7,9 +7,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <custom/shader.h>
+#include <custom/gpu_resources.h>
 
 #include <string>
 #include <vector>
+#include <utility>
+#include <cmath>
 
 struct Vertex {
     glm::vec3 Position;
@@ -19,6 +22,21 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+struct AABB{
+    glm::vec3 Min;
+    glm::vec3 Max;
+};
+
+inline AABB TransformAABB(const AABB &bounds, const glm::mat4 &transform){
+    glm::vec3 center = glm::vec3(transform * glm::vec4((bounds.Min + bounds.Max) * 0.5f, 1.0f));
+    glm::vec3 halfExtent = (bounds.Max - bounds.Min) * 0.5f;
+    glm::vec3 extent(0.0f);
+    for (int i = 0; i < 3; i++){
+        extent += glm::abs(glm::vec3(transform[i])) * halfExtent[i];
+    }
+    return AABB{center - extent, center + extent};
+}
+
 struct Texture{
     unsigned int id;
     std::string type;
@@ -32,23 +50,111 @@ class Mesh{
         std::vector<Texture> textures;
 
         unsigned int VAO;
+        unsigned int IndexCount;
+        AABB Bounds;
+        // UV units per unit of length on the surface, 0 without texture coordinates.
+        float TexelScale;
+
+        // Takes ownership of the arrays, callers move them in instead of paying for a copy.
+        // Without upload the mesh can be built off the GL thread and uploaded there later.
+        Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, std::vector<Texture> &&textures, bool upload = true)
+            : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), VAO(0){
+
+            IndexCount = this->indices.size();
+            computeBounds();
+            computeTexelScale();
+            computeSamplerNames();
+            if (upload) setupMesh();
+        }
+
+        // The GL objects belong to exactly one Mesh, so it can only be moved.
+        Mesh(const Mesh&) = delete;
+        Mesh& operator=(const Mesh&) = delete;
+
+        Mesh(Mesh &&other) noexcept : VAO(0){
+            *this = std::move(other);
+        }
+
+        Mesh& operator=(Mesh &&other) noexcept{
+            if (this == &other) return *this;
+
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            samplerNames = std::move(other.samplerNames);
+            IndexCount = other.IndexCount;
+            Bounds = other.Bounds;
+            TexelScale = other.TexelScale;
+            vertexArray = std::move(other.vertexArray);
+            vertexBuffer = std::move(other.vertexBuffer);
+            indexBuffer = std::move(other.indexBuffer);
+            VAO = other.VAO;
+            other.VAO = 0;
+            return *this;
+        }
+
+        // Frees the CPU copy of the geometry once it lives on the GPU. Bounds and
+        // IndexCount stay valid, but the mesh can no longer be used as an occluder.
+        void ReleaseGeometry(){
+            std::vector<Vertex>().swap(vertices);
+            std::vector<unsigned int>().swap(indices);
+        }
 
-        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures){
-            this->vertices = vertices;
-            this->indices = indices;
-            this->textures = textures;
+        void Upload(){
+            if (!VAO) setupMesh();
+        }
 
-            setupMesh();
+        size_t GeometryBytes() const{
+            return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
         }
+
         void Draw(Shader &shader){
+            ALLOC_SCOPE(ALLOC_MESH_DRAW);
+            bindTextures(shader);
+
+            GLState().BindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0);
+        }
+
+        void DrawInstanced(Shader &shader, unsigned int instanceCount){
+            ALLOC_SCOPE(ALLOC_MESH_DRAW);
+            bindTextures(shader);
+
+            GLState().BindVertexArray(VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0, instanceCount);
+        }
+
+        void DrawIndirect(Shader &shader, unsigned int commandOffset){
+            ALLOC_SCOPE(ALLOC_MESH_DRAW);
+            bindTextures(shader);
+
+            GLState().BindVertexArray(VAO);
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(size_t)commandOffset);
+        }
+    private:
+        GpuResource vertexArray, vertexBuffer, indexBuffer;
+
+        std::vector<std::string> samplerNames;
+
+        void bindTextures(Shader &shader){
+            if (samplerNames.size() != textures.size()) computeSamplerNames();
+
+            shader.setFloat("material.shininess", 32);
+            for (unsigned int i = 0; i < textures.size(); i++){
+                shader.setInt(samplerNames[i].c_str(), i);
+                GLState().BindTexture(i, textures[i].id);
+            }
+        }
+
+        // The sampler uniform names only depend on the texture types, so they are built once instead of every draw.
+        void computeSamplerNames(){
             unsigned int diffuseNr = 0;
             unsigned int specularNr = 0;
             unsigned int normalNr = 0;
             unsigned int heightNr = 0;
 
+            samplerNames.clear();
             for (unsigned int i = 0; i < textures.size(); i++){
-                glActiveTexture(GL_TEXTURE0 + i);
-
                 std::string number;
                 std::string name = textures[i].type;
                 if (name == "texture_diffuse")
@@ -59,28 +165,45 @@ class Mesh{
                     number = std::to_string(normalNr++);
                 else if (name == "texture_height")
                     number = std::to_string(heightNr++);
-                
-                shader.setFloat("material.shininess", 32);
-                shader.setInt(("material." + name + "[" + number + "]"), i);
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+
+                samplerNames.push_back("material." + name + "[" + number + "]");
             }
+        }
+
+        void computeBounds(){
+            Bounds.Min = glm::vec3(0.0f);
+            Bounds.Max = glm::vec3(0.0f);
+            if (vertices.empty()) return;
 
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
-            
-            glActiveTexture(GL_TEXTURE0);
+            Bounds.Min = Bounds.Max = vertices[0].Position;
+            for (unsigned int i = 1; i < vertices.size(); i++){
+                Bounds.Min = glm::min(Bounds.Min, vertices[i].Position);
+                Bounds.Max = glm::max(Bounds.Max, vertices[i].Position);
+            }
         }
-    private:
-        unsigned int VBO, EBO;
         
+        void computeTexelScale(){
+            float area = 0.0f, uvArea = 0.0f;
+            for (unsigned int i = 0; i + 2 < indices.size(); i += 3){
+                const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+                area += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+                glm::vec2 u = b.TexCoords - a.TexCoords, v = c.TexCoords - a.TexCoords;
+                uvArea += std::abs(u.x * v.y - u.y * v.x);
+            }
+            TexelScale = area > 0.0f ? std::sqrt(uvArea / area) : 0.0f;
+        }
+
         void setupMesh(){
+            unsigned int VBO, EBO;
             glGenBuffers(1, &VBO);
             glGenBuffers(1, &EBO);
             glGenVertexArrays(1, &VAO);
+            vertexArray = GpuResource(GPU_VERTEX_ARRAY, VAO, 0, GPU_CATEGORY_MESH);
+            vertexBuffer = GpuResource(GPU_BUFFER, VBO, vertices.size() * sizeof(Vertex), GPU_CATEGORY_MESH);
+            indexBuffer = GpuResource(GPU_BUFFER, EBO, indices.size() * sizeof(unsigned int), GPU_CATEGORY_MESH);
 
-            glBindVertexArray(VAO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            GLState().BindVertexArray(VAO);
+            GLState().BindBuffer(GL_ARRAY_BUFFER, VBO);
 
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
@@ -102,8 +225,6 @@ class Mesh{
             glEnableVertexArrayAttrib(VAO, 4);
             glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-
-            glBindVertexArray(0);
         }
 };
 
@@ -0,0 +1,290 @@
+#ifndef MIP_GENERATION_H
+#define MIP_GENERATION_H
+
+#include <custom/job_system.h>
+#include <custom/ktx2.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// CPU mip chains for baking and streaming, in place of glGenerateMipmap.
+// Every level is filtered from the one above it with a separable windowed
+// sinc in float, each channel in its own plane so both passes are plain
+// loops over rows the compiler can vectorize: the vertical pass adds whole
+// source rows, the horizontal pass gathers a fixed number of taps per texel.
+// Color channels of sRGB images are filtered in linear light, alpha and
+// data channels as they are, normal maps are renormalized on every level.
+// Borders clamp, wrapping would bleed across atlas edges.
+
+enum MipFilter{
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+    MIP_FILTER_LANCZOS
+};
+
+const char* const MIP_FILTER_NAMES[3] = {"box", "kaiser", "lanczos"};
+
+const float MIP_KAISER_ALPHA = 4.0f;
+const float MIP_SINC_RADIUS = 3.0f;     // in destination texels, Kaiser and Lanczos alike
+const unsigned int MIP_ROW_GRAIN = 16;
+
+struct MipSettings{
+    MipFilter Filter = MIP_FILTER_KAISER;
+    bool Srgb = false;      // color channels are sRGB encoded
+    bool Normal = false;    // rgb holds a unit vector packed as 0.5 * n + 0.5
+};
+
+// One float plane per channel.
+struct MipImage{
+    unsigned int Width, Height, Components;
+    std::vector<float> Planes[4];
+};
+
+// Weights of one axis, Taps per destination texel with the source indices already clamped.
+struct MipKernel{
+    unsigned int Taps;
+    std::vector<unsigned int> Indices;
+    std::vector<float> Weights;
+};
+
+inline float mipSinc(float x){
+    if (std::fabs(x) < 1e-5f) return 1.0f;
+    x *= 3.14159265f;
+    return std::sin(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind, by its series.
+inline float mipBessel(float x){
+    float sum = 1.0f, term = 1.0f;
+    for (unsigned int k = 1; k < 32; k++){
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+        if (term < sum * 1e-8f) break;
+    }
+    return sum;
+}
+
+// x in destination texels from the destination texel center.
+inline float mipFilterWeight(MipFilter filter, float x){
+    float t = std::fabs(x);
+    switch (filter){
+        case MIP_FILTER_BOX: return t < 0.5f ? 1.0f : t == 0.5f ? 0.5f : 0.0f;
+        case MIP_FILTER_LANCZOS: return t < MIP_SINC_RADIUS ? mipSinc(t) * mipSinc(t / MIP_SINC_RADIUS) : 0.0f;
+        case MIP_FILTER_KAISER:{
+            if (t >= MIP_SINC_RADIUS) return 0.0f;
+            float r = t / MIP_SINC_RADIUS;
+            return mipSinc(t) * mipBessel(MIP_KAISER_ALPHA * std::sqrt(1.0f - r * r)) / mipBessel(MIP_KAISER_ALPHA);
+        }
+    }
+    return 0.0f;
+}
+
+inline MipKernel mipKernel(MipFilter filter, unsigned int sourceSize, unsigned int size){
+    float scale = (float)sourceSize / size;
+    float support = (filter == MIP_FILTER_BOX ? 0.5f : MIP_SINC_RADIUS) * scale;
+    MipKernel kernel;
+    kernel.Taps = (unsigned int)std::ceil(2.0f * support) + 1;
+    kernel.Indices.resize((size_t)size * kernel.Taps);
+    kernel.Weights.resize((size_t)size * kernel.Taps);
+    for (unsigned int i = 0; i < size; i++){
+        float center = (i + 0.5f) * scale;
+        int first = (int)std::floor(center - support);
+        float sum = 0.0f;
+        for (unsigned int k = 0; k < kernel.Taps; k++){
+            int source = first + (int)k;
+            float weight = mipFilterWeight(filter, (source + 0.5f - center) / scale);
+            kernel.Indices[(size_t)i * kernel.Taps + k] = (unsigned int)std::min(std::max(source, 0), (int)sourceSize - 1);
+            kernel.Weights[(size_t)i * kernel.Taps + k] = weight;
+            sum += weight;
+        }
+        for (unsigned int k = 0; k < kernel.Taps; k++) kernel.Weights[(size_t)i * kernel.Taps + k] /= sum;
+    }
+    return kernel;
+}
+
+inline float mipSrgbToLinear(float value){
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float mipLinearToSrgb(float value){
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Encoded bytes of linear values in steps of 1 / MIP_SRGB_STEPS, fine enough that the darkest step stays below a byte.
+const unsigned int MIP_SRGB_STEPS = 1 << 16;
+
+inline const unsigned char* mipSrgbTable(){
+    static const std::vector<unsigned char> table = [](){
+        std::vector<unsigned char> bytes(MIP_SRGB_STEPS + 1);
+        for (unsigned int i = 0; i <= MIP_SRGB_STEPS; i++) bytes[i] = (unsigned char)(mipLinearToSrgb((float)i / MIP_SRGB_STEPS) * 255.0f + 0.5f);
+        return bytes;
+    }();
+    return table.data();
+}
+
+// Channels filtered in linear light: rgb, or the grey channel of 1 and 2 component images.
+inline unsigned int mipColorChannels(unsigned int components){
+    return components >= 3 ? 3 : 1;
+}
+
+inline void mipNormalize(MipImage &image, unsigned int begin, unsigned int end){
+    if (image.Components < 3) return;
+    float* x = image.Planes[0].data();
+    float* y = image.Planes[1].data();
+    float* z = image.Planes[2].data();
+    for (size_t i = (size_t)begin * image.Width; i < (size_t)end * image.Width; i++){
+        float length = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        float scale = length > 1e-6f ? 1.0f / length : 0.0f;
+        x[i] *= scale;
+        y[i] *= scale;
+        z[i] = length > 1e-6f ? z[i] * scale : 1.0f;
+    }
+}
+
+template<typename Function>
+inline void mipParallelRows(unsigned int rows, JobSystem* jobs, const Function &function){
+    if (jobs) jobs->ParallelFor(rows, MIP_ROW_GRAIN, function);
+    else function(0, rows);
+}
+
+inline MipImage mipDecode(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int components,
+                          const MipSettings &settings, JobSystem* jobs){
+    float table[256];
+    MipImage image{width, height, components, {}};
+    for (unsigned int c = 0; c < components; c++) image.Planes[c].resize((size_t)width * height);
+    for (unsigned int c = 0; c < components; c++){
+        bool color = c < mipColorChannels(components);
+        for (unsigned int v = 0; v < 256; v++){
+            float value = v / 255.0f;
+            if (color && settings.Normal && components >= 3) value = value * 2.0f - 1.0f;
+            else if (color && settings.Srgb) value = mipSrgbToLinear(value);
+            table[v] = value;
+        }
+        float* plane = image.Planes[c].data();
+        mipParallelRows(height, jobs, [&](unsigned int begin, unsigned int end){
+            for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++) plane[i] = table[pixels[i * components + c]];
+        });
+    }
+    return image;
+}
+
+inline TextureLevel mipEncode(const MipImage &image, const MipSettings &settings, JobSystem* jobs){
+    TextureLevel level{image.Width, image.Height, std::vector<unsigned char>((size_t)image.Width * image.Height * image.Components)};
+    unsigned int components = image.Components;
+    mipParallelRows(image.Height, jobs, [&](unsigned int begin, unsigned int end){
+        for (unsigned int c = 0; c < components; c++){
+            bool color = c < mipColorChannels(components);
+            bool normal = color && settings.Normal && components >= 3;
+            bool srgb = color && !normal && settings.Srgb;
+            const float* plane = image.Planes[c].data();
+            const unsigned char* table = mipSrgbTable();
+            for (size_t i = (size_t)begin * image.Width; i < (size_t)end * image.Width; i++){
+                float value = normal ? plane[i] * 0.5f + 0.5f : plane[i];
+                value = std::min(std::max(value, 0.0f), 1.0f);
+                level.Pixels[i * components + c] = srgb ? table[(unsigned int)(value * MIP_SRGB_STEPS + 0.5f)] : (unsigned char)(value * 255.0f + 0.5f);
+            }
+        }
+    });
+    return level;
+}
+
+// Vertically into rows of the source width, then horizontally; an axis that keeps its size is copied.
+inline MipImage mipDownsample(const MipImage &source, const MipSettings &settings, JobSystem* jobs){
+    unsigned int width = std::max(1u, source.Width / 2), height = std::max(1u, source.Height / 2);
+    MipImage vertical{source.Width, height, source.Components, {}};
+    if (height == source.Height){
+        for (unsigned int c = 0; c < source.Components; c++) vertical.Planes[c] = source.Planes[c];
+    }else{
+        MipKernel kernel = mipKernel(settings.Filter, source.Height, height);
+        for (unsigned int c = 0; c < source.Components; c++) vertical.Planes[c].assign((size_t)source.Width * height, 0.0f);
+        mipParallelRows(height, jobs, [&](unsigned int begin, unsigned int end){
+            for (unsigned int c = 0; c < source.Components; c++){
+                for (unsigned int y = begin; y < end; y++){
+                    float* out = &vertical.Planes[c][(size_t)y * source.Width];
+                    for (unsigned int k = 0; k < kernel.Taps; k++){
+                        float weight = kernel.Weights[(size_t)y * kernel.Taps + k];
+                        if (weight == 0.0f) continue;
+                        const float* in = &source.Planes[c][(size_t)kernel.Indices[(size_t)y * kernel.Taps + k] * source.Width];
+                        for (unsigned int x = 0; x < source.Width; x++) out[x] += weight * in[x];
+                    }
+                }
+            }
+        });
+    }
+
+    MipImage image{width, height, source.Components, {}};
+    if (width == source.Width){
+        for (unsigned int c = 0; c < source.Components; c++) image.Planes[c] = std::move(vertical.Planes[c]);
+    }else{
+        MipKernel kernel = mipKernel(settings.Filter, source.Width, width);
+        for (unsigned int c = 0; c < source.Components; c++) image.Planes[c].resize((size_t)width * height);
+        mipParallelRows(height, jobs, [&](unsigned int begin, unsigned int end){
+            for (unsigned int c = 0; c < source.Components; c++){
+                for (unsigned int y = begin; y < end; y++){
+                    const float* in = &vertical.Planes[c][(size_t)y * source.Width];
+                    float* out = &image.Planes[c][(size_t)y * width];
+                    for (unsigned int x = 0; x < width; x++){
+                        const unsigned int* indices = &kernel.Indices[(size_t)x * kernel.Taps];
+                        const float* weights = &kernel.Weights[(size_t)x * kernel.Taps];
+                        float sum = 0.0f;
+                        for (unsigned int k = 0; k < kernel.Taps; k++) sum += weights[k] * in[indices[k]];
+                        out[x] = sum;
+                    }
+                }
+            }
+        });
+    }
+    if (settings.Normal) mipParallelRows(height, jobs, [&image](unsigned int begin, unsigned int end){ mipNormalize(image, begin, end); });
+    return image;
+}
+
+// The whole chain down to 1x1, top level first, tightly packed with the input's component count.
+// Levels are filtered from the float level above, so rounding does not add up along the chain.
+inline std::vector<TextureLevel> GenerateMips(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int components,
+                                              const MipSettings &settings, JobSystem* jobs){
+    std::vector<TextureLevel> levels;
+    levels.push_back(TextureLevel{width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * components)});
+    if (width <= 1 && height <= 1) return levels;
+
+    MipImage image = mipDecode(pixels, width, height, components, settings, jobs);
+    if (settings.Normal) mipParallelRows(height, jobs, [&image](unsigned int begin, unsigned int end){ mipNormalize(image, begin, end); });
+    while (image.Width > 1 || image.Height > 1){
+        image = mipDownsample(image, settings, jobs);
+        levels.push_back(mipEncode(image, settings, jobs));
+    }
+    return levels;
+}
+
+// The cheap chain for textures that were not baked, filtered at load time: 2x2 averages of the
+// stored bytes, the box glGenerateMipmap gives the textures that are not streamed. No linear
+// light and no renormalization, texture_bake writes the GenerateMips chain for that.
+inline std::vector<TextureLevel> GenerateBoxMips(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int components,
+                                                 JobSystem* jobs){
+    std::vector<TextureLevel> levels;
+    levels.push_back(TextureLevel{width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * components)});
+    while (width > 1 || height > 1){
+        unsigned int sourceWidth = width, sourceHeight = height;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        TextureLevel level{width, height, std::vector<unsigned char>((size_t)width * height * components)};
+        const unsigned char* source = levels.back().Pixels.data();
+        mipParallelRows(height, jobs, [&](unsigned int begin, unsigned int end){
+            for (unsigned int y = begin; y < end; y++){
+                const unsigned char* row0 = source + (size_t)std::min(2 * y, sourceHeight - 1) * sourceWidth * components;
+                const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, sourceHeight - 1) * sourceWidth * components;
+                unsigned char* out = &level.Pixels[(size_t)y * width * components];
+                for (unsigned int x = 0; x < width; x++){
+                    unsigned int x0 = std::min(2 * x, sourceWidth - 1) * components, x1 = std::min(2 * x + 1, sourceWidth - 1) * components;
+                    for (unsigned int c = 0; c < components; c++){
+                        out[x * components + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                    }
+                }
+            }
+        });
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+#endif
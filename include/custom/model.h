@@ -12,52 +12,380 @@
 
 #include <custom/mesh.h>
 #include <custom/shader.h>
+#include <custom/occlusion.h>
+#include <custom/gpu_culler.h>
+#include <custom/transform.h>
+#include <custom/job_system.h>
+#include <custom/command_buffer.h>
+#include <custom/perf_counters.h>
+#include <custom/texture_streaming.h>
+#include <custom/texture_baking.h>
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 
-unsigned int TextureFromFile(const char* path, const std::string &directory, bool gamma = false);
-unsigned int EmptyTexture();
+struct TextureData{
+    unsigned char* data;
+    int width, height, nrComponents;
+    Ktx2Texture* baked = NULL;  // set instead of data when a current .ktx2 bake was found
+};
+
+GpuResource TextureFromFile(const char* path, const std::string &directory, bool gamma = false);
+TextureData DecodeTexture(const char* path, const std::string &directory, bool preferBaked = true);
+void FreeTextureData(TextureData &texture);
+GpuResource UploadTexture(TextureData &texture, const char* path, JobSystem* jobs = NULL);
+GpuResource UploadBakedTexture(Ktx2Texture &texture);
+GpuResource EmptyTexture();
+
+const unsigned int PARALLEL_VERTEX_GRAIN = 4096;
+
+const unsigned int PENDING_EMPTY_TEXTURE = 0xFFFFFFFF;
+
+const unsigned int INSTANCE_TRANSFORM_BINDING = 6;
+const unsigned int INSTANCE_DATA_BINDING = 7;
 
 class Model{
     std::vector<Mesh> meshes;
     std::string directory;
     std::vector<Texture> textures_loaded;
+    std::vector<GpuResource> ownedTextures;
+    GpuResource emptyTexture;
     bool gammaCorrection;
     unsigned int maxTextures = 4;
+    GpuResource instanceTransformBuffer, instanceDataBuffer;
+    size_t instanceTransformCapacity = 0, instanceDataCapacity = 0;
+    TransformHierarchy nodes;
+    std::vector<unsigned int> meshNodes;
+    JobSystem* jobs;
+    std::unordered_map<std::string, TextureData> decodedTextures;
+    bool deferred;
+    std::vector<std::pair<TextureData, std::string>> pendingTextures;
 
     public:
-        Model(const std::string &path, bool gamma = false) : gammaCorrection(gamma){
+        bool Occluder;
+
+        // With a job system, texture decoding and vertex conversion run on the workers while
+        // every GL upload stays on the calling thread.
+        // A deferred model only imports and decodes, nothing touches GL until Upload(), so it
+        // can be loaded on a worker thread and uploaded on the GL thread when there is time.
+        Model(const std::string &path, bool gamma = false, JobSystem* jobs = NULL, bool deferUpload = false)
+            : gammaCorrection(gamma), jobs(jobs), deferred(deferUpload), Occluder(false){
+            PROFILE_ZONE("model load");
+            ALLOC_SCOPE(ALLOC_MODEL_LOAD);
+            nodes.AddNode(-1);
             loadModel(path);
+            this->jobs = NULL;
+        }
+
+        // A model built in code from meshes that are already uploaded, their textures belong to the caller.
+        Model(std::vector<Mesh> &&meshes) : meshes(std::move(meshes)), gammaCorrection(false), jobs(NULL), deferred(false), Occluder(false){
+            nodes.AddNode(-1);
+            meshNodes.assign(this->meshes.size(), 0);
+            nodes.Update();
+        }
+
+        ~Model(){
+            for (unsigned int i = 0; i < pendingTextures.size(); i++){
+                FreeTextureData(pendingTextures[i].first);
+            }
+        }
+
+        Model(const Model&) = delete;
+        Model& operator=(const Model&) = delete;
+
+        // Uploads the textures and meshes of a deferred model, the mesh textures hold
+        // indices into the pending textures until then.
+        void Upload(){
+            if (!deferred) return;
+            PROFILE_ZONE("model upload");
+            std::vector<unsigned int> ids;
+            for (unsigned int i = 0; i < pendingTextures.size(); i++){
+                ownedTextures.push_back(UploadTexture(pendingTextures[i].first, pendingTextures[i].second.c_str(), jobs));
+                ids.push_back(ownedTextures.back().Id());
+            }
+            pendingTextures.clear();
+            emptyTexture = EmptyTexture();
+
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                for (unsigned int t = 0; t < meshes[i].textures.size(); t++){
+                    unsigned int &id = meshes[i].textures[t].id;
+                    id = id == PENDING_EMPTY_TEXTURE ? emptyTexture.Id() : ids[id];
+                }
+                meshes[i].Upload();
+            }
+            for (unsigned int i = 0; i < textures_loaded.size(); i++){
+                if (textures_loaded[i].id != PENDING_EMPTY_TEXTURE) textures_loaded[i].id = ids[textures_loaded[i].id];
+            }
+            deferred = false;
+        }
+
+        // What Upload() will hand to GL: the geometry and the decoded texels.
+        size_t PendingBytes() const{
+            size_t bytes = deferred ? GeometryBytes() : 0;
+            for (unsigned int i = 0; i < pendingTextures.size(); i++){
+                const TextureData &texture = pendingTextures[i].first;
+                bytes += texture.baked ? texture.baked->Bytes() : TextureBytes(texture.width, texture.height, texture.nrComponents, true);
+            }
+            return bytes;
+        }
+
+        void SetTransform(const glm::mat4 &transform){
+            nodes.SetLocal(0, transform);
+        }
+
+        // Recomputes the node transforms below anything changed since the last call, the draw calls do this themselves.
+        unsigned int Update(){
+            return nodes.Update();
+        }
+
+        const glm::mat4& GetMeshTransform(unsigned int mesh) const{
+            return nodes.GetWorld(meshNodes[mesh]);
+        }
+
+        std::vector<glm::mat4> GetMeshTransforms() const{
+            std::vector<glm::mat4> transforms;
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                transforms.push_back(GetMeshTransform(i));
+            }
+            return transforms;
         }
 
         void Draw(Shader &shader){
+            nodes.Update();
             for (unsigned int i = 0; i < meshes.size(); i++){
+                setNodeUniforms(shader, i);
                 meshes[i].Draw(shader);
             }
         }
+
+        // One instanced draw per mesh, transforms (and optional per instance vec4s) are read
+        // from SSBOs by gl_InstanceID, see object_instanced_vert.glsl.
+        void DrawInstanced(Shader &shader, const std::vector<glm::mat4> &transforms, const std::vector<glm::vec4> &instanceData = std::vector<glm::vec4>()){
+            if (transforms.empty()) return;
+            nodes.Update();
+
+            uploadInstances(instanceTransformBuffer, instanceTransformCapacity, transforms.data(), transforms.size() * sizeof(glm::mat4));
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_TRANSFORM_BINDING, instanceTransformBuffer.Id());
+
+            shader.setBool("hasInstanceData", !instanceData.empty());
+            if (!instanceData.empty()){
+                uploadInstances(instanceDataBuffer, instanceDataCapacity, instanceData.data(), instanceData.size() * sizeof(glm::vec4));
+                GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, instanceDataBuffer.Id());
+            }
+
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                shader.setMat4("node", GetMeshTransform(i));
+                meshes[i].DrawInstanced(shader, transforms.size());
+            }
+        }
+
+        void Draw(Shader &shader, OcclusionCuller &culler){
+            nodes.Update();
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                if (culler.IsVisible(meshes[i].Bounds, GetMeshTransform(i))){
+                    setNodeUniforms(shader, i);
+                    meshes[i].Draw(shader);
+                }
+            }
+        }
+
+        // model is this model's index in the culler's SetInstances.
+        void DrawCulled(Shader &shader, GpuCuller &culler, int phase, unsigned int model = 0){
+            nodes.Update();
+            culler.Bind();
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                shader.setMat4("node", GetMeshTransform(i));
+                meshes[i].DrawIndirect(shader, culler.CommandOffset(phase, culler.MeshBase(model) + i));
+            }
+        }
+
+        // Records the draws without any GL calls, so it can run on a worker. The node
+        // transforms have to be up to date, call Update() on the GL thread first.
+        void Record(CommandBuffer &commands, const DrawProgram &program, const OcclusionCuller* culler = NULL) const{
+            commands.BindProgram(program);
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                if (culler && !culler->Test(meshes[i].Bounds, GetMeshTransform(i))) continue;
+
+                commands.BindMaterial(meshes[i]);
+                commands.SetDrawData(nodes.GetWorld(meshNodes[i]), nodes.GetNormal(meshNodes[i]));
+                commands.Draw(meshes[i]);
+            }
+        }
+
+        // Records one instance of the model, transform is applied on top of the node transforms
+        // instead of through SetTransform, so every instance of a model can be recorded in parallel.
+        void Record(CommandBuffer &commands, const DrawProgram &program, const glm::mat4 &transform, const OcclusionCuller* culler = NULL) const{
+            glm::mat3 normal = TransformHierarchy::NormalMatrix(transform);
+            commands.BindProgram(program);
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                glm::mat4 world = transform * GetMeshTransform(i);
+                if (culler && !culler->Test(meshes[i].Bounds, world)) continue;
+
+                commands.BindMaterial(meshes[i]);
+                commands.SetDrawData(world, normal * nodes.GetNormal(meshNodes[i]));
+                commands.Draw(meshes[i]);
+            }
+        }
+
+        // Tells the texture streamer how much of each mesh's UV range one pixel covers for this
+        // instance, from the UV density of the mesh and the distance of its bounds to the eye.
+        // pixelScale is the viewport height in pixels over the height of the view at distance 1.
+        void RequestTextures(TextureStreamer &streamer, const glm::mat4 &transform, const glm::vec3 &eye, float pixelScale) const{
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                if (meshes[i].TexelScale <= 0.0f) continue;
+                glm::mat4 world = transform * GetMeshTransform(i);
+                float scale = std::cbrt(std::abs(glm::determinant(glm::mat3(world))));
+                if (scale <= 0.0f) continue;
+                AABB bounds = TransformAABB(meshes[i].Bounds, world);
+                float distance = glm::length(eye - glm::clamp(eye, bounds.Min, bounds.Max));
+                float uvPerPixel = meshes[i].TexelScale / scale * distance / pixelScale;
+
+                unsigned int previous = 0;
+                for (unsigned int t = 0; t < meshes[i].textures.size(); t++){
+                    const Texture &texture = meshes[i].textures[t];
+                    if (texture.id == previous || texture.path == "empty") continue;
+                    streamer.Request(texture.id, uvPerPixel);
+                    previous = texture.id;
+                }
+            }
+        }
+
+        void SubmitOccluders(OcclusionCuller &culler){
+            if (!Occluder) return;
+            nodes.Update();
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                culler.AddOccluder(meshes[i], GetMeshTransform(i));
+            }
+        }
+
+        void SubmitOccluders(OcclusionCuller &culler, const glm::mat4 &transform){
+            if (!Occluder) return;
+            nodes.Update();
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                culler.AddOccluder(meshes[i], transform * GetMeshTransform(i));
+            }
+        }
+
+        // Drops the CPU copy of every mesh after upload, occluders keep theirs for the software rasterizer.
+        void ReleaseGeometry(){
+            if (Occluder) return;
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                meshes[i].ReleaseGeometry();
+            }
+        }
+
+        size_t GeometryBytes() const{
+            size_t bytes = 0;
+            for (unsigned int i = 0; i < meshes.size(); i++){
+                bytes += meshes[i].GeometryBytes();
+            }
+            return bytes;
+        }
+
+        const std::vector<Mesh>& GetMeshes() const{
+            return meshes;
+        }
+
+        AABB GetBounds() const{
+            if (meshes.empty()) return AABB{glm::vec3(0.0f), glm::vec3(0.0f)};
+
+            AABB bounds = TransformAABB(meshes[0].Bounds, GetMeshTransform(0));
+            for (unsigned int i = 1; i < meshes.size(); i++){
+                AABB meshBounds = TransformAABB(meshes[i].Bounds, GetMeshTransform(i));
+                bounds.Min = glm::min(bounds.Min, meshBounds.Min);
+                bounds.Max = glm::max(bounds.Max, meshBounds.Max);
+            }
+            return bounds;
+        }
     private:
+        void setNodeUniforms(Shader &shader, unsigned int mesh){
+            shader.setMat4("model", nodes.GetWorld(meshNodes[mesh]));
+            shader.setMat3("normalMat", nodes.GetNormal(meshNodes[mesh]));
+        }
+
+        // A buffer that is outgrown is released to the registry, which keeps it alive until the GPU is done with it.
+        void uploadInstances(GpuResource &buffer, size_t &capacity, const void* data, size_t size){
+            if (size > capacity){
+                unsigned int id;
+                capacity = std::max(size, capacity * 2);
+                glCreateBuffers(1, &id);
+                glNamedBufferStorage(id, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+                buffer = GpuResource(GPU_BUFFER, id, capacity, GPU_CATEGORY_INSTANCING);
+            }else{
+                glInvalidateBufferData(buffer.Id());
+            }
+            glNamedBufferSubData(buffer.Id(), 0, size, data);
+        }
+
         void loadModel(const std::string &path){
             Assimp::Importer importer;
-            const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+            const aiScene* scene;
+            {
+                PROFILE_ZONE("assimp import");
+                PERF_PHASE("import");
+                scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+            }
 
             if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
                 std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
                 return;
             }
             directory = path.substr(0, path.find_last_of('/'));
-            
-            processNode(scene->mRootNode, scene);
+
+            if (jobs) decodeTextures(scene);
+            {
+                PROFILE_ZONE("process meshes");
+                processNode(scene->mRootNode, scene, 0);
+            }
+
+            for (auto it = decodedTextures.begin(); it != decodedTextures.end(); ++it){
+                FreeTextureData(it->second);
+            }
+            decodedTextures.clear();
+        }
+
+        void decodeTextures(const aiScene* scene){
+            aiTextureType types[] = {aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT};
+            std::vector<std::string> paths;
+            for (unsigned int m = 0; m < scene->mNumMaterials; m++){
+                for (unsigned int t = 0; t < 4; t++){
+                    for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(types[t]) && i < maxTextures; i++){
+                        aiString str;
+                        scene->mMaterials[m]->GetTexture(types[t], i, &str);
+                        if (decodedTextures.insert(std::make_pair(std::string(str.C_Str()), TextureData{NULL, 0, 0, 0})).second)
+                            paths.push_back(str.C_Str());
+                    }
+                }
+            }
+
+            std::vector<TextureData> decoded(paths.size());
+            jobs->ParallelFor(paths.size(), 1, [this, &paths, &decoded](unsigned int begin, unsigned int end){
+                for (unsigned int i = begin; i < end; i++){
+                    decoded[i] = DecodeTexture(paths[i].c_str(), directory);
+                }
+            });
+            for (unsigned int i = 0; i < paths.size(); i++){
+                decodedTextures[paths[i]] = decoded[i];
+            }
         }
 
-        void processNode(aiNode* node, const aiScene* scene){
+        void processNode(aiNode* node, const aiScene* scene, int parent){
+            const aiMatrix4x4 &m = node->mTransformation;
+            glm::mat4 local(m.a1, m.b1, m.c1, m.d1,
+                            m.a2, m.b2, m.c2, m.d2,
+                            m.a3, m.b3, m.c3, m.d3,
+                            m.a4, m.b4, m.c4, m.d4);
+            unsigned int index = nodes.AddNode(parent, local);
+
             for (unsigned int i = 0; i < node->mNumMeshes; i++){
                 aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
                 meshes.push_back(processMesh(mesh, scene));
+                meshNodes.push_back(index);
             }
 
             for (unsigned int i = 0; i < node->mNumChildren; i++){
-                processNode(node->mChildren[i], scene);
+                processNode(node->mChildren[i], scene, index);
             }
         }
 
@@ -66,44 +394,22 @@ class Model{
             std::vector<unsigned int> indices;
             std::vector<Texture> textures;
 
-            for (unsigned int i = 0; i < mesh->mNumVertices; i++){
-                Vertex vertex;
-
-                glm::vec3 vector;
-                vector.x = mesh->mVertices[i].x;
-                vector.y = mesh->mVertices[i].y;
-                vector.z = mesh->mVertices[i].z;
-                vertex.Position = vector;
-                
-                if (mesh->HasNormals()){
-                    vector.x = mesh->mNormals[i].x;
-                    vector.y = mesh->mNormals[i].y;
-                    vector.z = mesh->mNormals[i].z;
-                    vertex.Normal = vector;
-                }
-
-                if (mesh->mTextureCoords[0]){
-                    glm::vec2 vec;
-                    vec.x = mesh->mTextureCoords[0][i].x;
-                    vec.y = mesh->mTextureCoords[0][i].y;
-                    vertex.TexCoords = vec;
-
-                    vector.x = mesh->mTangents[i].x;
-                    vector.y = mesh->mTangents[i].y;
-                    vector.z = mesh->mTangents[i].z;
-                    vertex.Tangent = vector;
-
-                    vector.x = mesh->mBitangents[i].x;
-                    vector.y = mesh->mBitangents[i].y;
-                    vector.z = mesh->mBitangents[i].z;
-                    vertex.Bitangent = vector;
-                }else{
-                    vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            vertices.resize(mesh->mNumVertices);
+            if (jobs && mesh->mNumVertices > PARALLEL_VERTEX_GRAIN){
+                jobs->ParallelFor(mesh->mNumVertices, PARALLEL_VERTEX_GRAIN, [mesh, &vertices](unsigned int begin, unsigned int end){
+                    PERF_PHASE("vertex conversion");
+                    for (unsigned int i = begin; i < end; i++){
+                        vertices[i] = convertVertex(mesh, i);
+                    }
+                });
+            }else{
+                PERF_PHASE("vertex conversion");
+                for (unsigned int i = 0; i < mesh->mNumVertices; i++){
+                    vertices[i] = convertVertex(mesh, i);
                 }
-
-                vertices.push_back(vertex);
             }
 
+            indices.reserve(mesh->mNumFaces * 3);
             for (unsigned int i = 0; i < mesh->mNumFaces; i++){
                 aiFace face = mesh->mFaces[i];
                 for (unsigned int j = 0; j < face.mNumIndices; j++){
@@ -127,7 +433,45 @@ class Model{
                 textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
             }
 
-            return Mesh(vertices, indices, textures);
+            return Mesh(std::move(vertices), std::move(indices), std::move(textures), !deferred);
+        }
+
+        static Vertex convertVertex(aiMesh* mesh, unsigned int i){
+            Vertex vertex;
+
+            glm::vec3 vector;
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            
+            if (mesh->HasNormals()){
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+
+            if (mesh->mTextureCoords[0]){
+                glm::vec2 vec;
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }else{
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            }
+
+            return vertex;
         }
 
         std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName){
@@ -146,7 +490,19 @@ class Model{
 
                 if (!skip){
                     Texture texture;
-                    texture.id = TextureFromFile(str.C_Str(), this->directory);
+                    auto decoded = decodedTextures.find(str.C_Str());
+                    if (deferred){
+                        TextureData data = decoded != decodedTextures.end() ? decoded->second : DecodeTexture(str.C_Str(), this->directory);
+                        if (decoded != decodedTextures.end()) decodedTextures.erase(decoded);
+                        texture.id = pendingTextures.size();
+                        pendingTextures.push_back(std::make_pair(data, std::string(str.C_Str())));
+                    }else if (decoded != decodedTextures.end() && (decoded->second.data || decoded->second.baked)){
+                        ownedTextures.push_back(UploadTexture(decoded->second, str.C_Str(), jobs));
+                        decodedTextures.erase(decoded);
+                    }else{
+                        ownedTextures.push_back(TextureFromFile(str.C_Str(), this->directory));
+                    }
+                    if (!deferred) texture.id = ownedTextures.back().Id();
                     texture.path = str.C_Str();
                     texture.type = typeName;
                     textures.push_back(texture);
@@ -154,8 +510,11 @@ class Model{
                 }
             }
 
+            // Every padding slot of every mesh samples the same white texture.
+            if (!emptyTexture.Id() && !deferred) emptyTexture = EmptyTexture();
+
             Texture texture;
-            texture.id = EmptyTexture();
+            texture.id = deferred ? PENDING_EMPTY_TEXTURE : emptyTexture.Id();
             texture.path = "empty";
             texture.type = typeName;
 
@@ -167,51 +526,131 @@ class Model{
         }
 };
 
-unsigned int TextureFromFile(const char* path, const std::string &directory, bool gamma){
+GpuResource TextureFromFile(const char* path, const std::string &directory, bool gamma){
+    TextureData texture = DecodeTexture(path, directory);
+    return UploadTexture(texture, path);
+}
+
+TextureData DecodeTexture(const char* path, const std::string &directory, bool preferBaked){
+    PROFILE_ZONE("texture decode");
+    PERF_PHASE("texture decode");
     std::string filename = std::string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    TextureData texture{NULL, 0, 0, 0};
+    if (preferBaked && BakedTextureCurrent(filename)){
+        texture.baked = new Ktx2Texture();
+        bool loaded = texture.baked->Load(BakedTexturePath(filename));
+        if (loaded && texture.baked->Orientation != BAKED_TEXTURE_ORIENTATION)
+            std::cout << "TEXTURE::STALE_BAKE " << filename << " is stored upside down, rebake it with texture_bake" << std::endl;
+        if (loaded && texture.baked->Orientation == BAKED_TEXTURE_ORIENTATION){
+            texture.width = texture.baked->Width;
+            texture.height = texture.baked->Height;
+            return texture;
+        }
+        delete texture.baked;
+        texture.baked = NULL;
+    }
+    texture.data = stbi_load(filename.c_str(), &texture.width, &texture.height, &texture.nrComponents, 0);
+    return texture;
+}
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data){
+void FreeTextureData(TextureData &texture){
+    stbi_image_free(texture.data);
+    delete texture.baked;
+    texture.data = NULL;
+    texture.baked = NULL;
+}
+
+GpuResource UploadTexture(TextureData &texture, const char* path, JobSystem* jobs){
+    PROFILE_ZONE("texture upload");
+    if (texture.baked){
+        GpuResource resource = UploadBakedTexture(*texture.baked);
+        FreeTextureData(texture);
+        return resource;
+    }
+    // Streamed textures start with their coarse mips, the streamer uploads the rest on demand.
+    // Their chain is a box filter made here on the GL thread, Kaiser filtered mips come from texture_bake.
+    if (texture.data && TextureStreaming().Enabled()){
+        GpuResource resource = TextureStreaming().Add(texture.data, texture.width, texture.height, texture.nrComponents, jobs);
+        stbi_image_free(texture.data);
+        texture.data = NULL;
+        return resource;
+    }
+
+    unsigned int textureID;
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    size_t bytes = 0;
+    if (texture.data){
         GLenum format;
-        if (nrComponents == 1)
+        if (texture.nrComponents == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (texture.nrComponents == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (texture.nrComponents == 4)
             format = GL_RGBA;
         
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        GLState().BindTexture(0, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, texture.width, texture.height, 0, format, GL_UNSIGNED_BYTE, texture.data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        bytes = TextureBytes(texture.width, texture.height, texture.nrComponents, true);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
+        stbi_image_free(texture.data);
     }else{
         std::cout << "ERROR::TEXTURE::FAILED_TO_LOAD\nPath: " << path << std::endl;
-        stbi_image_free(data);
+        stbi_image_free(texture.data);
+    }
+    texture.data = NULL;
+    return GpuResource(GPU_TEXTURE, textureID, bytes, GPU_CATEGORY_TEXTURE);
+}
+
+// Baked levels go up as they are, the driver neither compresses nor builds mips.
+GpuResource UploadBakedTexture(Ktx2Texture &texture){
+    const Ktx2Format &format = *texture.Format();
+    GLint swizzle[4];
+    texture.GLSwizzle(swizzle);
+    if (TextureStreaming().Enabled()){
+        GpuResource resource = TextureStreaming().AddLevels(format, std::move(texture.Levels));
+        glTextureParameteriv(resource.Id(), GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        return resource;
+    }
+
+    unsigned int textureID;
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    glTextureStorage2D(textureID, texture.Levels.size(), format.InternalFormat, texture.Width, texture.Height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < texture.Levels.size(); level++){
+        const TextureLevel &image = texture.Levels[level];
+        if (format.Compressed)
+            glCompressedTextureSubImage2D(textureID, level, 0, 0, image.Width, image.Height, format.InternalFormat, image.Pixels.size(), image.Pixels.data());
+        else
+            glTextureSubImage2D(textureID, level, 0, 0, image.Width, image.Height, format.Format, GL_UNSIGNED_BYTE, image.Pixels.data());
     }
-    return textureID;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, texture.Levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteriv(textureID, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    return GpuResource(GPU_TEXTURE, textureID, texture.Bytes(), GPU_CATEGORY_TEXTURE);
 }
 
-unsigned int EmptyTexture(){
+GpuResource EmptyTexture(){
     unsigned int textureID;
-    glGenTextures(1, &textureID);
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState().BindTexture(0, textureID);
 
     GLubyte data[] = {255, 255, 255};
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 
-    return textureID;
+    return GpuResource(GPU_TEXTURE, textureID, TextureBytes(1, 1, 3, false), GPU_CATEGORY_TEXTURE);
 }
 
 #endif
\ No newline at end of file
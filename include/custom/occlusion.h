@@ -0,0 +1,308 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <custom/mesh.h>
+#include <custom/job_system.h>
+#include <custom/perf_counters.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+const unsigned int OCCLUSION_WIDTH = 256;
+const unsigned int OCCLUSION_HEIGHT = 128;
+const unsigned int OCCLUSION_TILE_SIZE = 32;
+
+struct OcclusionStats{
+    float RasterizeMs;
+    unsigned int OccluderTriangles;
+    unsigned int Tested;
+    unsigned int Culled;
+};
+
+// Low resolution software depth buffer. Occluders are transformed and binned
+// into screen tiles on the calling thread, tiles are rasterized in parallel,
+// and bounding boxes are then tested against the nearest occluder depth.
+class OcclusionCuller{
+    public:
+        OcclusionCuller(unsigned int width = OCCLUSION_WIDTH, unsigned int height = OCCLUSION_HEIGHT)
+            : stats{0.0f, 0, 0, 0}, tested(0), culled(0), totals{0.0f, 0, 0, 0}, frames(0){
+            tilesX = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+            tilesY = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+            this->width = tilesX * OCCLUSION_TILE_SIZE;
+            this->height = tilesY * OCCLUSION_TILE_SIZE;
+
+            depth.resize(this->width * this->height);
+            bins.resize(tilesX * tilesY);
+
+            BeginFrame(glm::mat4(1.0f));
+            frames = 0;
+        }
+
+        void BeginFrame(const glm::mat4 &viewProjection){
+            OcclusionStats last = GetStats();
+            totals.RasterizeMs += last.RasterizeMs;
+            totals.OccluderTriangles += last.OccluderTriangles;
+            totals.Tested += last.Tested;
+            totals.Culled += last.Culled;
+            frames++;
+
+            this->viewProjection = viewProjection;
+            std::fill(depth.begin(), depth.end(), 1.0f);
+            triangles.clear();
+            for (unsigned int i = 0; i < bins.size(); i++){
+                bins[i].clear();
+            }
+            stats = OcclusionStats{0.0f, 0, 0, 0};
+            tested = 0;
+            culled = 0;
+        }
+
+        void AddOccluder(const Mesh &mesh, const glm::mat4 &model){
+            if (mesh.vertices.empty()) return;
+            AddOccluder(&mesh.vertices[0].Position, sizeof(Vertex), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), model);
+        }
+
+        void AddOccluder(const glm::vec3* positions, unsigned int stride, unsigned int vertexCount,
+                         const unsigned int* indices, unsigned int indexCount, const glm::mat4 &model){
+            glm::mat4 mvp = viewProjection * model;
+
+            clip.resize(vertexCount);
+            const char* base = (const char*)positions;
+            for (unsigned int i = 0; i < vertexCount; i++){
+                const glm::vec3 &p = *(const glm::vec3*)(base + i * stride);
+                clip[i] = mvp * glm::vec4(p, 1.0f);
+            }
+
+            for (unsigned int i = 0; i + 2 < indexCount; i += 3){
+                binTriangle(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+            }
+        }
+
+        void Rasterize(JobSystem &jobs){
+            PROFILE_ZONE("occlusion rasterize");
+            auto start = std::chrono::steady_clock::now();
+
+            jobs.ParallelFor(bins.size(), 1, [this](unsigned int begin, unsigned int end){
+                PERF_PHASE("cull");
+                for (unsigned int tile = begin; tile < end; tile++){
+                    rasterizeTile(tile);
+                }
+            });
+
+            stats.RasterizeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        bool IsVisible(const AABB &bounds, const glm::mat4 &model){
+            return Test(bounds, model);
+        }
+
+        // Safe to call from several threads after Rasterize, the counters are atomic.
+        bool Test(const AABB &bounds, const glm::mat4 &model) const{
+            tested.fetch_add(1, std::memory_order_relaxed);
+            if (testBounds(bounds, viewProjection * model)) return true;
+            culled.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // The frame since BeginFrame.
+        OcclusionStats GetStats() const{
+            OcclusionStats current = stats;
+            current.Tested = tested.load(std::memory_order_relaxed);
+            current.Culled = culled.load(std::memory_order_relaxed);
+            return current;
+        }
+
+        // Averages of the frames finished since the last report.
+        void Report(){
+            if (!frames) return;
+            std::cout << std::fixed << std::setprecision(2);
+            std::cout << "OCCLUSION::CULLER rasterize " << totals.RasterizeMs / frames << " ms, " << totals.OccluderTriangles / frames << " occluder triangles, "
+                      << totals.Culled / frames << " of " << totals.Tested / frames << " meshes culled per frame over " << frames << " frames" << std::endl;
+            std::cout << std::defaultfloat;
+            totals = OcclusionStats{0.0f, 0, 0, 0};
+            frames = 0;
+        }
+
+        const std::vector<float>& GetDepthBuffer() const{ return depth; }
+        unsigned int GetWidth() const{ return width; }
+        unsigned int GetHeight() const{ return height; }
+
+    private:
+        struct Triangle{
+            float edgeA[3], edgeB[3], edgeC[3];
+            float zA, zB, zC;
+            int minX, minY, maxX, maxY;
+        };
+
+        unsigned int width, height;
+        unsigned int tilesX, tilesY;
+        glm::mat4 viewProjection;
+        OcclusionStats stats;
+        mutable std::atomic<unsigned int> tested, culled;
+        OcclusionStats totals;
+        unsigned int frames;
+
+        std::vector<float> depth;
+        std::vector<glm::vec4> clip;
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<unsigned int>> bins;
+
+        glm::vec3 toScreen(const glm::vec4 &c) const{
+            float invW = 1.0f / c.w;
+            return glm::vec3((c.x * invW * 0.5f + 0.5f) * width,
+                             (c.y * invW * 0.5f + 0.5f) * height,
+                             c.z * invW * 0.5f + 0.5f);
+        }
+
+        void binTriangle(const glm::vec4 &c0, const glm::vec4 &c1, const glm::vec4 &c2){
+            // Dropping a triangle only loses occlusion, so anything touching the near plane is skipped instead of clipped.
+            if (c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w) return;
+            if (c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f) return;
+
+            glm::vec3 v0 = toScreen(c0);
+            glm::vec3 v1 = toScreen(c1);
+            glm::vec3 v2 = toScreen(c2);
+
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if (std::fabs(area) < 1e-8f) return;
+            if (area < 0.0f){
+                std::swap(v1, v2);
+                area = -area;
+            }
+
+            int minX = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+            int minY = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+            int maxX = std::min((int)width - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+            int maxY = std::min((int)height - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+            if (minX > maxX || minY > maxY) return;
+
+            Triangle t;
+            setupEdge(t, 0, v1, v2);
+            setupEdge(t, 1, v2, v0);
+            setupEdge(t, 2, v0, v1);
+
+            float invArea = 1.0f / area;
+            t.zA = (t.edgeA[0] * v0.z + t.edgeA[1] * v1.z + t.edgeA[2] * v2.z) * invArea;
+            t.zB = (t.edgeB[0] * v0.z + t.edgeB[1] * v1.z + t.edgeB[2] * v2.z) * invArea;
+            t.zC = (t.edgeC[0] * v0.z + t.edgeC[1] * v1.z + t.edgeC[2] * v2.z) * invArea;
+            t.minX = minX, t.minY = minY, t.maxX = maxX, t.maxY = maxY;
+
+            unsigned int index = triangles.size();
+            triangles.push_back(t);
+            stats.OccluderTriangles++;
+
+            for (int ty = minY / (int)OCCLUSION_TILE_SIZE; ty <= maxY / (int)OCCLUSION_TILE_SIZE; ty++){
+                for (int tx = minX / (int)OCCLUSION_TILE_SIZE; tx <= maxX / (int)OCCLUSION_TILE_SIZE; tx++){
+                    bins[ty * tilesX + tx].push_back(index);
+                }
+            }
+        }
+
+        static void setupEdge(Triangle &t, int i, const glm::vec3 &a, const glm::vec3 &b){
+            t.edgeA[i] = a.y - b.y;
+            t.edgeB[i] = b.x - a.x;
+            t.edgeC[i] = a.x * b.y - a.y * b.x;
+        }
+
+        void rasterizeTile(unsigned int tile){
+            int tileMinX = (tile % tilesX) * OCCLUSION_TILE_SIZE;
+            int tileMinY = (tile / tilesX) * OCCLUSION_TILE_SIZE;
+            int tileMaxX = tileMinX + OCCLUSION_TILE_SIZE - 1;
+            int tileMaxY = tileMinY + OCCLUSION_TILE_SIZE - 1;
+
+            const std::vector<unsigned int> &bin = bins[tile];
+            for (unsigned int i = 0; i < bin.size(); i++){
+                const Triangle &t = triangles[bin[i]];
+                int minX = std::max(t.minX, tileMinX) & ~3;
+                int maxX = std::min(t.maxX, tileMaxX);
+                int minY = std::max(t.minY, tileMinY);
+                int maxY = std::min(t.maxY, tileMaxY);
+
+                for (int y = minY; y <= maxY; y++){
+                    float py = y + 0.5f;
+                    float row0 = t.edgeB[0] * py + t.edgeC[0];
+                    float row1 = t.edgeB[1] * py + t.edgeC[1];
+                    float row2 = t.edgeB[2] * py + t.edgeC[2];
+                    float rowZ = t.zB * py + t.zC;
+                    float* dst = &depth[y * width];
+#ifdef OCCLUSION_SSE
+                    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                    const __m128 zero = _mm_setzero_ps();
+                    for (int x = minX; x <= maxX; x += 4){
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                        __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), _mm_set1_ps(row0));
+                        __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), _mm_set1_ps(row1));
+                        __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), _mm_set1_ps(row2));
+                        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                        if (_mm_movemask_ps(inside) == 0) continue;
+
+                        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zA), px), _mm_set1_ps(rowZ));
+                        __m128 old = _mm_loadu_ps(dst + x);
+                        __m128 nearest = _mm_min_ps(old, z);
+                        _mm_storeu_ps(dst + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                    }
+#else
+                    for (int x = minX; x <= maxX; x++){
+                        float px = x + 0.5f;
+                        if (t.edgeA[0] * px + row0 < 0.0f || t.edgeA[1] * px + row1 < 0.0f || t.edgeA[2] * px + row2 < 0.0f) continue;
+                        dst[x] = std::min(dst[x], t.zA * px + rowZ);
+                    }
+#endif
+                }
+            }
+        }
+
+        bool testBounds(const AABB &bounds, const glm::mat4 &mvp) const{
+            float minX = (float)width, minY = (float)height, maxX = 0.0f, maxY = 0.0f;
+            float minZ = 1.0f;
+
+            for (int i = 0; i < 8; i++){
+                glm::vec4 corner((i & 1) ? bounds.Max.x : bounds.Min.x,
+                                 (i & 2) ? bounds.Max.y : bounds.Min.y,
+                                 (i & 4) ? bounds.Max.z : bounds.Min.z, 1.0f);
+                glm::vec4 c = mvp * corner;
+                if (c.w <= 0.0f || c.z < -c.w) return true;
+
+                glm::vec3 s = toScreen(c);
+                minX = std::min(minX, s.x), maxX = std::max(maxX, s.x);
+                minY = std::min(minY, s.y), maxY = std::max(maxY, s.y);
+                minZ = std::min(minZ, s.z);
+            }
+
+            if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) return false;
+
+            int x0 = std::max(0, (int)std::floor(minX)) & ~3;
+            int y0 = std::max(0, (int)std::floor(minY));
+            int x1 = std::min((int)width - 1, (int)std::ceil(maxX));
+            int y1 = std::min((int)height - 1, (int)std::ceil(maxY));
+
+            for (int y = y0; y <= y1; y++){
+                const float* row = &depth[y * width];
+#ifdef OCCLUSION_SSE
+                __m128 z = _mm_set1_ps(minZ);
+                for (int x = x0; x <= x1; x += 4){
+                    if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z))) return true;
+                }
+#else
+                for (int x = x0; x <= x1; x++){
+                    if (row[x] >= minZ) return true;
+                }
+#endif
+            }
+            return false;
+        }
+};
+
+#endif
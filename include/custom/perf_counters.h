@@ -0,0 +1,258 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+enum PerfCounter{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_TASK_CLOCK,
+    PERF_PAGE_FAULTS,
+    PERF_COUNTER_COUNT
+};
+
+const char* const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT] = {"cycles", "instr", "l1d_miss", "llc_miss", "br_miss", "dtlb_miss", "cpu_ms", "faults"};
+const unsigned int PERF_MAX_PHASES = 32;
+
+struct PerfReading{
+    unsigned long long Values[PERF_COUNTER_COUNT];
+};
+
+// The counters of the calling thread, user space only so it works with the
+// default perf_event_paranoid of 2. Every counter is its own event with
+// enabled/running times, so the kernel can multiplex them when there are
+// more than the PMU has slots and the values get scaled back up. Counters
+// that cannot be opened (no PMU in a VM, a locked down kernel, not Linux)
+// are left out; the software ones (CPU time, page faults) nearly always work.
+class PerfCounters{
+    public:
+        PerfCounters(){
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++) fds[i] = -1;
+            error = 0;
+#ifdef __linux__
+            const unsigned long long cacheMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            open(PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            open(PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            open(PERF_L1D_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cacheMiss);
+            open(PERF_LLC_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cacheMiss);
+            open(PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+            open(PERF_DTLB_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cacheMiss);
+            open(PERF_TASK_CLOCK, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+            open(PERF_PAGE_FAULTS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#endif
+        }
+
+        ~PerfCounters(){
+#ifdef __linux__
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++){
+                if (fds[i] >= 0) close(fds[i]);
+            }
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        bool Available(unsigned int counter) const{
+            return fds[counter] >= 0;
+        }
+
+        // errno of the first counter that failed to open, 0 if all opened.
+        int Error() const{
+            return error;
+        }
+
+        PerfReading Read() const{
+            PerfReading reading;
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++){
+                reading.Values[i] = 0;
+#ifdef __linux__
+                unsigned long long values[3];
+                if (fds[i] < 0 || ::read(fds[i], values, sizeof(values)) != sizeof(values)) continue;
+                // value * enabled / running undoes the multiplexing.
+                if (values[2] > 0 && values[2] < values[1]) reading.Values[i] = (unsigned long long)((double)values[0] * values[1] / values[2]);
+                else reading.Values[i] = values[0];
+#endif
+            }
+            return reading;
+        }
+
+        // Counters are opened on first use per thread, which costs a few syscalls once.
+        static PerfCounters& Thread(){
+            static thread_local PerfCounters counters;
+            return counters;
+        }
+
+    private:
+        int fds[PERF_COUNTER_COUNT];
+        int error;
+
+#ifdef __linux__
+        void open(unsigned int counter, unsigned int type, unsigned long long config){
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = type;
+            attributes.config = config;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[counter] = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+            if (fds[counter] < 0 && !error) error = errno;
+        }
+#endif
+};
+
+struct PerfPhaseStats{
+    const char* Name;
+    unsigned long long Calls;
+    double WallMs;
+    unsigned long long Values[PERF_COUNTER_COUNT];
+};
+
+// Counter totals per named phase (import, vertex conversion, texture decode,
+// cull, submit), summed over every thread that ran it. Phases take string
+// literals and are looked up by pointer first, so a scope costs the counter
+// reads and a short locked search.
+class PerfPhases{
+    public:
+        PerfPhases(){
+            phases.reserve(PERF_MAX_PHASES);
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++) available[i] = false;
+            error = 0;
+        }
+
+        PerfPhases(const PerfPhases&) = delete;
+        PerfPhases& operator=(const PerfPhases&) = delete;
+
+        void Add(const char* name, double wallMs, const PerfReading &begin, const PerfReading &end, const PerfCounters &counters){
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++) available[i] = available[i] || counters.Available(i);
+            if (!error) error = counters.Error();
+
+            PerfPhaseStats* phase = find(name);
+            if (!phase){
+                if (phases.size() >= PERF_MAX_PHASES) return;
+                phases.push_back(PerfPhaseStats{name, 0, 0.0, {}});
+                phase = &phases.back();
+            }
+            phase->Calls++;
+            phase->WallMs += wallMs;
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++){
+                if (end.Values[i] > begin.Values[i]) phase->Values[i] += end.Values[i] - begin.Values[i];
+            }
+        }
+
+        std::vector<PerfPhaseStats> Stats(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return phases;
+        }
+
+        void Clear(){
+            std::lock_guard<std::mutex> lock(mutex);
+            phases.clear();
+        }
+
+        // Counters that could not be opened are printed as "-", cpu_ms is the phase's CPU time over all threads.
+        void Report(){
+            std::lock_guard<std::mutex> lock(mutex);
+            if (phases.empty()) return;
+
+            std::cout << "PERF::COUNTERS";
+            if (error) std::cout << " (some unavailable: " << std::strerror(error) << ")";
+            std::cout << std::endl;
+            std::cout << std::setw(20) << std::left << "phase" << std::right << std::setw(8) << "calls" << std::setw(12) << "wall_ms";
+            for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++) std::cout << std::setw(14) << PERF_COUNTER_NAMES[i];
+            std::cout << std::setw(8) << "ipc" << std::endl;
+
+            std::cout << std::fixed << std::setprecision(3);
+            for (unsigned int p = 0; p < phases.size(); p++){
+                const PerfPhaseStats &phase = phases[p];
+                std::cout << std::setw(20) << std::left << phase.Name << std::right << std::setw(8) << phase.Calls << std::setw(12) << phase.WallMs;
+                for (unsigned int i = 0; i < PERF_COUNTER_COUNT; i++){
+                    if (!available[i]) std::cout << std::setw(14) << "-";
+                    else if (i == PERF_TASK_CLOCK) std::cout << std::setw(14) << phase.Values[i] / 1000000.0;
+                    else std::cout << std::setw(14) << phase.Values[i];
+                }
+                if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS] && phase.Values[PERF_CYCLES]){
+                    std::cout << std::setw(8) << std::setprecision(2) << (double)phase.Values[PERF_INSTRUCTIONS] / phase.Values[PERF_CYCLES] << std::setprecision(3);
+                }else{
+                    std::cout << std::setw(8) << "-";
+                }
+                std::cout << std::endl;
+            }
+            std::cout << std::defaultfloat;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<PerfPhaseStats> phases;
+        bool available[PERF_COUNTER_COUNT];
+        int error;
+
+        PerfPhaseStats* find(const char* name){
+            for (unsigned int i = 0; i < phases.size(); i++){
+                if (phases[i].Name == name || std::strcmp(phases[i].Name, name) == 0) return &phases[i];
+            }
+            return NULL;
+        }
+};
+
+inline PerfPhases& PerfPhaseTable(){
+    static PerfPhases table;
+    return table;
+}
+
+class PerfPhase{
+    public:
+        PerfPhase(const char* name) : name(name), counters(PerfCounters::Thread()){
+            start = std::chrono::steady_clock::now();
+            begin = counters.Read();
+        }
+
+        ~PerfPhase(){
+            PerfReading end = counters.Read();
+            double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            PerfPhaseTable().Add(name, wallMs, begin, end, counters);
+        }
+
+        PerfPhase(const PerfPhase&) = delete;
+        PerfPhase& operator=(const PerfPhase&) = delete;
+
+    private:
+        const char* name;
+        PerfCounters &counters;
+        PerfReading begin;
+        std::chrono::steady_clock::time_point start;
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+
+// Like the profiler zones, phases only exist in builds with PERF_COUNTERS.
+#ifdef PERF_COUNTERS
+#define PERF_PHASE(name) PerfPhase PERF_CONCAT(perfPhase, __LINE__)(name)
+#else
+#define PERF_PHASE(name)
+#endif
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILE_RDTSC
+#endif
+
+const unsigned int PROFILE_RING_EVENTS = 1 << 16;
+
+enum ProfileEventType{
+    PROFILE_BEGIN,
+    PROFILE_END,
+    PROFILE_COMPLETE
+};
+
+// Names have to outlive the export, zones only take string literals.
+struct ProfileEvent{
+    const char* Name;
+    unsigned long long Ticks;
+    unsigned int Type;
+};
+
+// Single producer, single consumer: the owning thread pushes, Profiler::Collect()
+// drains. A full ring drops events instead of blocking the hot path.
+class ProfileRing{
+    public:
+        unsigned int ThreadId;
+        const char* ThreadName;
+        std::atomic<unsigned long long> Dropped;
+
+        ProfileRing(unsigned int threadId) : ThreadId(threadId), ThreadName(NULL), Dropped(0), head(0), tail(0){
+            events.reset(new ProfileEvent[PROFILE_RING_EVENTS]);
+        }
+
+        void Push(const char* name, unsigned long long ticks, unsigned int type){
+            size_t write = head.load(std::memory_order_relaxed);
+            if (write - tail.load(std::memory_order_acquire) >= PROFILE_RING_EVENTS){
+                Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events[write & (PROFILE_RING_EVENTS - 1)] = ProfileEvent{name, ticks, type};
+            head.store(write + 1, std::memory_order_release);
+        }
+
+        template<typename Function>
+        void Drain(const Function &function){
+            size_t read = tail.load(std::memory_order_relaxed);
+            size_t end = head.load(std::memory_order_acquire);
+            for (; read < end; read++){
+                function(events[read & (PROFILE_RING_EVENTS - 1)]);
+            }
+            tail.store(read, std::memory_order_release);
+        }
+
+    private:
+        std::unique_ptr<ProfileEvent[]> events;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+};
+
+struct ProfileTraceEvent{
+    const char* Name;
+    unsigned int ThreadId;
+    unsigned int Type;
+    double Microseconds;
+    double DurationMicroseconds;
+};
+
+// Collects the rings of every thread that recorded a zone and writes them as
+// Chrome trace JSON, which chrome://tracing and ui.perfetto.dev both load.
+// Zones store raw TSC ticks where available, converted to microseconds on
+// collection with a tick rate measured against steady_clock.
+class Profiler{
+    public:
+        static bool Enabled(){
+#ifdef PROFILING
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        static unsigned long long Ticks(){
+#ifdef PROFILE_RDTSC
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        static ProfileRing& ThreadRing(){
+            static thread_local ProfileRing* ring = NULL;
+            if (!ring) ring = state().AddRing();
+            return *ring;
+        }
+
+        static void SetThreadName(const char* name){
+            ThreadRing().ThreadName = name;
+        }
+
+        static void Begin(const char* name){
+            ThreadRing().Push(name, Ticks(), PROFILE_BEGIN);
+        }
+
+        static void End(const char* name){
+            ThreadRing().Push(name, Ticks(), PROFILE_END);
+        }
+
+        // Moves everything recorded so far out of the rings, call it often enough that they do not fill up.
+        static void Collect(){
+            State &profiler = state();
+            std::lock_guard<std::mutex> lock(profiler.Mutex);
+            profiler.Calibrate();
+            for (unsigned int i = 0; i < profiler.Rings.size(); i++){
+                ProfileRing &ring = *profiler.Rings[i];
+                ring.Drain([&](const ProfileEvent &event){
+                    profiler.Events.push_back(ProfileTraceEvent{event.Name, ring.ThreadId, event.Type, profiler.Microseconds(event.Ticks), 0.0});
+                });
+            }
+        }
+
+        // Converts a steady_clock reading into the trace timeline, for events that were timed elsewhere.
+        static double SteadyMicroseconds(std::chrono::steady_clock::time_point time){
+            return std::chrono::duration<double, std::micro>(time - state().StartTime).count();
+        }
+
+        // Adds a finished span on its own track, e.g. GPU time read back from queries.
+        static void AddSpan(const char* track, unsigned int trackId, const char* name, double beginMicroseconds, double endMicroseconds){
+            State &profiler = state();
+            std::lock_guard<std::mutex> lock(profiler.Mutex);
+            if (std::find(profiler.Tracks.begin(), profiler.Tracks.end(), std::make_pair(trackId, track)) == profiler.Tracks.end()){
+                profiler.Tracks.push_back(std::make_pair(trackId, track));
+            }
+            profiler.Events.push_back(ProfileTraceEvent{name, trackId, PROFILE_COMPLETE, beginMicroseconds, endMicroseconds - beginMicroseconds});
+        }
+
+        static unsigned long long Dropped(){
+            State &profiler = state();
+            std::lock_guard<std::mutex> lock(profiler.Mutex);
+            unsigned long long dropped = 0;
+            for (unsigned int i = 0; i < profiler.Rings.size(); i++){
+                dropped += profiler.Rings[i]->Dropped.load(std::memory_order_relaxed);
+            }
+            return dropped;
+        }
+
+        static bool WriteChromeTrace(const std::string &path){
+            Collect();
+            State &profiler = state();
+            std::lock_guard<std::mutex> lock(profiler.Mutex);
+
+            std::ofstream file(path);
+            if (!file){
+                std::cout << "ERROR::PROFILER::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+
+            // Events of one thread are already in order, a stable sort keeps begin/end pairs of equal timestamps intact.
+            std::stable_sort(profiler.Events.begin(), profiler.Events.end(), [](const ProfileTraceEvent &a, const ProfileTraceEvent &b){
+                return a.Microseconds < b.Microseconds;
+            });
+
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            for (unsigned int i = 0; i < profiler.Rings.size(); i++){
+                const char* name = profiler.Rings[i]->ThreadName;
+                std::string thread = name ? name : "thread " + std::to_string(profiler.Rings[i]->ThreadId);
+                writeThreadName(file, first, profiler.Rings[i]->ThreadId, thread.c_str());
+            }
+            for (unsigned int i = 0; i < profiler.Tracks.size(); i++){
+                writeThreadName(file, first, profiler.Tracks[i].first, profiler.Tracks[i].second);
+            }
+
+            char line[256];
+            for (unsigned int i = 0; i < profiler.Events.size(); i++){
+                const ProfileTraceEvent &event = profiler.Events[i];
+                if (event.Type == PROFILE_COMPLETE){
+                    std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                                  first ? "" : ",\n", event.Name, event.Microseconds, event.DurationMicroseconds, event.ThreadId);
+                }else{
+                    std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                                  first ? "" : ",\n", event.Name, event.Type == PROFILE_BEGIN ? "B" : "E", event.Microseconds, event.ThreadId);
+                }
+                file << line;
+                first = false;
+            }
+            file << "\n]}\n";
+
+            std::cout << "PROFILER::TRACE " << profiler.Events.size() << " events written to " << path;
+            unsigned long long dropped = 0;
+            for (unsigned int i = 0; i < profiler.Rings.size(); i++) dropped += profiler.Rings[i]->Dropped.load(std::memory_order_relaxed);
+            if (dropped) std::cout << ", " << dropped << " dropped";
+            std::cout << std::endl;
+            return true;
+        }
+
+        static void Clear(){
+            Collect();
+            State &profiler = state();
+            std::lock_guard<std::mutex> lock(profiler.Mutex);
+            profiler.Events.clear();
+            profiler.Tracks.clear();
+        }
+
+    private:
+        struct State{
+            std::mutex Mutex;
+            std::vector<std::unique_ptr<ProfileRing>> Rings;
+            std::vector<ProfileTraceEvent> Events;
+            std::vector<std::pair<unsigned int, const char*>> Tracks;
+
+            std::chrono::steady_clock::time_point StartTime;
+            unsigned long long StartTicks;
+            double TicksPerMicrosecond;
+
+            State(){
+                StartTime = std::chrono::steady_clock::now();
+                StartTicks = Ticks();
+                TicksPerMicrosecond = 0.0;
+            }
+
+            ProfileRing* AddRing(){
+                std::lock_guard<std::mutex> lock(Mutex);
+                Rings.push_back(std::unique_ptr<ProfileRing>(new ProfileRing(Rings.size() + 1)));
+                return Rings.back().get();
+            }
+
+            // The tick rate is measured over the whole run so far, which gets more precise the longer it runs.
+            void Calibrate(){
+#ifdef PROFILE_RDTSC
+                double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - StartTime).count();
+                if (elapsed > 0.0) TicksPerMicrosecond = (double)(Ticks() - StartTicks) / elapsed;
+#endif
+            }
+
+            double Microseconds(unsigned long long ticks) const{
+#ifdef PROFILE_RDTSC
+                if (TicksPerMicrosecond == 0.0) return 0.0;
+                return ((double)ticks - (double)StartTicks) / TicksPerMicrosecond;
+#else
+                return ((double)ticks - (double)StartTicks) / 1000.0;
+#endif
+            }
+        };
+
+        static State& state(){
+            static State profiler;
+            return profiler;
+        }
+
+        static void writeThreadName(std::ofstream &file, bool &first, unsigned int id, const char* name){
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+        }
+};
+
+class ProfileZone{
+    public:
+        ProfileZone(const char* name) : name(name){
+            Profiler::Begin(name);
+        }
+
+        ~ProfileZone(){
+            Profiler::End(name);
+        }
+
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+
+    private:
+        const char* name;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Without PROFILING the zones and everything they would record vanish from the build.
+#ifdef PROFILING
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#define PROFILE_COLLECT() Profiler::Collect()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_COLLECT()
+#endif
+
+#endif
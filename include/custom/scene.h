@@ -0,0 +1,665 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/mesh.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SCENE_MMAP
+#endif
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+const unsigned int SCENE_MAX_POINT_LIGHTS = 32;
+const unsigned int SCENE_MAX_SPOT_LIGHTS = 32;
+const unsigned int SCENE_MIN_DETAIL = 4;
+const unsigned int SCENE_MAX_DETAIL = 256;
+
+enum SceneShape{
+    SHAPE_SPHERE,
+    SHAPE_BOX,
+    SHAPE_TORUS,
+    SHAPE_COUNT
+};
+
+const char* const SCENE_SHAPE_NAMES[SHAPE_COUNT] = {"sphere", "box", "torus"};
+
+enum SceneLightType{
+    LIGHT_POINT,
+    LIGHT_SPOT,
+    LIGHT_TYPE_COUNT
+};
+
+// A checker of two colors, Checker squares per texture side. Specular is the
+// grey level of the specular map.
+struct SceneMaterial{
+    glm::vec3 ColorA;
+    glm::vec3 ColorB;
+    unsigned int Checker;
+    float Specular;
+};
+
+// Procedural meshes are stored as their parameters and built when the scene
+// is loaded, Detail is the tessellation (segments around a sphere, quads per box face side).
+struct SceneMesh{
+    unsigned int Shape;
+    unsigned int Detail;
+    unsigned int Material;
+};
+
+// Object indexes the models first and the procedural meshes after them.
+struct SceneInstance{
+    unsigned int Object;
+    glm::vec3 Position;
+    glm::quat Rotation;
+    float Scale;
+};
+
+// A white light has the default diffuse and specular of the shader's light setters.
+struct SceneLight{
+    unsigned int Type;
+    glm::vec3 Position;
+    glm::vec3 Direction;
+    glm::vec3 Color;
+};
+
+// Binary scenes are a header followed by tables, every table starting on a
+// SCENE_BINARY_ALIGNMENT boundary so the file can be mapped and the tables
+// used in place (or handed to glBufferData) without parsing. Instances are
+// stored as one array per component. Everything is little endian.
+const char SCENE_BINARY_MAGIC[8] = {'O', 'G', 'L', 'S', 'C', 'E', 'N', 'E'};
+const uint32_t SCENE_BINARY_VERSION = 1;
+const uint64_t SCENE_BINARY_ALIGNMENT = 64;
+
+enum SceneTable{
+    TABLE_STRINGS,
+    TABLE_MODELS,
+    TABLE_MATERIALS,
+    TABLE_MESHES,
+    TABLE_LIGHTS,
+    TABLE_INSTANCE_OBJECTS,
+    TABLE_POSITION_X,
+    TABLE_POSITION_Y,
+    TABLE_POSITION_Z,
+    TABLE_ROTATION_W,
+    TABLE_ROTATION_X,
+    TABLE_ROTATION_Y,
+    TABLE_ROTATION_Z,
+    TABLE_SCALE,
+    TABLE_COUNT
+};
+
+// A model path, a range of the string table.
+struct SceneString{
+    uint32_t Offset;
+    uint32_t Length;
+};
+
+struct SceneTableEntry{
+    uint64_t Offset;
+    uint64_t Count;
+    uint32_t Stride;
+    uint32_t Reserved;
+};
+
+struct SceneBinaryHeader{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t TableCount;
+    uint64_t FileSize;
+    SceneTableEntry Tables[TABLE_COUNT];
+};
+
+static_assert(sizeof(SceneMaterial) == 32 && sizeof(SceneMesh) == 12 && sizeof(SceneLight) == 40, "scene records are stored as they are in memory");
+
+inline uint32_t SceneTableStride(unsigned int table){
+    switch (table){
+        case TABLE_STRINGS: return 1;
+        case TABLE_MODELS: return sizeof(SceneString);
+        case TABLE_MATERIALS: return sizeof(SceneMaterial);
+        case TABLE_MESHES: return sizeof(SceneMesh);
+        case TABLE_LIGHTS: return sizeof(SceneLight);
+        default: return 4;
+    }
+}
+
+// A read only view of a binary scene file, mapped where the platform allows
+// and read into memory otherwise. Open() checks that every table lies inside
+// the file, so the accessors need no further bounds checks.
+class MappedScene{
+    public:
+        MappedScene() : data(NULL), size(0), mapped(false){}
+
+        ~MappedScene(){
+            close();
+        }
+
+        MappedScene(const MappedScene&) = delete;
+        MappedScene& operator=(const MappedScene&) = delete;
+
+        static bool IsBinary(const std::string &path){
+            char magic[sizeof(SCENE_BINARY_MAGIC)] = {};
+            std::ifstream file(path, std::ios::binary);
+            file.read(magic, sizeof(magic));
+            return file && std::memcmp(magic, SCENE_BINARY_MAGIC, sizeof(magic)) == 0;
+        }
+
+        bool Open(const std::string &path){
+            close();
+#ifdef SCENE_MMAP
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0){
+                void* view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (view != MAP_FAILED){
+                    data = (const unsigned char*)view;
+                    size = info.st_size;
+                    mapped = true;
+                }
+            }
+            if (fd >= 0) ::close(fd);
+#else
+            std::ifstream file(path, std::ios::binary);
+            if (file){
+                file.seekg(0, std::ios::end);
+                buffer.resize((size_t)file.tellg());
+                file.seekg(0);
+                file.read((char*)buffer.data(), buffer.size());
+                if (file){
+                    data = buffer.data();
+                    size = buffer.size();
+                }
+            }
+#endif
+            if (!data){
+                std::cout << "ERROR::SCENE::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+            if (!validate()){
+                std::cout << "ERROR::SCENE::INVALID_BINARY_SCENE " << path << std::endl;
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        size_t Size() const{ return size; }
+
+        uint64_t Count(unsigned int table) const{
+            return header()->Tables[table].Count;
+        }
+
+        template<typename T>
+        const T* Table(unsigned int table) const{
+            return (const T*)(data + header()->Tables[table].Offset);
+        }
+
+        std::string Model(unsigned int model) const{
+            const SceneString &path = Table<SceneString>(TABLE_MODELS)[model];
+            return std::string(Table<char>(TABLE_STRINGS) + path.Offset, path.Length);
+        }
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        bool mapped;
+        std::vector<unsigned char> buffer;
+
+        const SceneBinaryHeader* header() const{
+            return (const SceneBinaryHeader*)data;
+        }
+
+        bool validate() const{
+            if (size < sizeof(SceneBinaryHeader)) return false;
+            const SceneBinaryHeader* h = header();
+            if (std::memcmp(h->Magic, SCENE_BINARY_MAGIC, sizeof(SCENE_BINARY_MAGIC)) != 0 || h->Version != SCENE_BINARY_VERSION
+                || h->TableCount != TABLE_COUNT || h->FileSize != size) return false;
+
+            for (unsigned int i = 0; i < TABLE_COUNT; i++){
+                const SceneTableEntry &table = h->Tables[i];
+                if (table.Stride != SceneTableStride(i) || table.Offset % SCENE_BINARY_ALIGNMENT) return false;
+                if (table.Offset > size || table.Count > (size - table.Offset) / table.Stride) return false;
+            }
+            // Every per instance array has one entry per instance, and the model paths stay inside the string table.
+            for (unsigned int i = TABLE_INSTANCE_OBJECTS + 1; i < TABLE_COUNT; i++){
+                if (h->Tables[i].Count != h->Tables[TABLE_INSTANCE_OBJECTS].Count) return false;
+            }
+            const SceneString* models = Table<SceneString>(TABLE_MODELS);
+            for (uint64_t i = 0; i < Count(TABLE_MODELS); i++){
+                if ((uint64_t)models[i].Offset + models[i].Length > Count(TABLE_STRINGS)) return false;
+            }
+            return true;
+        }
+
+        void close(){
+#ifdef SCENE_MMAP
+            if (mapped) munmap((void*)data, size);
+#endif
+            std::vector<unsigned char>().swap(buffer);
+            data = NULL;
+            size = 0;
+            mapped = false;
+        }
+};
+
+inline glm::mat4 InstanceTransform(const SceneInstance &instance){
+    glm::mat4 transform = glm::mat4_cast(instance.Rotation) * instance.Scale;
+    transform[3] = glm::vec4(instance.Position, 1.0f);
+    return transform;
+}
+
+// Everything a scene is made of, without any GL objects. Scene files are
+// either binary (see MappedScene, written by SaveBinary) or text, one entry
+// per line and # starts a comment:
+//   model <path>
+//   material <a.r a.g a.b> <b.r b.g b.b> <checker> <specular>
+//   mesh <sphere|box|torus> <detail> <material>
+//   instance <object> <position.x y z> <rotation.w x y z> <scale>
+//   point <position.x y z> <color.r g b>
+//   spot <position.x y z> <direction.x y z> <color.r g b>
+// Instances are drawn in file order.
+class SceneDescription{
+    public:
+        std::vector<std::string> Models;
+        std::vector<SceneMaterial> Materials;
+        std::vector<SceneMesh> Meshes;
+        std::vector<SceneInstance> Instances;
+        std::vector<SceneLight> Lights;
+
+        unsigned int ObjectCount() const{
+            return Models.size() + Meshes.size();
+        }
+
+        // A single model at the origin, what --scene did before there were scene files.
+        static SceneDescription FromModel(const std::string &path){
+            SceneDescription scene;
+            scene.Models.push_back(path);
+            scene.Instances.push_back(SceneInstance{0, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f});
+            return scene;
+        }
+
+        bool Load(const std::string &path){
+            if (MappedScene::IsBinary(path)) return loadBinary(path);
+
+            std::ifstream file(path);
+            if (!file){
+                std::cout << "ERROR::SCENE::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+
+            *this = SceneDescription();
+            std::string line;
+            for (unsigned int number = 1; std::getline(file, line); number++){
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+                std::istringstream values(line);
+                std::string type;
+                values >> type;
+                if (!parse(type, values)){
+                    std::cout << "ERROR::SCENE::INVALID_ENTRY " << path << ":" << number << std::endl;
+                    return false;
+                }
+            }
+            return validate(path);
+        }
+
+        bool Save(const std::string &path) const{
+            std::ofstream file(path);
+            if (!file){
+                std::cout << "ERROR::SCENE::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+
+            file << std::setprecision(9);
+            file << "# " << Models.size() << " models, " << Meshes.size() << " meshes, " << Materials.size() << " materials, "
+                 << Instances.size() << " instances, " << Lights.size() << " lights\n";
+            for (unsigned int i = 0; i < Models.size(); i++){
+                file << "model " << Models[i] << "\n";
+            }
+            for (unsigned int i = 0; i < Materials.size(); i++){
+                const SceneMaterial &m = Materials[i];
+                file << "material " << m.ColorA.r << " " << m.ColorA.g << " " << m.ColorA.b << " " << m.ColorB.r << " " << m.ColorB.g << " "
+                     << m.ColorB.b << " " << m.Checker << " " << m.Specular << "\n";
+            }
+            for (unsigned int i = 0; i < Meshes.size(); i++){
+                file << "mesh " << SCENE_SHAPE_NAMES[Meshes[i].Shape] << " " << Meshes[i].Detail << " " << Meshes[i].Material << "\n";
+            }
+            for (unsigned int i = 0; i < Instances.size(); i++){
+                const SceneInstance &n = Instances[i];
+                file << "instance " << n.Object << " " << n.Position.x << " " << n.Position.y << " " << n.Position.z << " " << n.Rotation.w << " "
+                     << n.Rotation.x << " " << n.Rotation.y << " " << n.Rotation.z << " " << n.Scale << "\n";
+            }
+            for (unsigned int i = 0; i < Lights.size(); i++){
+                const SceneLight &l = Lights[i];
+                file << (l.Type == LIGHT_POINT ? "point " : "spot ") << l.Position.x << " " << l.Position.y << " " << l.Position.z << " ";
+                if (l.Type == LIGHT_SPOT) file << l.Direction.x << " " << l.Direction.y << " " << l.Direction.z << " ";
+                file << l.Color.r << " " << l.Color.g << " " << l.Color.b << "\n";
+            }
+            return (bool)file;
+        }
+
+        bool SaveBinary(const std::string &path) const{
+            std::ofstream file(path, std::ios::binary);
+            if (!file){
+                std::cout << "ERROR::SCENE::FAILED_TO_OPEN\nPath: " << path << std::endl;
+                return false;
+            }
+
+            std::string strings;
+            std::vector<SceneString> models;
+            for (unsigned int i = 0; i < Models.size(); i++){
+                models.push_back(SceneString{(uint32_t)strings.size(), (uint32_t)Models[i].size()});
+                strings += Models[i];
+            }
+
+            // One column per instance component.
+            size_t count = Instances.size();
+            std::vector<uint32_t> objects(count);
+            std::vector<float> columns[TABLE_COUNT - TABLE_POSITION_X];
+            for (unsigned int c = 0; c < TABLE_COUNT - TABLE_POSITION_X; c++) columns[c].resize(count);
+            for (size_t i = 0; i < count; i++){
+                const SceneInstance &n = Instances[i];
+                const float values[TABLE_COUNT - TABLE_POSITION_X] = {n.Position.x, n.Position.y, n.Position.z, n.Rotation.w,
+                                                                      n.Rotation.x, n.Rotation.y, n.Rotation.z, n.Scale};
+                objects[i] = n.Object;
+                for (unsigned int c = 0; c < TABLE_COUNT - TABLE_POSITION_X; c++) columns[c][i] = values[c];
+            }
+
+            const void* tables[TABLE_COUNT] = {strings.data(), models.data(), Materials.data(), Meshes.data(), Lights.data(), objects.data()};
+            uint64_t counts[TABLE_COUNT] = {strings.size(), models.size(), Materials.size(), Meshes.size(), Lights.size(), count};
+            for (unsigned int c = 0; c < TABLE_COUNT - TABLE_POSITION_X; c++){
+                tables[TABLE_POSITION_X + c] = columns[c].data();
+                counts[TABLE_POSITION_X + c] = count;
+            }
+
+            SceneBinaryHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.Magic, SCENE_BINARY_MAGIC, sizeof(SCENE_BINARY_MAGIC));
+            header.Version = SCENE_BINARY_VERSION;
+            header.TableCount = TABLE_COUNT;
+            uint64_t offset = sizeof(header);
+            for (unsigned int i = 0; i < TABLE_COUNT; i++){
+                offset = (offset + SCENE_BINARY_ALIGNMENT - 1) & ~(SCENE_BINARY_ALIGNMENT - 1);
+                header.Tables[i] = SceneTableEntry{offset, counts[i], SceneTableStride(i), 0};
+                offset += counts[i] * SceneTableStride(i);
+            }
+            header.FileSize = offset;
+
+            const char padding[SCENE_BINARY_ALIGNMENT] = {};
+            file.write((const char*)&header, sizeof(header));
+            uint64_t written = sizeof(header);
+            for (unsigned int i = 0; i < TABLE_COUNT; i++){
+                file.write(padding, header.Tables[i].Offset - written);
+                file.write((const char*)tables[i], counts[i] * SceneTableStride(i));
+                written = header.Tables[i].Offset + counts[i] * SceneTableStride(i);
+            }
+            return (bool)file;
+        }
+
+    private:
+        // Each table is copied in one go, the instances are gathered from their columns
+        // into storage sized once, nothing is allocated per instance.
+        bool loadBinary(const std::string &path){
+            MappedScene mapped;
+            if (!mapped.Open(path)) return false;
+
+            *this = SceneDescription();
+            Models.reserve(mapped.Count(TABLE_MODELS));
+            for (unsigned int i = 0; i < mapped.Count(TABLE_MODELS); i++){
+                Models.push_back(mapped.Model(i));
+            }
+            Materials.assign(mapped.Table<SceneMaterial>(TABLE_MATERIALS), mapped.Table<SceneMaterial>(TABLE_MATERIALS) + mapped.Count(TABLE_MATERIALS));
+            Meshes.assign(mapped.Table<SceneMesh>(TABLE_MESHES), mapped.Table<SceneMesh>(TABLE_MESHES) + mapped.Count(TABLE_MESHES));
+            Lights.assign(mapped.Table<SceneLight>(TABLE_LIGHTS), mapped.Table<SceneLight>(TABLE_LIGHTS) + mapped.Count(TABLE_LIGHTS));
+            for (unsigned int i = 0; i < Meshes.size(); i++){
+                if (Meshes[i].Shape >= SHAPE_COUNT) Meshes[i].Shape = SHAPE_SPHERE;
+            }
+
+            size_t count = mapped.Count(TABLE_INSTANCE_OBJECTS);
+            const uint32_t* objects = mapped.Table<uint32_t>(TABLE_INSTANCE_OBJECTS);
+            const float* px = mapped.Table<float>(TABLE_POSITION_X);
+            const float* py = mapped.Table<float>(TABLE_POSITION_Y);
+            const float* pz = mapped.Table<float>(TABLE_POSITION_Z);
+            const float* rw = mapped.Table<float>(TABLE_ROTATION_W);
+            const float* rx = mapped.Table<float>(TABLE_ROTATION_X);
+            const float* ry = mapped.Table<float>(TABLE_ROTATION_Y);
+            const float* rz = mapped.Table<float>(TABLE_ROTATION_Z);
+            const float* scale = mapped.Table<float>(TABLE_SCALE);
+            Instances.resize(count);
+            for (size_t i = 0; i < count; i++){
+                Instances[i] = SceneInstance{objects[i], glm::vec3(px[i], py[i], pz[i]), glm::quat(rw[i], rx[i], ry[i], rz[i]), scale[i]};
+            }
+            return validate(path);
+        }
+
+        bool parse(const std::string &type, std::istringstream &values){
+            if (type == "model"){
+                std::string path;
+                if (!std::getline(values >> std::ws, path)) return false;
+                Models.push_back(path.substr(0, path.find_last_not_of(" \t\r") + 1));
+            }else if (type == "material"){
+                SceneMaterial m;
+                if (!(values >> m.ColorA.r >> m.ColorA.g >> m.ColorA.b >> m.ColorB.r >> m.ColorB.g >> m.ColorB.b >> m.Checker >> m.Specular)) return false;
+                Materials.push_back(m);
+            }else if (type == "mesh"){
+                std::string shape;
+                SceneMesh m;
+                if (!(values >> shape >> m.Detail >> m.Material)) return false;
+                m.Shape = std::find(SCENE_SHAPE_NAMES, SCENE_SHAPE_NAMES + SHAPE_COUNT, shape) - SCENE_SHAPE_NAMES;
+                if (m.Shape >= SHAPE_COUNT) return false;
+                Meshes.push_back(m);
+            }else if (type == "instance"){
+                SceneInstance n;
+                if (!(values >> n.Object >> n.Position.x >> n.Position.y >> n.Position.z >> n.Rotation.w >> n.Rotation.x >> n.Rotation.y
+                      >> n.Rotation.z >> n.Scale)) return false;
+                Instances.push_back(n);
+            }else if (type == "point" || type == "spot"){
+                SceneLight l;
+                l.Type = type == "point" ? LIGHT_POINT : LIGHT_SPOT;
+                l.Direction = glm::vec3(0.0f, -1.0f, 0.0f);
+                if (!(values >> l.Position.x >> l.Position.y >> l.Position.z)) return false;
+                if (l.Type == LIGHT_SPOT && !(values >> l.Direction.x >> l.Direction.y >> l.Direction.z)) return false;
+                if (!(values >> l.Color.r >> l.Color.g >> l.Color.b)) return false;
+                Lights.push_back(l);
+            }else{
+                return false;
+            }
+            return true;
+        }
+
+        bool validate(const std::string &path){
+            for (unsigned int i = 0; i < Meshes.size(); i++){
+                if (Meshes[i].Material >= Materials.size()){
+                    std::cout << "ERROR::SCENE::UNKNOWN_MATERIAL " << path << ", mesh " << i << std::endl;
+                    return false;
+                }
+                Meshes[i].Detail = std::min(std::max(Meshes[i].Detail, SCENE_MIN_DETAIL), SCENE_MAX_DETAIL);
+            }
+            for (unsigned int i = 0; i < Instances.size(); i++){
+                if (Instances[i].Object >= ObjectCount()){
+                    std::cout << "ERROR::SCENE::UNKNOWN_OBJECT " << path << ", instance " << i << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+};
+
+// The bounds BuildProceduralMesh produces, known without building the mesh.
+inline AABB ProceduralMeshBounds(const SceneMesh &mesh){
+    float height = mesh.Shape == SHAPE_TORUS ? 0.15f : 0.5f;
+    return AABB{glm::vec3(-0.5f, -height, -0.5f), glm::vec3(0.5f, height, 0.5f)};
+}
+
+// Unit sized shapes around the origin with normals, texture coordinates and tangents.
+inline void BuildProceduralMesh(const SceneMesh &mesh, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices){
+    const float pi = glm::pi<float>();
+    unsigned int n = mesh.Detail;
+    vertices.clear();
+    indices.clear();
+
+    // A (columns + 1) x (rows + 1) vertex grid, two counter clockwise triangles per cell.
+    auto grid = [&indices](unsigned int first, unsigned int columns, unsigned int rows){
+        for (unsigned int y = 0; y < rows; y++){
+            for (unsigned int x = 0; x < columns; x++){
+                unsigned int a = first + y * (columns + 1) + x;
+                unsigned int b = a + columns + 1;
+                indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+            }
+        }
+    };
+    auto vertex = [&vertices](glm::vec3 position, glm::vec3 normal, glm::vec2 uv, glm::vec3 tangent){
+        vertices.push_back(Vertex{position, normal, uv, tangent, glm::cross(normal, tangent)});
+    };
+
+    if (mesh.Shape == SHAPE_SPHERE){
+        unsigned int columns = n * 2, rows = n;
+        for (unsigned int y = 0; y <= rows; y++){
+            float theta = pi * y / rows;
+            for (unsigned int x = 0; x <= columns; x++){
+                float phi = 2.0f * pi * x / columns;
+                glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                vertex(normal * 0.5f, normal, glm::vec2((float)x / columns * 2.0f, (float)y / rows), glm::vec3(-std::sin(phi), 0.0f, std::cos(phi)));
+            }
+        }
+        grid(0, columns, rows);
+    }else if (mesh.Shape == SHAPE_BOX){
+        for (unsigned int face = 0; face < 6; face++){
+            glm::vec3 normal(0.0f);
+            normal[face / 2] = face % 2 ? -1.0f : 1.0f;
+            glm::vec3 u(0.0f), v(0.0f);
+            u[(face / 2 + 1) % 3] = 1.0f;
+            v = glm::cross(normal, u);
+
+            unsigned int first = vertices.size();
+            for (unsigned int y = 0; y <= n; y++){
+                for (unsigned int x = 0; x <= n; x++){
+                    glm::vec2 uv((float)x / n, (float)y / n);
+                    vertex(normal * 0.5f + u * (uv.x - 0.5f) + v * (uv.y - 0.5f), normal, uv, u);
+                }
+            }
+            grid(first, n, n);
+        }
+    }else{
+        const float major = 0.35f, minor = 0.15f;
+        unsigned int columns = n * 2, rows = n;
+        for (unsigned int y = 0; y <= rows; y++){
+            float theta = -2.0f * pi * y / rows;
+            for (unsigned int x = 0; x <= columns; x++){
+                float phi = 2.0f * pi * x / columns;
+                glm::vec3 ring(std::cos(phi), 0.0f, std::sin(phi));
+                glm::vec3 normal = ring * std::cos(theta) + glm::vec3(0.0f, std::sin(theta), 0.0f);
+                vertex(ring * major + normal * minor, normal, glm::vec2((float)x / columns * 4.0f, (float)y / rows), glm::vec3(-ring.z, 0.0f, ring.x));
+            }
+        }
+        grid(0, columns, rows);
+    }
+}
+
+// Knobs of a synthetic workload. Instances are scattered over a box of
+// 2 * Extent by Extent / 2 by 2 * Extent around the origin. Layers nests that
+// many spheres of up to Coverage * Extent radius at the origin, which puts
+// 2 * Layers surfaces behind every pixel they cover; drawn inside out every
+// one of them passes the depth test (worst case overdraw), outside in the
+// outermost shell hides the rest.
+struct StressSceneSettings{
+    std::vector<std::string> Models;
+    float ModelScale = 1.0f;
+    unsigned int ModelInstances = 16;
+    unsigned int Meshes = 8;
+    unsigned int Materials = 8;
+    unsigned int MeshInstances = 16;
+    unsigned int MinDetail = 8;
+    unsigned int MaxDetail = 48;
+    unsigned int PointLights = 4;
+    unsigned int SpotLights = 0;
+    unsigned int Layers = 0;
+    bool LayersInsideOut = true;
+    float Coverage = 0.5f;
+    float Extent = 10.0f;
+    unsigned int Seed = 1;
+};
+
+// The same settings always give the same scene.
+inline SceneDescription GenerateStressScene(const StressSceneSettings &settings){
+    SceneDescription scene;
+    std::mt19937 random(settings.Seed);
+    auto uniform = [&random](float min, float max){
+        return std::uniform_real_distribution<float>(min, max)(random);
+    };
+    auto color = [&uniform](){
+        return glm::vec3(uniform(0.1f, 1.0f), uniform(0.1f, 1.0f), uniform(0.1f, 1.0f));
+    };
+    auto position = [&uniform, &settings](){
+        float e = settings.Extent;
+        return glm::vec3(uniform(-e, e), uniform(-e * 0.25f, e * 0.25f), uniform(-e, e));
+    };
+    auto rotation = [&uniform](){
+        glm::vec3 axis(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f));
+        if (glm::length(axis) < 1e-3f) axis = glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::angleAxis(uniform(0.0f, 2.0f * glm::pi<float>()), glm::normalize(axis));
+    };
+
+    scene.Models = settings.Models;
+    unsigned int materials = settings.Meshes || settings.Layers ? std::max(settings.Materials, 1u) : 0;
+    for (unsigned int i = 0; i < materials; i++){
+        scene.Materials.push_back(SceneMaterial{color(), color(), (unsigned int)uniform(1.0f, 9.0f), uniform(0.0f, 1.0f)});
+    }
+    for (unsigned int i = 0; i < settings.Meshes; i++){
+        unsigned int detail = (unsigned int)uniform((float)settings.MinDetail, (float)settings.MaxDetail + 1.0f);
+        scene.Meshes.push_back(SceneMesh{i % SHAPE_COUNT, std::min(detail, settings.MaxDetail), i % materials});
+    }
+
+    // The shells come first, so the depth buffer they leave decides how much of the rest is shaded.
+    if (settings.Layers){
+        unsigned int shell = scene.ObjectCount();
+        scene.Meshes.push_back(SceneMesh{SHAPE_SPHERE, 32, 0});
+        float outer = settings.Coverage * settings.Extent * 2.0f;
+        for (unsigned int i = 0; i < settings.Layers; i++){
+            unsigned int layer = settings.LayersInsideOut ? i + 1 : settings.Layers - i;
+            scene.Instances.push_back(SceneInstance{shell, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), outer * layer / settings.Layers});
+        }
+    }
+
+    for (unsigned int m = 0; m < settings.Models.size(); m++){
+        for (unsigned int i = 0; i < settings.ModelInstances; i++){
+            glm::quat yaw = glm::angleAxis(uniform(0.0f, 2.0f * glm::pi<float>()), glm::vec3(0.0f, 1.0f, 0.0f));
+            scene.Instances.push_back(SceneInstance{m, position(), yaw, settings.ModelScale});
+        }
+    }
+    for (unsigned int m = 0; m < settings.Meshes; m++){
+        for (unsigned int i = 0; i < settings.MeshInstances; i++){
+            scene.Instances.push_back(SceneInstance{(unsigned int)settings.Models.size() + m, position(), rotation(), uniform(0.5f, 2.0f)});
+        }
+    }
+
+    for (unsigned int i = 0; i < settings.PointLights; i++){
+        scene.Lights.push_back(SceneLight{LIGHT_POINT, position(), glm::vec3(0.0f, -1.0f, 0.0f), color()});
+    }
+    for (unsigned int i = 0; i < settings.SpotLights; i++){
+        glm::vec3 from = position() + glm::vec3(0.0f, settings.Extent * 0.5f, 0.0f);
+        glm::vec3 direction = glm::normalize(position() - from);
+        scene.Lights.push_back(SceneLight{LIGHT_SPOT, from, direction, color()});
+    }
+    return scene;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef SCENE_RESOURCES_H
+#define SCENE_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <custom/scene.h>
+#include <custom/model.h>
+#include <custom/job_system.h>
+#include <custom/gpu_resources.h>
+#include <custom/gl_state.h>
+
+#include <vector>
+#include <memory>
+#include <string>
+
+const unsigned int SCENE_TEXTURE_SIZE = 64;
+
+// An object loaded off the GL thread: a deferred model, or the geometry of a procedural mesh.
+struct PreparedObject{
+    unsigned int Object;
+    std::unique_ptr<Model> Loaded;
+    std::vector<Vertex> Vertices;
+    std::vector<unsigned int> Indices;
+    size_t Bytes;
+};
+
+// The GL side of a SceneDescription: one Model per object, indexed the same
+// way as the instances. Models are loaded with the job system, procedural
+// meshes are built on the workers and uploaded here, each material is a
+// checker diffuse and a flat specular texture shared by its meshes.
+// A streamed scene starts out with only the materials, objects come and go
+// through Prepare() on any thread and Upload()/Unload() on the GL thread.
+// Objects flagged in occluders keep their CPU geometry for the software occlusion culler.
+class SceneResources{
+    public:
+        std::vector<std::unique_ptr<Model>> Objects;
+
+        SceneResources(const SceneDescription &scene, JobSystem &jobs, bool streamed = false, const std::vector<bool> &occluders = std::vector<bool>())
+            : scene(scene), occluders(occluders){
+            PROFILE_ZONE("scene load");
+            emptyTexture = EmptyTexture();
+            for (unsigned int i = 0; i < scene.Materials.size(); i++){
+                createMaterial(scene.Materials[i]);
+            }
+            if (streamed){
+                Objects.resize(scene.ObjectCount());
+                residentBytes.assign(scene.ObjectCount(), 0);
+                return;
+            }
+
+            for (unsigned int i = 0; i < scene.Models.size(); i++){
+                Objects.push_back(std::unique_ptr<Model>(new Model(scene.Models[i], false, &jobs)));
+                Objects.back()->Occluder = isOccluder(i);
+                Objects.back()->Update();
+            }
+
+            std::vector<std::vector<Vertex>> vertices(scene.Meshes.size());
+            std::vector<std::vector<unsigned int>> indices(scene.Meshes.size());
+            jobs.ParallelFor(scene.Meshes.size(), 1, [&](unsigned int begin, unsigned int end){
+                for (unsigned int i = begin; i < end; i++){
+                    BuildProceduralMesh(scene.Meshes[i], vertices[i], indices[i]);
+                }
+            });
+            for (unsigned int i = 0; i < scene.Meshes.size(); i++){
+                std::vector<Mesh> meshes;
+                meshes.push_back(Mesh(std::move(vertices[i]), std::move(indices[i]), materialTextures(scene.Meshes[i].Material)));
+                Objects.push_back(std::unique_ptr<Model>(new Model(std::move(meshes))));
+                Objects.back()->Occluder = isOccluder(scene.Models.size() + i);
+            }
+        }
+
+        SceneResources(const SceneResources&) = delete;
+        SceneResources& operator=(const SceneResources&) = delete;
+
+        // Thread safe, nothing here touches GL.
+        PreparedObject Prepare(unsigned int object) const{
+            PreparedObject prepared;
+            prepared.Object = object;
+            if (object < scene.Models.size()){
+                prepared.Loaded.reset(new Model(scene.Models[object], false, NULL, true));
+                prepared.Bytes = prepared.Loaded->PendingBytes();
+            }else{
+                BuildProceduralMesh(scene.Meshes[object - scene.Models.size()], prepared.Vertices, prepared.Indices);
+                prepared.Bytes = prepared.Vertices.size() * sizeof(Vertex) + prepared.Indices.size() * sizeof(unsigned int);
+            }
+            return prepared;
+        }
+
+        void Upload(PreparedObject &prepared){
+            unsigned int object = prepared.Object;
+            if (prepared.Loaded){
+                prepared.Loaded->Upload();
+                Objects[object] = std::move(prepared.Loaded);
+            }else{
+                std::vector<Mesh> meshes;
+                meshes.push_back(Mesh(std::move(prepared.Vertices), std::move(prepared.Indices),
+                                      materialTextures(scene.Meshes[object - scene.Models.size()].Material)));
+                Objects[object].reset(new Model(std::move(meshes)));
+            }
+            Objects[object]->Occluder = isOccluder(object);
+            Objects[object]->Update();
+            Objects[object]->ReleaseGeometry();
+            residentBytes[object] = prepared.Bytes;
+        }
+
+        // The GL objects are released to the registry, which deletes them once the GPU is done with them.
+        void Unload(unsigned int object){
+            Objects[object].reset();
+            residentBytes[object] = 0;
+        }
+
+        size_t ResidentBytes(unsigned int object) const{
+            return object < residentBytes.size() ? residentBytes[object] : 0;
+        }
+
+        // Local bounds per object, instances place them with their transform. Procedural
+        // meshes are known up front, models that are not loaded yet report an empty box.
+        std::vector<AABB> Bounds() const{
+            std::vector<AABB> bounds;
+            for (unsigned int i = 0; i < Objects.size(); i++){
+                if (Objects[i]) bounds.push_back(Objects[i]->GetBounds());
+                else if (i >= scene.Models.size()) bounds.push_back(ProceduralMeshBounds(scene.Meshes[i - scene.Models.size()]));
+                else bounds.push_back(AABB{glm::vec3(0.0f), glm::vec3(0.0f)});
+            }
+            return bounds;
+        }
+
+        size_t GeometryBytes() const{
+            size_t bytes = 0;
+            for (unsigned int i = 0; i < Objects.size(); i++){
+                if (Objects[i]) bytes += Objects[i]->GeometryBytes();
+            }
+            return bytes;
+        }
+
+        void ReleaseGeometry(){
+            for (unsigned int i = 0; i < Objects.size(); i++){
+                if (Objects[i]) Objects[i]->ReleaseGeometry();
+            }
+        }
+
+    private:
+        const SceneDescription &scene;
+        std::vector<bool> occluders;
+        std::vector<GpuResource> textures;
+        GpuResource emptyTexture;
+        std::vector<size_t> residentBytes;
+
+        bool isOccluder(unsigned int object) const{
+            return object < occluders.size() && occluders[object];
+        }
+
+        void createMaterial(const SceneMaterial &material){
+            std::vector<unsigned char> pixels(SCENE_TEXTURE_SIZE * SCENE_TEXTURE_SIZE * 3);
+            unsigned int square = std::max(1u, SCENE_TEXTURE_SIZE / std::max(1u, material.Checker));
+            for (unsigned int y = 0; y < SCENE_TEXTURE_SIZE; y++){
+                for (unsigned int x = 0; x < SCENE_TEXTURE_SIZE; x++){
+                    glm::vec3 color = (x / square + y / square) % 2 ? material.ColorB : material.ColorA;
+                    for (unsigned int c = 0; c < 3; c++){
+                        pixels[(y * SCENE_TEXTURE_SIZE + x) * 3 + c] = (unsigned char)(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+                    }
+                }
+            }
+            textures.push_back(createTexture(pixels.data(), SCENE_TEXTURE_SIZE, true));
+
+            unsigned char specular = (unsigned char)(glm::clamp(material.Specular, 0.0f, 1.0f) * 255.0f + 0.5f);
+            unsigned char flat[3] = {specular, specular, specular};
+            textures.push_back(createTexture(flat, 1, false));
+        }
+
+        GpuResource createTexture(const unsigned char* pixels, unsigned int size, bool mipmapped){
+            unsigned int textureID;
+            glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+            GLState().BindTexture(0, textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            if (mipmapped){
+                glGenerateMipmap(GL_TEXTURE_2D);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            }else{
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            }
+            return GpuResource(GPU_TEXTURE, textureID, TextureBytes(size, size, 3, mipmapped), GPU_CATEGORY_TEXTURE);
+        }
+
+        // Padded like a loaded model's meshes, every sampler slot of every type gets a texture.
+        std::vector<Texture> materialTextures(unsigned int material){
+            const char* types[4] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+            std::vector<Texture> meshTextures;
+            for (unsigned int t = 0; t < 4; t++){
+                for (unsigned int i = 0; i < 4; i++){
+                    unsigned int id = t < 2 && i == 0 ? textures[material * 2 + t].Id() : emptyTexture.Id();
+                    meshTextures.push_back(Texture{id, types[t], i == 0 && t < 2 ? "procedural" : "empty"});
+                }
+            }
+            return meshTextures;
+        }
+};
+
+#endif
@@ -3,7 +3,13 @@
 
 #include <glad/glad.h>
 
+#include <custom/frame_arena.h>
+#include <custom/gpu_resources.h>
+#include <custom/gl_state.h>
+#include <custom/profiler.h>
+
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -13,32 +19,14 @@ class Shader{
         unsigned int ID;
 
         Shader(const char* vertexPath, const char* fragmentPath){
-            std::string vertexCode;
-            std::string fragmentCode;
-            std::ifstream vShaderFile(vertexPath);
-            std::ifstream fShaderFile(fragmentPath);
-
-            vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-            fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-            
-            try
-            {
-                vertexCode.assign( (std::istreambuf_iterator<char>(vShaderFile) ),
-                       (std::istreambuf_iterator<char>()    ) );
-
-                fragmentCode.assign( (std::istreambuf_iterator<char>(fShaderFile) ),
-                       (std::istreambuf_iterator<char>()    ) );
-            }
-            catch(std::ifstream::failure e)
-            {
-                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-            }
+            PROFILE_ZONE("shader compile");
+            ALLOC_SCOPE(ALLOC_SHADER);
+            std::string vertexCode = readSource(vertexPath);
+            std::string fragmentCode = readSource(fragmentPath);
             const char* vShaderCode = vertexCode.c_str();
             const char* fShaderCode = fragmentCode.c_str();
 
             unsigned int vertex, fragment;
-            int success;
-            char infoLog[512];
 
             vertex = glCreateShader(GL_VERTEX_SHADER);
             glShaderSource(vertex, 1, &vShaderCode, NULL);
@@ -53,6 +41,7 @@ class Shader{
             checkCompileErrors(fragment, "FRAGMENT");
 
             ID = glCreateProgram();
+            program = GpuResource(GPU_PROGRAM, ID, 0, GPU_CATEGORY_SHADER);
             glAttachShader(ID, vertex);
             glAttachShader(ID, fragment);
             glLinkProgram(ID);
@@ -63,92 +52,169 @@ class Shader{
             glDeleteShader(fragment);
         }
 
+        Shader(const char* computePath){
+            PROFILE_ZONE("shader compile");
+            ALLOC_SCOPE(ALLOC_SHADER);
+            std::string computeCode = readSource(computePath);
+            const char* cShaderCode = computeCode.c_str();
+
+            unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(compute, 1, &cShaderCode, NULL);
+            glCompileShader(compute);
+
+            checkCompileErrors(compute, "COMPUTE");
+
+            ID = glCreateProgram();
+            program = GpuResource(GPU_PROGRAM, ID, 0, GPU_CATEGORY_SHADER);
+            glAttachShader(ID, compute);
+            glLinkProgram(ID);
+
+            checkCompileErrors(ID, "PROGRAM");
+
+            glDeleteShader(compute);
+        }
+
         void use(){
-            glUseProgram(ID);
+            GLState().UseProgram(ID);
         }
 
-        void setBool(std::string name, bool value) const{
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        void setBool(const char* name, bool value) const{
+            glUniform1i(glGetUniformLocation(ID, name), (int)value);
         }
-        void setInt(std::string name, int value) const{
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        void setInt(const char* name, int value) const{
+            glUniform1i(glGetUniformLocation(ID, name), value);
         }
-        void setFloat(std::string name, float value) const{
-            glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        void setFloat(const char* name, float value) const{
+            glUniform1f(glGetUniformLocation(ID, name), value);
         }
 
 
-        void setVec2(std::string name, glm::vec2 value) const{
-            glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &(value.x));
+        void setVec2(const char* name, glm::vec2 value) const{
+            glUniform2fv(glGetUniformLocation(ID, name), 1, &(value.x));
         }
-        void setVec2(std::string name, float x, float y) const{
-            glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        void setVec2(const char* name, float x, float y) const{
+            glUniform2f(glGetUniformLocation(ID, name), x, y);
         }
 
-        void setVec3(std::string name, glm::vec3 value) const{
-            glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &(value.x));
+        void setVec3(const char* name, glm::vec3 value) const{
+            glUniform3fv(glGetUniformLocation(ID, name), 1, &(value.x));
         }
-        void setVec3(std::string name, float x, float y, float z) const{
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        void setVec3(const char* name, float x, float y, float z) const{
+            glUniform3f(glGetUniformLocation(ID, name), x, y, z);
         }
 
-        void setVec4(std::string name, glm::vec4 value) const{
-            glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &(value.x));
+        void setVec4(const char* name, glm::vec4 value) const{
+            glUniform4fv(glGetUniformLocation(ID, name), 1, &(value.x));
         }
-        void setVec4(std::string name, float x, float y, float z, float w) const{
-            glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        void setVec4(const char* name, float x, float y, float z, float w) const{
+            glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
         }
 
 
-        void setMat2(std::string name, glm::mat2 value) const{
-            glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+        void setMat2(const char* name, glm::mat2 value) const{
+            glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &(value[0].x));
         }
-        void setMat3(std::string name, glm::mat3 value) const{
-            glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+        void setMat3(const char* name, glm::mat3 value) const{
+            glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &(value[0].x));
         }
-        void setMat4(std::string name, glm::mat4 value) const{
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+        void setMat4(const char* name, glm::mat4 value) const{
+            glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &(value[0].x));
         }
 
-        void setPointLight(std::string name, glm::vec3 position, glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
+        void setPointLight(const char* name, glm::vec3 position, glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
                             glm::vec3 diffuse = glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f),
                             float attenuationConstant = 1.0f, float attenuationLinear = 0.07f, float attenuationQuadratic = 0.017f){
+            FrameString uniform;
+            uniform.reserve(std::strlen(name) + 16);
 
-            setVec3(name + ".position", position);
-            setVec3(name + ".ambient", ambient);
-            setVec3(name + ".diffuse", diffuse);
-            setVec3(name + ".specular", specular);
-            setFloat(name + ".constant", attenuationConstant);
-            setFloat(name + ".linear", attenuationLinear);
-            setFloat(name + ".quadratic", attenuationQuadratic);
+            setVec3(member(uniform, name, ".position"), position);
+            setVec3(member(uniform, name, ".ambient"), ambient);
+            setVec3(member(uniform, name, ".diffuse"), diffuse);
+            setVec3(member(uniform, name, ".specular"), specular);
+            setFloat(member(uniform, name, ".constant"), attenuationConstant);
+            setFloat(member(uniform, name, ".linear"), attenuationLinear);
+            setFloat(member(uniform, name, ".quadratic"), attenuationQuadratic);
         }
 
-        void setSpotLight(std::string name, glm::vec3 position, glm::vec3 direction, glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
+        void setSpotLight(const char* name, glm::vec3 position, glm::vec3 direction, glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
                             glm::vec3 diffuse = glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f),
                             float innerCutOffRadius = 12.5f, float outerCutOffRadius = 17.5f, float attenuationConstant = 1.0f, 
                             float attenuationLinear = 0.07f, float attenuationQuadratic = 0.017f){
-
-            setVec3(name + ".position", position);
-            setVec3(name + ".direction", direction);
-            setVec3(name + ".ambient", ambient);
-            setVec3(name + ".diffuse", diffuse);
-            setVec3(name + ".specular", specular);
-            setFloat(name + ".cutOff", glm::cos(glm::radians(innerCutOffRadius)));
-            setFloat(name + ".outerCutOff", glm::cos(glm::radians(outerCutOffRadius)));
-            setFloat(name + ".constant", attenuationConstant);
-            setFloat(name + ".linear", attenuationLinear);
-            setFloat(name + ".quadratic", attenuationQuadratic);
-        }
-
-        void setDirectionalLight(std::string name, glm::vec3 direction = glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
+            FrameString uniform;
+            uniform.reserve(std::strlen(name) + 16);
+
+            setVec3(member(uniform, name, ".position"), position);
+            setVec3(member(uniform, name, ".direction"), direction);
+            setVec3(member(uniform, name, ".ambient"), ambient);
+            setVec3(member(uniform, name, ".diffuse"), diffuse);
+            setVec3(member(uniform, name, ".specular"), specular);
+            setFloat(member(uniform, name, ".cutOff"), glm::cos(glm::radians(innerCutOffRadius)));
+            setFloat(member(uniform, name, ".outerCutOff"), glm::cos(glm::radians(outerCutOffRadius)));
+            setFloat(member(uniform, name, ".constant"), attenuationConstant);
+            setFloat(member(uniform, name, ".linear"), attenuationLinear);
+            setFloat(member(uniform, name, ".quadratic"), attenuationQuadratic);
+        }
+
+        void setDirectionalLight(const char* name, glm::vec3 direction = glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3 ambient = glm::vec3(0.05f, 0.05f, 0.05f),
                                  glm::vec3 diffuse = glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f)){
+            FrameString uniform;
+            uniform.reserve(std::strlen(name) + 16);
                                      
-            setVec3(name + ".direction", direction);
-            setVec3(name + ".ambient", ambient);
-            setVec3(name + ".diffuse", diffuse);
-            setVec3(name + ".specular", specular);
+            setVec3(member(uniform, name, ".direction"), direction);
+            setVec3(member(uniform, name, ".ambient"), ambient);
+            setVec3(member(uniform, name, ".diffuse"), diffuse);
+            setVec3(member(uniform, name, ".specular"), specular);
         }
     private:
+        GpuResource program;
+
+        // Reuses the reserved frame arena storage for every member name of a light.
+        static const char* member(FrameString &uniform, const char* name, const char* field){
+            uniform.assign(name);
+            uniform += field;
+            return uniform.c_str();
+        }
+
+        std::string readSource(const char* path){
+            std::string code;
+            std::ifstream file(path);
+            file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+
+            try
+            {
+                code.assign( (std::istreambuf_iterator<char>(file) ),
+                       (std::istreambuf_iterator<char>()    ) );
+            }
+            catch(std::ifstream::failure e)
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+            }
+            lowerVersion(code);
+            return code;
+        }
+
+        // The shaders are written against 4.6, contexts that stop at 4.5 (Mesa llvmpipe in
+        // headless runs) get the version lowered and the 4.6 draw parameters from the ARB extension.
+        static void lowerVersion(std::string &code){
+            GLint major = 0, minor = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            int version = major * 100 + minor * 10;
+
+            size_t at = code.find("#version 460");
+            if (at == std::string::npos || version >= 460 || version < 450) return;
+            code.replace(at, 12, "#version " + std::to_string(version));
+
+            if (code.find("gl_BaseInstance") != std::string::npos || code.find("gl_DrawID") != std::string::npos){
+                size_t line = code.find('\n', at);
+                if (line == std::string::npos) return;
+                code.insert(line + 1, "#extension GL_ARB_shader_draw_parameters : require\n"
+                                      "#define gl_BaseInstance gl_BaseInstanceARB\n"
+                                      "#define gl_BaseVertex gl_BaseVertexARB\n"
+                                      "#define gl_DrawID gl_DrawIDARB\n");
+            }
+        }
+
         void checkCompileErrors(GLuint shader, std::string type){
         GLint success;
         GLchar infoLog[1024];
@@ -0,0 +1,402 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <glm/glm.hpp>
+
+#include <custom/scene.h>
+#include <custom/scene_resources.h>
+#include <custom/job_system.h>
+#include <custom/frame.h>
+#include <custom/profiler.h>
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+const float STREAMING_CELL_SIZE = 16.0f;
+const float STREAMING_RADIUS = 32.0f;
+const float STREAMING_PREFETCH_SECONDS = 1.0f;
+const size_t STREAMING_UPLOAD_BUDGET = 4 << 20;
+const size_t STREAMING_MEMORY_CAP = 256 << 20;
+const double STREAMING_HITCH_MS = 4.0;
+const unsigned int STREAMING_MAX_LATENCIES = 1 << 16;
+
+struct StreamingSettings{
+    float CellSize = STREAMING_CELL_SIZE;
+    float Radius = STREAMING_RADIUS;
+    float PrefetchSeconds = STREAMING_PREFETCH_SECONDS;
+    size_t UploadBudget = STREAMING_UPLOAD_BUDGET;
+    size_t MemoryCap = STREAMING_MEMORY_CAP;
+};
+
+// Splits a scene into square cells on the XZ plane, an instance belongs to
+// the cell its position falls into. Every cell lists the objects its
+// instances use, every object the instances that use it, both as flat
+// offset + index arrays.
+class StreamingGrid{
+    public:
+        StreamingGrid(const SceneDescription &scene, float cellSize) : cellSize(cellSize), columns(1), rows(1){
+            origin = glm::vec2(0.0f);
+            glm::vec2 max(0.0f);
+            for (unsigned int i = 0; i < scene.Instances.size(); i++){
+                glm::vec2 position(scene.Instances[i].Position.x, scene.Instances[i].Position.z);
+                origin = i ? glm::min(origin, position) : position;
+                max = i ? glm::max(max, position) : position;
+            }
+            columns = (unsigned int)((max.x - origin.x) / cellSize) + 1;
+            rows = (unsigned int)((max.y - origin.y) / cellSize) + 1;
+
+            std::vector<std::pair<unsigned int, unsigned int>> cellObjects(scene.Instances.size());
+            instanceCells.resize(scene.Instances.size());
+            for (unsigned int i = 0; i < scene.Instances.size(); i++){
+                instanceCells[i] = CellAt(scene.Instances[i].Position);
+                cellObjects[i] = std::make_pair(instanceCells[i], scene.Instances[i].Object);
+            }
+            std::sort(cellObjects.begin(), cellObjects.end());
+            cellObjects.erase(std::unique(cellObjects.begin(), cellObjects.end()), cellObjects.end());
+
+            objectOffsets.assign(columns * rows + 1, 0);
+            for (unsigned int i = 0; i < cellObjects.size(); i++){
+                objectOffsets[cellObjects[i].first + 1]++;
+                objects.push_back(cellObjects[i].second);
+            }
+            for (unsigned int i = 0; i < columns * rows; i++) objectOffsets[i + 1] += objectOffsets[i];
+
+            instanceOffsets.assign(scene.ObjectCount() + 1, 0);
+            for (unsigned int i = 0; i < scene.Instances.size(); i++) instanceOffsets[scene.Instances[i].Object + 1]++;
+            for (unsigned int i = 0; i < scene.ObjectCount(); i++) instanceOffsets[i + 1] += instanceOffsets[i];
+            instances.resize(scene.Instances.size());
+            std::vector<unsigned int> next(instanceOffsets.begin(), instanceOffsets.end() - 1);
+            for (unsigned int i = 0; i < scene.Instances.size(); i++) instances[next[scene.Instances[i].Object]++] = i;
+        }
+
+        unsigned int CellCount() const{ return columns * rows; }
+        float CellSize() const{ return cellSize; }
+        unsigned int InstanceCell(unsigned int instance) const{ return instanceCells[instance]; }
+
+        const unsigned int* CellObjects(unsigned int cell, unsigned int &count) const{
+            count = objectOffsets[cell + 1] - objectOffsets[cell];
+            return &objects[objectOffsets[cell]];
+        }
+
+        const unsigned int* ObjectInstances(unsigned int object, unsigned int &count) const{
+            count = instanceOffsets[object + 1] - instanceOffsets[object];
+            return &instances[instanceOffsets[object]];
+        }
+
+        unsigned int CellAt(const glm::vec3 &position) const{
+            int x = (int)std::floor((position.x - origin.x) / cellSize);
+            int z = (int)std::floor((position.z - origin.y) / cellSize);
+            return std::min(std::max(z, 0), (int)rows - 1) * columns + std::min(std::max(x, 0), (int)columns - 1);
+        }
+
+        // Distance on the XZ plane from a point to the closest point of the cell.
+        float Distance(unsigned int cell, const glm::vec3 &position) const{
+            glm::vec2 min = origin + glm::vec2(cell % columns, cell / columns) * cellSize;
+            glm::vec2 point(position.x, position.z);
+            return glm::length(point - glm::clamp(point, min, min + glm::vec2(cellSize)));
+        }
+
+        // The cells within radius of a point, clamped to the grid.
+        void Range(const glm::vec3 &position, float radius, unsigned int &x0, unsigned int &z0, unsigned int &x1, unsigned int &z1) const{
+            auto clampCell = [](float value, unsigned int count){
+                return (unsigned int)std::min(std::max(value, 0.0f), (float)count - 1.0f);
+            };
+            x0 = clampCell(std::floor((position.x - radius - origin.x) / cellSize), columns);
+            x1 = clampCell(std::floor((position.x + radius - origin.x) / cellSize), columns);
+            z0 = clampCell(std::floor((position.z - radius - origin.y) / cellSize), rows);
+            z1 = clampCell(std::floor((position.z + radius - origin.y) / cellSize), rows);
+        }
+
+        unsigned int Columns() const{ return columns; }
+
+    private:
+        float cellSize;
+        glm::vec2 origin;
+        unsigned int columns, rows;
+        std::vector<unsigned int> instanceCells;
+        std::vector<unsigned int> objectOffsets, objects;
+        std::vector<unsigned int> instanceOffsets, instances;
+};
+
+// Hands the bounds of models that finished loading from the GL thread to the
+// simulation, which only knew their position until then.
+class StreamingBounds{
+    public:
+        void Post(unsigned int object, const AABB &bounds){
+            std::lock_guard<std::mutex> lock(mutex);
+            posted.push_back(std::make_pair(object, bounds));
+        }
+
+        bool Take(std::vector<std::pair<unsigned int, AABB>> &out){
+            std::lock_guard<std::mutex> lock(mutex);
+            if (posted.empty()) return false;
+            out.swap(posted);
+            posted.clear();
+            return true;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<std::pair<unsigned int, AABB>> posted;
+};
+
+struct StreamingStats{
+    unsigned long long Frames;
+    unsigned long long Requested;
+    unsigned long long Loaded;
+    unsigned long long Evicted;
+    unsigned long long Hitches;
+    unsigned long long MissingFrames;
+    unsigned long long OverCapFrames;
+    size_t UploadedBytes;
+    size_t ResidentBytes;
+    size_t PeakResidentBytes;
+    double MaxUpdateMs;
+};
+
+// Keeps the cells around the camera resident. Every frame the cells within
+// Radius of the camera and of where it will be PrefetchSeconds from now are
+// wanted; their objects are loaded with Prepare() on the worker threads and
+// uploaded on the GL thread, at most UploadBudget bytes per frame (always at
+// least one object). Objects are shared between cells and reference counted.
+// Cells that are no longer wanted stay resident until the resident bytes
+// exceed MemoryCap, then the least recently wanted ones are evicted.
+class StreamingManager{
+    public:
+        StreamingManager(const StreamingGrid &grid, SceneResources &resources, JobSystem &jobs, const StreamingSettings &settings, StreamingBounds* bounds = NULL)
+            : grid(grid), resources(resources), jobs(jobs), settings(settings), bounds(bounds), stats(StreamingStats{}){
+            cells.resize(grid.CellCount());
+            objects.resize(resources.Objects.size());
+            wanted.reserve(grid.CellCount());
+            latencies.reserve(STREAMING_MAX_LATENCIES);
+            boundsKnown.assign(objects.size(), false);
+        }
+
+        // Outstanding loads reference the resources, they have to finish first.
+        ~StreamingManager(){
+            jobs.Wait(inflight);
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.clear();
+        }
+
+        StreamingManager(const StreamingManager&) = delete;
+        StreamingManager& operator=(const StreamingManager&) = delete;
+
+        bool CellResident(unsigned int cell) const{
+            return cells[cell].State == CELL_RESIDENT;
+        }
+
+        // Call once per frame on the GL thread.
+        void Update(const glm::vec3 &position, const glm::vec3 &velocity){
+            PROFILE_ZONE("streaming");
+            double begin = FrameTimeMs();
+            stats.Frames++;
+
+            request(position, velocity);
+            upload();
+            finishCells();
+            evict();
+
+            stats.PeakResidentBytes = std::max(stats.PeakResidentBytes, stats.ResidentBytes);
+            if (!CellResident(grid.CellAt(position))) stats.MissingFrames++;
+            double ms = FrameTimeMs() - begin;
+            stats.MaxUpdateMs = std::max(stats.MaxUpdateMs, ms);
+            if (ms > STREAMING_HITCH_MS) stats.Hitches++;
+        }
+
+        const StreamingStats& Stats() const{ return stats; }
+
+        void Report(){
+            unsigned int resident = 0;
+            for (unsigned int i = 0; i < cells.size(); i++) resident += cells[i].State == CELL_RESIDENT;
+
+            double mean = 0.0, p95 = 0.0, max = 0.0;
+            if (!latencies.empty()){
+                std::vector<double> sorted(latencies);
+                std::sort(sorted.begin(), sorted.end());
+                for (unsigned int i = 0; i < sorted.size(); i++) mean += sorted[i];
+                mean /= sorted.size();
+                p95 = sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.95))];
+                max = sorted.back();
+            }
+
+            std::cout << std::fixed << std::setprecision(1);
+            std::cout << "STREAMING::CELLS " << resident << "/" << cells.size() << " resident, " << stats.Requested << " requested, "
+                      << stats.Loaded << " loaded, " << stats.Evicted << " evicted, latency mean " << mean << " ms p95 " << p95 << " ms max " << max << " ms" << std::endl;
+            std::cout << "STREAMING::FRAMES " << stats.Hitches << " hitches (> " << STREAMING_HITCH_MS << " ms, worst " << stats.MaxUpdateMs << " ms), "
+                      << stats.MissingFrames << " of " << stats.Frames << " frames with the camera's cell missing, " << stats.OverCapFrames << " over the cap" << std::endl;
+            std::cout << "STREAMING::MEMORY resident " << stats.ResidentBytes / 1024 << " KiB, peak " << stats.PeakResidentBytes / 1024 << " KiB, cap "
+                      << settings.MemoryCap / 1024 << " KiB, uploaded " << stats.UploadedBytes / 1024 << " KiB" << std::endl;
+            std::cout << std::defaultfloat;
+        }
+
+    private:
+        enum CellState{ CELL_UNLOADED, CELL_LOADING, CELL_RESIDENT };
+        enum ObjectState{ OBJECT_UNLOADED, OBJECT_LOADING, OBJECT_RESIDENT };
+
+        struct Cell{
+            unsigned int State = CELL_UNLOADED;
+            unsigned long long LastWanted = 0;
+            double RequestMs = 0.0;
+        };
+
+        struct Object{
+            unsigned int State = OBJECT_UNLOADED;
+            unsigned int References = 0;
+        };
+
+        const StreamingGrid &grid;
+        SceneResources &resources;
+        JobSystem &jobs;
+        StreamingSettings settings;
+        StreamingBounds* bounds;
+        StreamingStats stats;
+
+        std::vector<Cell> cells;
+        std::vector<Object> objects;
+        std::vector<std::pair<float, unsigned int>> wanted;
+        std::vector<unsigned int> loading;
+        std::vector<double> latencies;
+        std::vector<bool> boundsKnown;
+
+        JobCounter inflight;
+        std::mutex readyMutex;
+        std::deque<std::unique_ptr<PreparedObject>> ready;
+
+        // Nearest cells first, the background queue runs the loads in the order they were requested.
+        void request(const glm::vec3 &position, const glm::vec3 &velocity){
+            glm::vec3 ahead = position + velocity * settings.PrefetchSeconds;
+            wanted.clear();
+            const glm::vec3 centers[2] = {position, ahead};
+            for (unsigned int c = 0; c < 2; c++){
+                unsigned int x0, z0, x1, z1;
+                grid.Range(centers[c], settings.Radius, x0, z0, x1, z1);
+                for (unsigned int z = z0; z <= z1; z++){
+                    for (unsigned int x = x0; x <= x1; x++){
+                        unsigned int cell = z * grid.Columns() + x;
+                        float distance = std::min(grid.Distance(cell, position), grid.Distance(cell, ahead));
+                        if (distance <= settings.Radius && cells[cell].LastWanted != stats.Frames){
+                            cells[cell].LastWanted = stats.Frames;
+                            wanted.push_back(std::make_pair(distance, cell));
+                        }
+                    }
+                }
+            }
+            std::sort(wanted.begin(), wanted.end());
+
+            for (unsigned int i = 0; i < wanted.size(); i++){
+                Cell &cell = cells[wanted[i].second];
+                if (cell.State != CELL_UNLOADED) continue;
+
+                cell.State = CELL_LOADING;
+                cell.RequestMs = FrameTimeMs();
+                loading.push_back(wanted[i].second);
+                stats.Requested++;
+
+                unsigned int count;
+                const unsigned int* cellObjects = grid.CellObjects(wanted[i].second, count);
+                for (unsigned int o = 0; o < count; o++){
+                    Object &object = objects[cellObjects[o]];
+                    if (object.References++ == 0 && object.State == OBJECT_UNLOADED){
+                        object.State = OBJECT_LOADING;
+                        unsigned int index = cellObjects[o];
+                        jobs.RunBackground([this, index](){
+                            std::unique_ptr<PreparedObject> prepared(new PreparedObject(resources.Prepare(index)));
+                            std::lock_guard<std::mutex> lock(readyMutex);
+                            ready.push_back(std::move(prepared));
+                        }, &inflight);
+                    }
+                }
+            }
+        }
+
+        // Loads whose cells were all evicted meanwhile are dropped without an upload.
+        void upload(){
+            size_t uploaded = 0;
+            while (true){
+                std::unique_ptr<PreparedObject> prepared;
+                {
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    if (ready.empty()) break;
+                    if (objects[ready.front()->Object].References && uploaded && uploaded + ready.front()->Bytes > settings.UploadBudget) break;
+                    prepared = std::move(ready.front());
+                    ready.pop_front();
+                }
+
+                Object &object = objects[prepared->Object];
+                if (!object.References){
+                    object.State = OBJECT_UNLOADED;
+                    continue;
+                }
+                resources.Upload(*prepared);
+                object.State = OBJECT_RESIDENT;
+                uploaded += prepared->Bytes;
+                stats.UploadedBytes += prepared->Bytes;
+                stats.ResidentBytes += resources.ResidentBytes(prepared->Object);
+
+                if (bounds && !boundsKnown[prepared->Object]){
+                    boundsKnown[prepared->Object] = true;
+                    bounds->Post(prepared->Object, resources.Objects[prepared->Object]->GetBounds());
+                }
+            }
+        }
+
+        void finishCells(){
+            for (unsigned int i = 0; i < loading.size(); ){
+                Cell &cell = cells[loading[i]];
+                unsigned int count;
+                const unsigned int* cellObjects = grid.CellObjects(loading[i], count);
+                bool complete = cell.State == CELL_LOADING;
+                for (unsigned int o = 0; o < count && complete; o++){
+                    complete = objects[cellObjects[o]].State == OBJECT_RESIDENT;
+                }
+                if (cell.State != CELL_LOADING || complete){
+                    if (complete){
+                        cell.State = CELL_RESIDENT;
+                        stats.Loaded++;
+                        if (latencies.size() < STREAMING_MAX_LATENCIES) latencies.push_back(FrameTimeMs() - cell.RequestMs);
+                    }
+                    loading[i] = loading.back();
+                    loading.pop_back();
+                }else{
+                    i++;
+                }
+            }
+        }
+
+        // Evicts the least recently wanted cells until the resident objects fit the cap again.
+        void evict(){
+            while (stats.ResidentBytes > settings.MemoryCap){
+                unsigned int victim = cells.size();
+                for (unsigned int i = 0; i < cells.size(); i++){
+                    if (cells[i].State == CELL_UNLOADED || cells[i].LastWanted == stats.Frames) continue;
+                    if (victim == cells.size() || cells[i].LastWanted < cells[victim].LastWanted) victim = i;
+                }
+                if (victim == cells.size()){
+                    stats.OverCapFrames++;
+                    return;
+                }
+
+                cells[victim].State = CELL_UNLOADED;
+                stats.Evicted++;
+                unsigned int count;
+                const unsigned int* cellObjects = grid.CellObjects(victim, count);
+                for (unsigned int o = 0; o < count; o++){
+                    Object &object = objects[cellObjects[o]];
+                    if (--object.References == 0 && object.State == OBJECT_RESIDENT){
+                        stats.ResidentBytes -= resources.ResidentBytes(cellObjects[o]);
+                        resources.Unload(cellObjects[o]);
+                        object.State = OBJECT_UNLOADED;
+                    }
+                }
+            }
+        }
+};
+
+#endif
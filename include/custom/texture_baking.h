@@ -0,0 +1,152 @@
+#ifndef TEXTURE_BAKING_H
+#define TEXTURE_BAKING_H
+
+#include <custom/ktx2.h>
+#include <custom/block_compression.h>
+#include <custom/mip_generation.h>
+#include <custom/job_system.h>
+#include <image_loader/stb_image.h>
+
+#include <sys/stat.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cctype>
+
+// Baked textures sit next to their source with .ktx2 appended, e.g. diffuse.jpg.ktx2.
+const char* const BAKED_TEXTURE_EXTENSION = ".ktx2";
+// Bottom row first, like the images the renderer loads flipped for GL's t axis.
+const char* const BAKED_TEXTURE_ORIENTATION = "ru";
+
+enum TextureKind{
+    TEXTURE_KIND_AUTO,
+    TEXTURE_KIND_COLOR,
+    TEXTURE_KIND_NORMAL,
+    TEXTURE_KIND_MASK
+};
+
+const char* const TEXTURE_KIND_NAMES[4] = {"auto", "color", "normal", "mask"};
+
+struct BakeSettings{
+    TextureKind Kind = TEXTURE_KIND_AUTO;
+    bool FastColor = false;     // BC1 (BC3 with alpha) instead of BC7 for color maps
+    bool Uncompressed = false;  // R8, RGB8 or RGBA8 levels, uploaded without any conversion
+    bool Mips = true;
+    MipFilter Filter = MIP_FILTER_KAISER;
+    bool LinearColor = false;   // filter color maps as stored instead of in linear light
+};
+
+inline std::string BakedTexturePath(const std::string &source){
+    return source + BAKED_TEXTURE_EXTENSION;
+}
+
+// A baked texture is used when it is at least as new as its source, or the source is gone.
+inline bool BakedTextureCurrent(const std::string &source){
+    struct stat baked, original;
+    if (stat(BakedTexturePath(source).c_str(), &baked) != 0) return false;
+    return stat(source.c_str(), &original) != 0 || baked.st_mtime >= original.st_mtime;
+}
+
+// Loads a source image bottom row first, the way the renderer does. Free with stbi_image_free.
+inline unsigned char* LoadBakeSource(const std::string &path, int &width, int &height, int &components){
+    stbi_set_flip_vertically_on_load(true);
+    return stbi_load(path.c_str(), &width, &height, &components, 0);
+}
+
+// Normal maps and masks are told apart by name, the way exporters name them.
+inline TextureKind ClassifyTexture(const std::string &path){
+    std::string name = path.substr(path.find_last_of("/\\") + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return (char)std::tolower(c); });
+    const char* normals[] = {"normal", "_nrm", "_norm", "_n."};
+    const char* masks[] = {"metallic", "roughness", "specular", "occlusion", "_ao", "ao.", "mask", "gloss"};
+    for (const char* key : normals) if (name.find(key) != std::string::npos) return TEXTURE_KIND_NORMAL;
+    for (const char* key : masks) if (name.find(key) != std::string::npos) return TEXTURE_KIND_MASK;
+    return TEXTURE_KIND_COLOR;
+}
+
+// How the mips of a kind of texture are filtered.
+inline MipSettings MipSettingsFor(TextureKind kind, MipFilter filter, bool linearColor){
+    MipSettings settings;
+    settings.Filter = filter;
+    settings.Srgb = kind == TEXTURE_KIND_COLOR && !linearColor;
+    settings.Normal = kind == TEXTURE_KIND_NORMAL;
+    return settings;
+}
+
+// Picks the format and channel layout for an image and compresses its mip chain:
+//   color   BC7, or BC1/BC3 with FastColor
+//   normal  BC5 of x and y, z has to be rebuilt by whoever samples it
+//   mask    BC4 when the image is grey, BC5 of green and blue for glTF metallicRoughness
+//           (roughness in g, metallic in b), otherwise like a color map
+// Uncompressed bakes keep every channel that carries data: R8 for grey masks,
+// RGBA8 with alpha and RGB8 otherwise. The swizzle brings the channels back to
+// where the shaders expect them. Mips come from GenerateMips on the full image.
+// pixels are bottom row first, as LoadBakeSource returns them.
+inline Ktx2Texture BakeTexture(const std::string &path, const unsigned char* pixels, unsigned int width, unsigned int height,
+                               unsigned int components, const BakeSettings &settings, JobSystem* jobs){
+    TextureLevel top{width, height, std::vector<unsigned char>((size_t)width * height * 4)};
+    bool grey = true, alpha = false;
+    for (size_t i = 0; i < (size_t)width * height; i++){
+        const unsigned char* source = pixels + i * components;
+        unsigned char* target = &top.Pixels[i * 4];
+        target[0] = source[0];
+        target[1] = components > 2 ? source[1] : source[0];
+        target[2] = components > 2 ? source[2] : source[0];
+        target[3] = components == 4 ? source[3] : components == 2 ? source[1] : 255;
+        grey = grey && target[0] == target[1] && target[1] == target[2];
+        alpha = alpha || target[3] != 255;
+    }
+
+    TextureKind kind = settings.Kind == TEXTURE_KIND_AUTO ? ClassifyTexture(path) : settings.Kind;
+    std::string name = path;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return (char)std::tolower(c); });
+
+    Ktx2Texture texture;
+    unsigned int channels[4] = {0, 1, 2, 3};
+    if (settings.Uncompressed && kind == TEXTURE_KIND_MASK && grey && !alpha){
+        texture.VkFormat = KTX2_R8_UNORM;
+        texture.Swizzle = "rrr1";
+    }else if (settings.Uncompressed){
+        texture.VkFormat = alpha ? KTX2_R8G8B8A8_UNORM : KTX2_R8G8B8_UNORM;
+    }else if (kind == TEXTURE_KIND_NORMAL){
+        texture.VkFormat = KTX2_BC5_UNORM;
+        texture.Swizzle = "rg01";
+    }else if (kind == TEXTURE_KIND_MASK && grey && !alpha){
+        texture.VkFormat = KTX2_BC4_UNORM;
+        texture.Swizzle = "rrr1";
+    }else if (kind == TEXTURE_KIND_MASK && name.find("metallicroughness") != std::string::npos){
+        texture.VkFormat = KTX2_BC5_UNORM;
+        texture.Swizzle = "0rg1";
+        channels[0] = 1;
+        channels[1] = 2;
+    }else if (settings.FastColor){
+        texture.VkFormat = alpha ? KTX2_BC3_UNORM : KTX2_BC1_RGB_UNORM;
+    }else{
+        texture.VkFormat = KTX2_BC7_UNORM;
+    }
+    texture.Width = width;
+    texture.Height = height;
+    texture.Orientation = BAKED_TEXTURE_ORIENTATION;
+
+    const Ktx2Format &format = *texture.Format();
+    // Dropping channels before filtering keeps the mip generator off data that is thrown away.
+    unsigned int packed = format.Compressed ? 4 : format.BlockBytes;
+    if (packed < 4){
+        for (size_t i = 0; i < (size_t)width * height; i++){
+            for (unsigned int c = 0; c < packed; c++) top.Pixels[i * packed + c] = top.Pixels[i * 4 + c];
+        }
+        top.Pixels.resize((size_t)width * height * packed);
+    }
+    std::vector<TextureLevel> levels;
+    if (settings.Mips) levels = GenerateMips(top.Pixels.data(), width, height, packed, MipSettingsFor(kind, settings.Filter, settings.LinearColor), jobs);
+    else levels.push_back(std::move(top));
+
+    for (TextureLevel &level : levels){
+        if (format.Compressed) level.Pixels = CompressImage(format, level.Pixels.data(), level.Width, level.Height, jobs, channels);
+        texture.Levels.push_back(std::move(level));
+    }
+    return texture;
+}
+
+#endif
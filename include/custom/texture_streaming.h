@@ -0,0 +1,360 @@
+#ifndef TEXTURE_STREAMING_H
+#define TEXTURE_STREAMING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <custom/gpu_resources.h>
+#include <custom/gl_state.h>
+#include <custom/profiler.h>
+#include <custom/ktx2.h>
+#include <custom/mip_generation.h>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+// GL_ARB_sparse_texture is not in the generated loader, Enable() fetches its entry point itself.
+#ifndef GL_TEXTURE_SPARSE_ARB
+#define GL_TEXTURE_SPARSE_ARB 0x91A6
+#define GL_VIRTUAL_PAGE_SIZE_INDEX_ARB 0x91A7
+#define GL_NUM_SPARSE_LEVELS_ARB 0x91AA
+#define GL_NUM_VIRTUAL_PAGE_SIZES_ARB 0x91A8
+#define GL_VIRTUAL_PAGE_SIZE_X_ARB 0x9195
+#define GL_VIRTUAL_PAGE_SIZE_Y_ARB 0x9196
+#endif
+typedef void (APIENTRYP PFNTEXPAGECOMMITMENTPROC)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+                                                   GLsizei width, GLsizei height, GLsizei depth, GLboolean commit);
+
+const size_t TEXTURE_STREAMING_BUDGET = 128 << 20;
+const size_t TEXTURE_STREAMING_UPLOAD_BUDGET = 4 << 20;
+const unsigned int TEXTURE_STREAMING_TAIL_SIZE = 64;
+
+struct TextureStreamingStats{
+    unsigned int Textures;
+    unsigned int SparseTextures;
+    size_t ResidentBytes;
+    size_t RequestedBytes;
+    unsigned long long Uploads;
+    size_t UploadedBytes;
+    unsigned long long Evictions;
+    unsigned long long OverBudgetFrames;
+};
+
+// Mip level streaming for the textures of loaded models. A texture starts out
+// with only its mip tail (TEXTURE_STREAMING_TAIL_SIZE and below) on the GPU,
+// the full chain stays in system memory. Every frame the renderer reports how
+// many UV units one pixel covers for each texture it draws, Update() turns
+// that into the finest level worth having and uploads the missing levels
+// coarse to fine, at most UploadBudget bytes per frame. When the budget is
+// exceeded, levels finer than needed go first, least recently used textures
+// before the others.
+// With GL_ARB_sparse_texture the chain is allocated once and levels are
+// committed and decommitted, otherwise levels are redefined to an empty image
+// and the base level keeps the texture complete, the name never changes.
+class TextureStreamer{
+    public:
+        TextureStreamer() : enabled(false), budget(TEXTURE_STREAMING_BUDGET), uploadBudget(TEXTURE_STREAMING_UPLOAD_BUDGET),
+                            pageCommitment(NULL), frame(1), stats(TextureStreamingStats{}){}
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+        // Call on the GL thread after the loader ran, before any texture is created.
+        void Enable(size_t budget, GLADloadproc loader){
+            enabled = true;
+            this->budget = budget;
+            GLint extensions = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+            for (GLint i = 0; i < extensions && loader; i++){
+                if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_sparse_texture") == 0){
+                    pageCommitment = (PFNTEXPAGECOMMITMENTPROC) loader("glTexPageCommitmentARB");
+                }
+            }
+            std::cout << "TEXTURE::STREAMING budget " << budget / 1024 << " KiB, " << (pageCommitment ? "sparse textures" : "no sparse textures, levels are redefined") << std::endl;
+        }
+
+        bool Enabled() const{ return enabled; }
+
+        void SetUploadBudget(size_t bytes){ uploadBudget = bytes; }
+
+        // Takes a copy of the pixels and uploads the mip tail, the caller keeps owning its buffer.
+        // The chain is the load time box filter of GenerateBoxMips, on jobs when given; baked
+        // textures bring their filtered chain through AddLevels.
+        GpuResource Add(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int components, JobSystem* jobs = NULL){
+            PROFILE_ZONE("texture stream add");
+            StreamedTexture texture;
+            texture.Components = components;
+            texture.Format = components == 1 ? GL_RED : components == 4 ? GL_RGBA : GL_RGB;
+            texture.InternalFormat = components == 1 ? GL_R8 : components == 4 ? GL_RGBA8 : GL_RGB8;
+            texture.Compressed = false;
+            texture.Levels = GenerateBoxMips(pixels, width, height, components, jobs);
+            return add(std::move(texture));
+        }
+
+        // Takes over a ready mip chain, finest level first, such as the levels of a baked texture.
+        // The chain may stop short of 1x1.
+        GpuResource AddLevels(const Ktx2Format &format, std::vector<TextureLevel> &&levels){
+            PROFILE_ZONE("texture stream add");
+            StreamedTexture texture;
+            texture.Components = format.Compressed ? 0 : format.BlockBytes;
+            texture.Format = format.Format;
+            texture.InternalFormat = format.InternalFormat;
+            texture.Compressed = format.Compressed;
+            texture.Levels = std::move(levels);
+            return add(std::move(texture));
+        }
+
+        // uvPerPixel is how much of the texture's UV range one pixel covers where it is drawn,
+        // the smallest value of the frame decides. Textures that are not streamed are ignored.
+        void Request(unsigned int id, float uvPerPixel){
+            auto found = ids.find(id);
+            if (found == ids.end()) return;
+            StreamedTexture &texture = textures[found->second];
+            if (texture.RequestFrame != frame || uvPerPixel < texture.UvPerPixel) texture.UvPerPixel = uvPerPixel;
+            texture.RequestFrame = frame;
+        }
+
+        // Call once per frame on the GL thread, after the frame's requests.
+        void Update(){
+            PROFILE_ZONE("texture streaming");
+            stats.RequestedBytes = 0;
+            candidates.clear();
+            for (unsigned int i = 0; i < textures.size(); ){
+                StreamedTexture &texture = textures[i];
+                if (!GpuRegistry().IsValid(texture.Handle)){
+                    remove(i);
+                    continue;
+                }
+                texture.Target = texture.Tail;
+                if (texture.RequestFrame == frame){
+                    texture.LastUsed = frame;
+                    float texels = std::max(texture.Levels[0].Width, texture.Levels[0].Height) * texture.UvPerPixel;
+                    float level = texels > 1.0f ? std::floor(std::log2(texels)) : 0.0f;
+                    texture.Target = std::min((unsigned int)level, texture.Tail);
+                }
+                for (unsigned int level = texture.Target; level < texture.Levels.size(); level++){
+                    stats.RequestedBytes += levelBytes(texture, level);
+                }
+                if (texture.Resident > texture.Target) candidates.push_back(i);
+                i++;
+            }
+
+            // The textures missing the most levels first, each one coarse to fine.
+            std::sort(candidates.begin(), candidates.end(), [this](unsigned int a, unsigned int b){
+                return textures[a].Resident - textures[a].Target > textures[b].Resident - textures[b].Target;
+            });
+            size_t uploaded = 0;
+            bool overBudget = false;
+            for (unsigned int c = 0; c < candidates.size() && !overBudget; c++){
+                StreamedTexture &texture = textures[candidates[c]];
+                while (texture.Resident > texture.Target){
+                    size_t bytes = levelBytes(texture, texture.Resident - 1);
+                    if (uploaded && uploaded + bytes > uploadBudget) break;
+                    if (!makeRoom(bytes)){
+                        overBudget = true;
+                        break;
+                    }
+                    uploadLevel(texture);
+                    GpuRegistry().SetBytes(texture.Handle, texture.Bytes);
+                    uploaded += bytes;
+                    stats.Uploads++;
+                    stats.UploadedBytes += bytes;
+                    stats.ResidentBytes += bytes;
+                }
+            }
+            if (overBudget || stats.ResidentBytes > budget) stats.OverBudgetFrames++;
+            frame++;
+        }
+
+        const TextureStreamingStats& Stats() const{ return stats; }
+
+        void Report() const{
+            if (!enabled) return;
+            std::cout << "TEXTURE::STREAMING " << stats.Textures << " textures (" << stats.SparseTextures << " sparse), resident " << stats.ResidentBytes / 1024
+                      << " KiB, requested " << stats.RequestedBytes / 1024 << " KiB, budget " << budget / 1024 << " KiB, " << stats.Uploads << " levels uploaded ("
+                      << stats.UploadedBytes / 1024 << " KiB), " << stats.Evictions << " evicted, " << stats.OverBudgetFrames << " frames over budget" << std::endl;
+        }
+
+        // Drops the system memory copies, the textures themselves belong to their models.
+        void Clear(){
+            textures.clear();
+            ids.clear();
+            candidates.clear();
+        }
+
+    private:
+        struct StreamedTexture{
+            GpuHandle Handle;
+            unsigned int Id;
+            unsigned int Components;
+            GLenum Format;
+            GLenum InternalFormat;
+            bool Compressed;
+            bool Sparse;
+            std::vector<TextureLevel> Levels;
+            unsigned int Tail;
+            unsigned int Resident;
+            unsigned int Target;
+            unsigned long long LastUsed;
+            unsigned long long RequestFrame;
+            float UvPerPixel;
+            size_t Bytes;
+        };
+
+        bool enabled;
+        size_t budget, uploadBudget;
+        PFNTEXPAGECOMMITMENTPROC pageCommitment;
+        unsigned long long frame;
+        TextureStreamingStats stats;
+        std::vector<StreamedTexture> textures;
+        std::unordered_map<unsigned int, unsigned int> ids;
+        std::vector<unsigned int> candidates;
+
+        static size_t levelBytes(const StreamedTexture &texture, unsigned int level){
+            return texture.Levels[level].Pixels.size();
+        }
+
+        // Creates the texture with its tail resident and starts tracking it.
+        GpuResource add(StreamedTexture &&texture){
+            texture.Tail = 0;
+            while (texture.Tail + 1 < texture.Levels.size() && std::max(texture.Levels[texture.Tail].Width, texture.Levels[texture.Tail].Height) > TEXTURE_STREAMING_TAIL_SIZE){
+                texture.Tail++;
+            }
+
+            unsigned int id;
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            texture.Id = id;
+            texture.Sparse = createSparse(texture);
+            if (!texture.Sparse){
+                GLState().BindTexture(0, id);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.Levels.size() - 1);
+            }
+            glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            texture.Resident = texture.Levels.size();
+            texture.Target = texture.Tail;
+            texture.LastUsed = frame;
+            texture.RequestFrame = 0;
+            texture.UvPerPixel = 0.0f;
+            texture.Bytes = 0;
+            for (unsigned int level = texture.Levels.size(); level-- > texture.Tail; ) uploadLevel(texture);
+
+            GpuResource resource(GPU_TEXTURE, id, texture.Bytes, GPU_CATEGORY_TEXTURE);
+            texture.Handle = resource.Handle();
+            stats.ResidentBytes += texture.Bytes;
+            stats.Textures++;
+            stats.SparseTextures += texture.Sparse;
+
+            // GL only hands out a name again once the old texture is deleted, so an entry found here is dead.
+            auto found = ids.find(id);
+            if (found != ids.end()) remove(found->second);
+            ids[id] = textures.size();
+            textures.push_back(std::move(texture));
+            return resource;
+        }
+
+        // Sparse storage needs a format with virtual pages and a size that is a multiple of the page size.
+        bool createSparse(StreamedTexture &texture){
+            if (!pageCommitment) return false;
+            GLenum internalFormat = texture.InternalFormat;
+            GLint pageSizes = 0, pageX = 0, pageY = 0;
+            glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &pageSizes);
+            if (pageSizes <= 0) return false;
+            glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &pageX);
+            glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &pageY);
+            if (pageX <= 0 || pageY <= 0 || texture.Levels[0].Width % pageX || texture.Levels[0].Height % pageY) return false;
+
+            glTextureParameteri(texture.Id, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+            glTextureParameteri(texture.Id, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+            glTextureStorage2D(texture.Id, texture.Levels.size(), internalFormat, texture.Levels[0].Width, texture.Levels[0].Height);
+            // Levels past the sparse ones share the mip tail, which is committed as a whole.
+            GLint sparseLevels = 0;
+            glGetTextureParameteriv(texture.Id, GL_NUM_SPARSE_LEVELS_ARB, &sparseLevels);
+            texture.Tail = std::min(texture.Tail, (unsigned int)std::max(sparseLevels, 0));
+            return true;
+        }
+
+        void commit(const StreamedTexture &texture, unsigned int level, bool resident){
+            GLState().BindTexture(0, texture.Id);
+            pageCommitment(GL_TEXTURE_2D, level, 0, 0, 0, texture.Levels[level].Width, texture.Levels[level].Height, 1, resident ? GL_TRUE : GL_FALSE);
+        }
+
+        // Makes the next finer level resident.
+        void uploadLevel(StreamedTexture &texture){
+            unsigned int level = --texture.Resident;
+            const TextureLevel &image = texture.Levels[level];
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            if (texture.Sparse){
+                commit(texture, level, true);
+                if (texture.Compressed) glCompressedTextureSubImage2D(texture.Id, level, 0, 0, image.Width, image.Height, texture.InternalFormat, image.Pixels.size(), image.Pixels.data());
+                else glTextureSubImage2D(texture.Id, level, 0, 0, image.Width, image.Height, texture.Format, GL_UNSIGNED_BYTE, image.Pixels.data());
+            }else{
+                GLState().BindTexture(0, texture.Id);
+                if (texture.Compressed) glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.InternalFormat, image.Width, image.Height, 0, image.Pixels.size(), image.Pixels.data());
+                else glTexImage2D(GL_TEXTURE_2D, level, texture.Format, image.Width, image.Height, 0, texture.Format, GL_UNSIGNED_BYTE, image.Pixels.data());
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glTextureParameteri(texture.Id, GL_TEXTURE_BASE_LEVEL, level);
+            texture.Bytes += levelBytes(texture, level);
+        }
+
+        // Drops the finest resident level, never the tail.
+        void evictLevel(StreamedTexture &texture){
+            unsigned int level = texture.Resident++;
+            glTextureParameteri(texture.Id, GL_TEXTURE_BASE_LEVEL, texture.Resident);
+            if (texture.Sparse){
+                commit(texture, level, false);
+            }else{
+                GLState().BindTexture(0, texture.Id);
+                if (texture.Compressed) glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.InternalFormat, 0, 0, 0, 0, NULL);
+                else glTexImage2D(GL_TEXTURE_2D, level, texture.Format, 0, 0, 0, texture.Format, GL_UNSIGNED_BYTE, NULL);
+            }
+            texture.Bytes -= levelBytes(texture, level);
+            stats.ResidentBytes -= levelBytes(texture, level);
+            GpuRegistry().SetBytes(texture.Handle, texture.Bytes);
+            stats.Evictions++;
+        }
+
+        // Evicts levels finer than their texture needs, least recently used first, until bytes fit the budget.
+        bool makeRoom(size_t bytes){
+            while (stats.ResidentBytes + bytes > budget){
+                StreamedTexture* victim = NULL;
+                for (unsigned int i = 0; i < textures.size(); i++){
+                    StreamedTexture &texture = textures[i];
+                    if (texture.Resident >= texture.Target || texture.Resident >= texture.Tail) continue;
+                    if (!victim || texture.LastUsed < victim->LastUsed) victim = &texture;
+                }
+                if (!victim) return false;
+                evictLevel(*victim);
+            }
+            return true;
+        }
+
+        void remove(unsigned int index){
+            stats.ResidentBytes -= textures[index].Bytes;
+            stats.Textures--;
+            stats.SparseTextures -= textures[index].Sparse;
+            auto found = ids.find(textures[index].Id);
+            if (found != ids.end() && found->second == index) ids.erase(found);
+            if (index + 1 != textures.size()){
+                textures[index] = std::move(textures.back());
+                ids[textures[index].Id] = index;
+            }
+            textures.pop_back();
+        }
+};
+
+inline TextureStreamer& TextureStreaming(){
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+#endif
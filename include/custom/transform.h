@@ -0,0 +1,152 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <glm/glm.hpp>
+
+#include <custom/job_system.h>
+
+#include <vector>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+const unsigned int TRANSFORM_PARALLEL_THRESHOLD = 1024;
+
+// Flat scene graph in depth first order: a parent always precedes its
+// children and every subtree is the contiguous range [node, node + subtree size).
+// Dirty subtrees are recomputed as independent ranges, so they can be
+// processed in parallel while the rest of the array is left untouched.
+class TransformHierarchy{
+    public:
+        // Nodes have to be added in depth first order, i.e. the parent's subtree must end at the back of the array.
+        unsigned int AddNode(int parent, const glm::mat4 &local = glm::mat4(1.0f)){
+            unsigned int node = parents.size();
+            assert(parent < 0 || (unsigned int)parent + subtreeSizes[parent] == node);
+
+            parents.push_back(parent);
+            subtreeSizes.push_back(1);
+            locals.push_back(local);
+            worlds.push_back(local);
+            normals.push_back(glm::mat3(1.0f));
+            dirty.push_back(1);
+
+            for (int p = parent; p >= 0; p = parents[p]){
+                subtreeSizes[p]++;
+            }
+            return node;
+        }
+
+        void SetLocal(unsigned int node, const glm::mat4 &local){
+            locals[node] = local;
+            dirty[node] = 1;
+        }
+
+        const glm::mat4& GetLocal(unsigned int node) const{ return locals[node]; }
+        const glm::mat4& GetWorld(unsigned int node) const{ return worlds[node]; }
+        const glm::mat3& GetNormal(unsigned int node) const{ return normals[node]; }
+        int GetParent(unsigned int node) const{ return parents[node]; }
+
+        const glm::mat4* Worlds() const{ return worlds.data(); }
+        const glm::mat3* Normals() const{ return normals.data(); }
+        unsigned int Size() const{ return parents.size(); }
+
+        static glm::mat3 NormalMatrix(const glm::mat4 &m){
+            glm::mat3 normal;
+            normalMatrix(m, normal);
+            return normal;
+        }
+
+        unsigned int Update(JobSystem &jobs){
+            unsigned int recomputed = collectRanges();
+            if (!recomputed) return 0;
+
+            unsigned int grain = recomputed >= TRANSFORM_PARALLEL_THRESHOLD ? 1 : ranges.size();
+            jobs.ParallelFor(ranges.size(), grain, [this](unsigned int begin, unsigned int end){
+                for (unsigned int r = begin; r < end; r++){
+                    updateRange(ranges[r], ranges[r] + subtreeSizes[ranges[r]]);
+                }
+            });
+            return recomputed;
+        }
+
+        // Serial, for the small hierarchies of single models. Returns the number of nodes that were recomputed.
+        unsigned int Update(){
+            unsigned int recomputed = collectRanges();
+            for (unsigned int r = 0; r < ranges.size(); r++){
+                updateRange(ranges[r], ranges[r] + subtreeSizes[ranges[r]]);
+            }
+            return recomputed;
+        }
+
+    private:
+        std::vector<int> parents;
+        std::vector<unsigned int> subtreeSizes;
+        std::vector<glm::mat4> locals;
+        std::vector<glm::mat4> worlds;
+        std::vector<glm::mat3> normals;
+        std::vector<unsigned char> dirty;
+        std::vector<unsigned int> ranges;
+
+        unsigned int collectRanges(){
+            ranges.clear();
+            unsigned int recomputed = 0;
+            for (unsigned int i = 0; i < parents.size(); ){
+                if (dirty[i]){
+                    ranges.push_back(i);
+                    recomputed += subtreeSizes[i];
+                    i += subtreeSizes[i];
+                }else{
+                    i++;
+                }
+            }
+            return recomputed;
+        }
+
+        // The parent of begin lies outside the range and is already up to date.
+        void updateRange(unsigned int begin, unsigned int end){
+            for (unsigned int i = begin; i < end; i++){
+                if (parents[i] < 0) worlds[i] = locals[i];
+                else multiply(worlds[parents[i]], locals[i], worlds[i]);
+
+                normalMatrix(worlds[i], normals[i]);
+                dirty[i] = 0;
+            }
+        }
+
+        static void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out){
+#ifdef TRANSFORM_SSE
+            __m128 a0 = _mm_loadu_ps(&a[0][0]);
+            __m128 a1 = _mm_loadu_ps(&a[1][0]);
+            __m128 a2 = _mm_loadu_ps(&a[2][0]);
+            __m128 a3 = _mm_loadu_ps(&a[3][0]);
+            for (int j = 0; j < 4; j++){
+                __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[j][0]));
+                r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+                r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j][2])));
+                r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j][3])));
+                _mm_storeu_ps(&out[j][0], r);
+            }
+#else
+            out = a * b;
+#endif
+        }
+
+        // Inverse transpose of the upper 3x3 through its cofactors, avoiding a full glm::inverse per node.
+        static void normalMatrix(const glm::mat4 &m, glm::mat3 &out){
+            glm::vec3 c0(m[0]), c1(m[1]), c2(m[2]);
+            glm::vec3 r0 = glm::cross(c1, c2);
+            glm::vec3 r1 = glm::cross(c2, c0);
+            glm::vec3 r2 = glm::cross(c0, c1);
+            float det = glm::dot(c0, r0);
+            float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+            out[0] = r0 * invDet;
+            out[1] = r1 * invDet;
+            out[2] = r2 * invDet;
+        }
+};
+
+#endif
@@ -9,128 +9,703 @@
 #include <custom/shader.h>
 #include <custom/camera.h>
 #include <custom/model.h>
+#include <custom/frame.h>
+#include <custom/gpu_profiler.h>
+#include <custom/headless.h>
+#include <custom/benchmark.h>
+#include <custom/input.h>
+#include <custom/scene.h>
+#include <custom/scene_resources.h>
+#include <custom/streaming.h>
 
 #include <iostream>
 #include <string.h>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <cstdio>
 
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height); 
-void processInput(GLFWwindow *window);
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void processInput();
+void applyMouse(double xpos, double ypos);
+void applyScroll(double xoffset, double yoffset);
+void applyResize(int width, int height);
+void renderLoop(GLFWwindow* window, HeadlessContext* context, FrameMailbox &mailbox, std::promise<std::vector<AABB>> &sceneReady);
 
 const unsigned int WINDOW_WIDTH = 1280;
 const unsigned int WINDOW_HEIGHT = 720;
+const unsigned int ALLOC_CHECK_FRAMES = 120;
+const unsigned int PROFILE_COLLECT_FRAMES = 60;
+const unsigned int HEADLESS_FRAMES = 300;
+const char* const DEFAULT_SCENE = "resource/backpack/backpack.obj";
+const float BENCHMARK_ORBIT_SECONDS = 10.0f;
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 float lastx = WINDOW_WIDTH/2.0f;
 float lasty = WINDOW_HEIGHT/2.0f;
 bool firstMouse = true;
+unsigned int resolutionWidth = WINDOW_WIDTH;
+unsigned int resolutionHeight = WINDOW_HEIGHT;
+unsigned int framebufferWidth = WINDOW_WIDTH;
+unsigned int framebufferHeight = WINDOW_HEIGHT;
+float aspect = (float)WINDOW_WIDTH/(float)WINDOW_HEIGHT;
+bool headless = false;
+unsigned int frameLimit = 0;
+unsigned int allocCheckFrames = 0;
+const char* scenePath = DEFAULT_SCENE;
+SceneDescription scene;
+const char* outputPath = NULL;
+const char* tracePath = NULL;
+bool benchmark = false;
+unsigned int warmupFrames = BENCHMARK_WARMUP_FRAMES;
+const char* cameraPathFile = NULL;
+const char* jsonPath = NULL;
+const char* csvPath = NULL;
+const char* baselinePath = NULL;
+double tolerance = BENCHMARK_TOLERANCE;
+std::atomic<bool> benchmarkRegressed(false);
+CameraPath cameraPath;
+const char* recordPath = NULL;
+const char* replayPath = NULL;
+InputLayer input;
+bool quit = false;
+std::atomic<unsigned long long> steadyStateAllocations(0);
+bool streamed = false;
+StreamingSettings streamingSettings;
+std::unique_ptr<StreamingGrid> streamingGrid;
+StreamingBounds streamingBounds;
+size_t textureBudget = 0;
+std::vector<const char*> occluderArgs;
+std::vector<bool> occluders;
+bool gpuCulling = false;
 
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-int main(){
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  
-
-    GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "OpenGL", NULL, NULL);  
-    if (window == NULL){    
-        std::cout <<"Failed to create GLFW window"<< std::endl;
-        glfwTerminate();
+int main(int argc, char** argv){
+    // --headless renders into an offscreen framebuffer through EGL, no display or GPU needed.
+    // --scene <path> loads another model or a .scene or binary scene file (see scene.h, bench/scene_gen.cpp), --resolution <width>x<height> sets the window or framebuffer size.
+    // --frames <count> stops after that many frames, headless runs default to HEADLESS_FRAMES.
+    // --output <path> writes the last headless frame as a PPM image.
+    // --alloc-check [frames] renders the scene headless and fails if a frame after the warmup allocates.
+    // --trace [path] writes the profiler zones of the whole run as a Chrome trace.
+    // --benchmark [camera path] flies the camera along a scripted path with a fixed timestep, an orbit around the scene by default.
+    // --warmup <frames> are left out of the benchmark statistics, --json/--csv <path> write them.
+    // --baseline <json> fails the run when a timing grew by more than --tolerance <percent> against an earlier --json report.
+    // --record <log> writes every input event and frame delta time, --replay <log> feeds them back instead of the window.
+    // --stream loads the objects of the scene cell by cell around the camera, --stream-cell <size> and --stream-radius <distance>
+    // set the grid and how far ahead it loads, --stream-budget <KiB> the uploads per frame and --stream-cap <MiB> the resident memory.
+    // --texture-budget <MiB> streams the mip levels of model textures by their on screen size under that much texture memory.
+    // --occluder <object|all> rasterizes the instances of that object (models first, then procedural meshes, counted from 0)
+    // into the software occlusion buffer, may be repeated.
+    // --gpu-culling culls every instance of the scene in compute shaders against a Hi-Z pyramid and draws them indirectly.
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--headless") == 0){
+            headless = true;
+        }else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc){
+            scenePath = argv[++i];
+        }else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc){
+            if (sscanf(argv[++i], "%ux%u", &resolutionWidth, &resolutionHeight) != 2 || !resolutionWidth || !resolutionHeight){
+                std::cout << "ERROR::ARGS::INVALID_RESOLUTION " << argv[i] << ", expected <width>x<height>" << std::endl;
+                return -1;
+            }
+        }else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc){
+            frameLimit = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc){
+            outputPath = argv[++i];
+        }else if (strcmp(argv[i], "--alloc-check") == 0){
+            allocCheckFrames = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : ALLOC_CHECK_FRAMES;
+            headless = true;
+            frameLimit = allocCheckFrames;
+        }else if (strcmp(argv[i], "--trace") == 0){
+            tracePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "trace.json";
+        }else if (strcmp(argv[i], "--benchmark") == 0){
+            benchmark = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') cameraPathFile = argv[++i];
+        }else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc){
+            warmupFrames = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc){
+            jsonPath = argv[++i];
+        }else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc){
+            csvPath = argv[++i];
+        }else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc){
+            baselinePath = argv[++i];
+        }else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc){
+            tolerance = atof(argv[++i]) / 100.0;
+        }else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+            recordPath = argv[++i];
+        }else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+            replayPath = argv[++i];
+        }else if (strcmp(argv[i], "--stream") == 0){
+            streamed = true;
+        }else if (strcmp(argv[i], "--stream-cell") == 0 && i + 1 < argc){
+            streamingSettings.CellSize = std::max(0.01f, (float)atof(argv[++i]));
+        }else if (strcmp(argv[i], "--stream-radius") == 0 && i + 1 < argc){
+            streamingSettings.Radius = atof(argv[++i]);
+        }else if (strcmp(argv[i], "--stream-budget") == 0 && i + 1 < argc){
+            streamingSettings.UploadBudget = (size_t)atoi(argv[++i]) << 10;
+        }else if (strcmp(argv[i], "--stream-cap") == 0 && i + 1 < argc){
+            streamingSettings.MemoryCap = (size_t)atoi(argv[++i]) << 20;
+        }else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc){
+            textureBudget = (size_t)std::max(1, atoi(argv[++i])) << 20;
+        }else if (strcmp(argv[i], "--occluder") == 0 && i + 1 < argc){
+            occluderArgs.push_back(argv[++i]);
+        }else if (strcmp(argv[i], "--gpu-culling") == 0){
+            gpuCulling = true;
+        }else{
+            std::cout << "ERROR::ARGS::UNKNOWN_ARGUMENT " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    std::string sceneFile(scenePath);
+    bool textScene = sceneFile.size() > 6 && sceneFile.compare(sceneFile.size() - 6, 6, ".scene") == 0;
+    if (textScene || MappedScene::IsBinary(sceneFile)){
+        if (!scene.Load(sceneFile)) return -1;
+    }else{
+        scene = SceneDescription::FromModel(sceneFile);
+    }
+    unsigned int pointLights = 0, spotLights = 0;
+    for (unsigned int i = 0; i < scene.Lights.size(); i++){
+        unsigned int &count = scene.Lights[i].Type == LIGHT_POINT ? pointLights : spotLights;
+        count++;
+    }
+    // One spot light slot is the camera's.
+    if (pointLights > SCENE_MAX_POINT_LIGHTS || spotLights + 1 > SCENE_MAX_SPOT_LIGHTS){
+        std::cout << "ERROR::SCENE::TOO_MANY_LIGHTS " << pointLights << " point and " << spotLights << " spot lights, using the first "
+                  << SCENE_MAX_POINT_LIGHTS << " and " << SCENE_MAX_SPOT_LIGHTS - 1 << std::endl;
+    }
+    occluders.assign(scene.ObjectCount(), false);
+    for (unsigned int i = 0; i < occluderArgs.size(); i++){
+        char* end;
+        unsigned long object = strtoul(occluderArgs[i], &end, 10);
+        if (strcmp(occluderArgs[i], "all") == 0){
+            occluders.assign(scene.ObjectCount(), true);
+        }else if (end != occluderArgs[i] && *end == '\0' && object < scene.ObjectCount()){
+            occluders[object] = true;
+        }else{
+            std::cout << "ERROR::ARGS::INVALID_OCCLUDER " << occluderArgs[i] << ", expected all or an object below " << scene.ObjectCount() << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "SCENE::LOADED " << scene.Models.size() << " models, " << scene.Meshes.size() << " meshes, " << scene.Materials.size()
+              << " materials, " << scene.Instances.size() << " instances, " << pointLights << " point and " << spotLights << " spot lights" << std::endl;
+
+    if (benchmark){
+        if (cameraPathFile && !cameraPath.Load(cameraPathFile)) return -1;
+        float duration = cameraPathFile ? cameraPath.Duration() : BENCHMARK_ORBIT_SECONDS;
+        if (!frameLimit) frameLimit = warmupFrames + (unsigned int)std::ceil(duration / BENCHMARK_TIMESTEP) + 1;
+    }else if (jsonPath || csvPath || baselinePath){
+        std::cout << "ERROR::ARGS::REPORT_NEEDS_BENCHMARK use --json, --csv and --baseline together with --benchmark" << std::endl;
         return -1;
     }
-
-    glfwMakeContextCurrent(window); 
-
-
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)){ 
-        std::cout << "Failed to initialize GLAD" << std::endl;
+    if ((recordPath || replayPath) && benchmark){
+        std::cout << "ERROR::ARGS::INPUT_LOG_WITH_BENCHMARK benchmarks script the camera, drop --record/--replay" << std::endl;
+        return -1;
+    }
+    if (recordPath && (headless || replayPath)){
+        std::cout << "ERROR::ARGS::RECORD_NEEDS_WINDOW --record captures live window input" << std::endl;
+        return -1;
+    }
+    input.SetHandlers(InputHandlers{applyMouse, applyScroll, applyResize});
+    if (recordPath && !input.Record(recordPath)) return -1;
+    if (replayPath){
+        if (!input.Replay(replayPath)) return -1;
+        if (!frameLimit) frameLimit = input.ReplayFrames();
+    }
+    if (headless && !frameLimit) frameLimit = HEADLESS_FRAMES;
+    if (outputPath && !headless){
+        std::cout << "ERROR::ARGS::OUTPUT_NEEDS_HEADLESS use --output together with --headless" << std::endl;
+        return -1;
+    }
+    if (allocCheckFrames && !AllocTracker::Enabled()){
+        std::cout << "ERROR::ALLOC::TRACKING_DISABLED build with -DALLOC_TRACKING to use --alloc-check" << std::endl;
+        return -1;
+    }
+    if (streamed && allocCheckFrames){
+        std::cout << "ERROR::ARGS::STREAM_WITH_ALLOC_CHECK streaming loads allocate, drop --stream or --alloc-check" << std::endl;
+        return -1;
+    }
+    if (streamed && gpuCulling){
+        std::cout << "ERROR::ARGS::STREAM_WITH_GPU_CULLING the GPU culler needs every object resident, drop --stream or --gpu-culling" << std::endl;
         return -1;
     }
+    if (streamed) streamingGrid.reset(new StreamingGrid(scene, streamingSettings.CellSize));
+    if (tracePath && !Profiler::Enabled()){
+        std::cout << "ERROR::PROFILER::DISABLED build with -DPROFILING to use --trace" << std::endl;
+        return -1;
+    }
+    PROFILE_THREAD("main");
+
+    framebufferWidth = resolutionWidth;
+    framebufferHeight = resolutionHeight;
+
+    GLFWwindow* window = NULL;
+    std::unique_ptr<HeadlessContext> context;
+    if (headless){
+        context.reset(new HeadlessContext());
+        if (!context->Valid()) return -1;
+    }else{
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  
+
+        window = glfwCreateWindow(resolutionWidth, resolutionHeight, "OpenGL", NULL, NULL);  
+        if (window == NULL){    
+            std::cout <<"Failed to create GLFW window"<< std::endl;
+            glfwTerminate();
+            return -1;
+        }
+
+        if (!replayPath) glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        if (!benchmark && !replayPath){
+            glfwSetKeyCallback(window, key_callback);
+            glfwSetCursorPosCallback(window, mouse_callback);
+            glfwSetScrollCallback(window, scroll_callback);
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        }
+    }
 
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);  
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    FrameMailbox mailbox;
+    std::promise<std::vector<AABB>> sceneReady;
+    std::future<std::vector<AABB>> sceneFuture = sceneReady.get_future();
+    std::thread renderer(renderLoop, window, context.get(), std::ref(mailbox), std::ref(sceneReady));
 
-    glEnable(GL_DEPTH_TEST);
+    while (sceneFuture.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready){
+        if (window) glfwPollEvents();
+    }
+    std::vector<AABB> sceneBounds = sceneFuture.get();
+
+    // Instances do not move, their transforms and world bounds are computed once. Streamed models
+    // report their bounds when they are loaded, until then their instances are never culled.
+    std::vector<glm::mat4> transforms;
+    std::vector<AABB> instanceBounds;
+    std::vector<unsigned int> instanceCells;
+    std::vector<bool> knownBounds(sceneBounds.size(), true);
+    std::vector<std::pair<unsigned int, AABB>> loadedBounds;
+    transforms.reserve(scene.Instances.size());
+    instanceBounds.reserve(scene.Instances.size());
+    instanceCells.reserve(scene.Instances.size());
+    for (unsigned int i = 0; i < scene.Models.size() && streamingGrid && !sceneBounds.empty(); i++) knownBounds[i] = false;
+    for (unsigned int i = 0; i < scene.Instances.size() && !sceneBounds.empty(); i++){
+        transforms.push_back(InstanceTransform(scene.Instances[i]));
+        instanceBounds.push_back(TransformAABB(sceneBounds[scene.Instances[i].Object], transforms.back()));
+        instanceCells.push_back(streamingGrid ? streamingGrid->InstanceCell(i) : 0);
+    }
 
-    stbi_set_flip_vertically_on_load(true);
+    std::vector<PointLightState> scenePointLights;
+    std::vector<SpotLightState> sceneSpotLights;
+    for (unsigned int i = 0; i < scene.Lights.size(); i++){
+        const SceneLight &light = scene.Lights[i];
+        if (light.Type == LIGHT_POINT && scenePointLights.size() < SCENE_MAX_POINT_LIGHTS){
+            scenePointLights.push_back(PointLightState{light.Position, light.Color});
+        }else if (light.Type == LIGHT_SPOT && sceneSpotLights.size() + 1 < SCENE_MAX_SPOT_LIGHTS){
+            sceneSpotLights.push_back(SpotLightState{light.Position, glm::normalize(light.Direction), light.Color});
+        }
+    }
 
-    Shader objectShader("src/shaders/object_vert.glsl", "src/shaders/object_frag.glsl");
-    Shader lightingShader("src/shaders/lighting_vert.glsl", "src/shaders/lighting_frag.glsl");
-    
-    Model backpack("C:/Users/jonat/OneDrive/Documenten/Code/C/opengl/resource/backpack/backpack.obj");
+    if (benchmark && !cameraPathFile){
+        AABB bounds = {glm::vec3(-1.0f), glm::vec3(1.0f)};
+        for (unsigned int i = 0; i < instanceBounds.size(); i++){
+            bounds.Min = i ? glm::min(bounds.Min, instanceBounds[i].Min) : instanceBounds[i].Min;
+            bounds.Max = i ? glm::max(bounds.Max, instanceBounds[i].Max) : instanceBounds[i].Max;
+        }
+        float radius = glm::length(bounds.Max - bounds.Min);
+        cameraPath = CameraPath::Orbit((bounds.Min + bounds.Max) * 0.5f, radius, radius * 0.3f, BENCHMARK_ORBIT_SECONDS);
+    }
 
-    while(!glfwWindowShouldClose(window)){
-        float currentFrame = glfwGetTime();
+    unsigned long long frame = 0;
+    glm::vec3 previousPosition = camera.Position;
+    while(!quit && (!window || !glfwWindowShouldClose(window)) && (!frameLimit || frame < frameLimit)){
+        if (window) glfwPollEvents();
+
+        // Benchmarks step a fixed time per frame, so every run sees the same camera in the same frame.
+        float currentFrame = benchmark ? frame * BENCHMARK_TIMESTEP : FrameTimeMs() / 1000.0;
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        if (!benchmark){
+            deltaTime = input.Frame(deltaTime);
+            if (input.Finished()) break;
+        }
+
+        FramePacket* packet = mailbox.BeginWrite();
+        if (!packet) break;
+        PROFILE_ZONE("simulation");
+        packet->SimulationBegin = FrameTimeMs();
+        ThreadFrameArena().Reset();
+        ALLOC_SCOPE(ALLOC_SIMULATION);
+        FRAME_NO_HEAP_ALLOCATIONS("simulation frame", frame >= FRAME_ARENA_WARMUP_FRAMES);
+
+        if (benchmark) cameraPath.Sample(frame > warmupFrames ? (frame - warmupFrames) * BENCHMARK_TIMESTEP : 0.0f, camera);
+        else processInput();
+
+        if (framebufferHeight > 0) aspect = (float)framebufferWidth / (float)framebufferHeight;
+        packet->Frame = frame++;
+        packet->Width = framebufferWidth;
+        packet->Height = framebufferHeight;
+        packet->View = camera.GetViewMatrix();
+        packet->Projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+        packet->ViewVelocity = deltaTime > 0.0f ? (camera.Position - previousPosition) / deltaTime : glm::vec3(0.0f);
+        previousPosition = camera.Position;
+        packet->ViewPos = camera.Position;
+
+        packet->PointLights.assign(scenePointLights.begin(), scenePointLights.end());
+        packet->SpotLights.clear();
+        packet->SpotLights.push_back(SpotLightState{camera.Position, camera.Front, glm::vec3(1.0f)});
+        packet->SpotLights.insert(packet->SpotLights.end(), sceneSpotLights.begin(), sceneSpotLights.end());
+
+        if (streamingGrid && streamingBounds.Take(loadedBounds)){
+            for (unsigned int i = 0; i < loadedBounds.size(); i++){
+                unsigned int object = loadedBounds[i].first, count;
+                const unsigned int* instances = streamingGrid->ObjectInstances(object, count);
+                for (unsigned int j = 0; j < count; j++){
+                    instanceBounds[instances[j]] = TransformAABB(loadedBounds[i].second, transforms[instances[j]]);
+                }
+                knownBounds[object] = true;
+            }
+        }
+
+        glm::mat4 viewProjection = packet->Projection * packet->View;
+        packet->Draws.clear();
+        {
+            PROFILE_ZONE("frustum cull");
+            PERF_PHASE("cull");
+            for (unsigned int i = 0; i < instanceBounds.size(); i++){
+                unsigned int object = scene.Instances[i].Object;
+                if (!knownBounds[object] || FrustumVisible(viewProjection, instanceBounds[i])){
+                    packet->Draws.push_back(DrawItem{object, instanceCells[i], transforms[i]});
+                }
+            }
+        }
+
+        packet->SimulationEnd = FrameTimeMs();
+        mailbox.Publish();
+    }
 
-        processInput(window);
+    mailbox.Close();
+    renderer.join();
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
+    if (window) glfwTerminate();    
+    context.reset();
 
-        objectShader.use();
-        
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
+    if (tracePath) Profiler::WriteChromeTrace(tracePath);
+    PerfPhaseTable().Report();
+
+    if (allocCheckFrames){
+        AllocTracker::Report();
+        if (steadyStateAllocations.load()){
+            std::cout << "ERROR::ALLOC::STEADY_STATE " << steadyStateAllocations.load() << " allocations after "
+                      << FRAME_ARENA_WARMUP_FRAMES << " warmup frames" << std::endl;
+            return 1;
+        }
+        std::cout << "ALLOC::STEADY_STATE no allocations in " << allocCheckFrames - FRAME_ARENA_WARMUP_FRAMES << " frames" << std::endl;
+    }
+    if (benchmarkRegressed.load()) return 1;
+    return 0;
+}
 
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)WINDOW_WIDTH/(float)WINDOW_HEIGHT, 0.1f, 100.0f);
-        glm::mat3 normalMat = glm::mat3(glm::transpose(glm::inverse(model)));
+// Owns the GL context: loads the scene, then draws every packet the simulation publishes.
+void renderLoop(GLFWwindow* window, HeadlessContext* context, FrameMailbox &mailbox, std::promise<std::vector<AABB>> &sceneReady){
+    PROFILE_THREAD("render");
+    if (window) glfwMakeContextCurrent(window); 
+    else context->MakeCurrent();
 
-        objectShader.setMat4("projection", projection);
-        objectShader.setMat4("view", view);        
-        objectShader.setMat4("model", model);
-        objectShader.setMat3("normalMat", normalMat);
+    if (!gladLoadGLLoader(window ? (GLADloadproc) glfwGetProcAddress : HeadlessContext::Loader())){ 
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        mailbox.Close();
+        sceneReady.set_value(std::vector<AABB>());
+        return;
+    }
+    if (context) std::cout << "HEADLESS::CONTEXT " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER) << std::endl;
 
-        objectShader.setDirectionalLight("dirLight");
-        objectShader.setPointLight("pointLights[0]", glm::vec3(0.0f, 0.0f, 3.0f));
-        objectShader.setSpotLight("spotLights[0]", camera.Position, camera.Front);
-        objectShader.setVec3("viewPos", camera.Position);
+    GLState().Viewport(0, 0, resolutionWidth, resolutionHeight);
+    GLState().Enable(GL_DEPTH_TEST);
+    if (textureBudget) TextureStreaming().Enable(textureBudget, window ? (GLADloadproc) glfwGetProcAddress : HeadlessContext::Loader());
 
-        backpack.Draw(objectShader);
+    stbi_set_flip_vertically_on_load(true);
 
-        glfwSwapBuffers(window);    
-        glfwPollEvents();   
+    {
+        Shader objectShader("src/shaders/object_vert.glsl", "src/shaders/object_frag.glsl");
+        Shader lightingShader("src/shaders/lighting_vert.glsl", "src/shaders/lighting_frag.glsl");
+        Shader culledShader("src/shaders/object_culled_vert.glsl", "src/shaders/object_frag.glsl");
+        
+        JobSystem jobs;
+        SceneResources resources(scene, jobs, streamingGrid != nullptr, occluders);
+        std::vector<std::unique_ptr<Model>> &objects = resources.Objects;
+        std::unique_ptr<StreamingManager> streaming;
+        if (streamingGrid) streaming.reset(new StreamingManager(*streamingGrid, resources, jobs, streamingSettings, &streamingBounds));
+
+        size_t geometryBytes = resources.GeometryBytes();
+        size_t residentLoaded = AllocTracker::ResidentBytes();
+        resources.ReleaseGeometry();
+        std::cout << "MODEL::MEMORY released " << (geometryBytes - resources.GeometryBytes()) / 1024 << " KiB of CPU geometry, resident "
+                  << residentLoaded / 1024 << " KiB -> " << AllocTracker::ResidentBytes() / 1024 << " KiB" << std::endl;
+
+        OcclusionCuller culler;
+        std::unique_ptr<GpuCuller> gpuCuller;
+        if (gpuCulling){
+            gpuCuller.reset(new GpuCuller(resolutionWidth, resolutionHeight));
+            std::vector<const std::vector<Mesh>*> meshes;
+            std::vector<std::vector<glm::mat4>> meshTransforms;
+            for (unsigned int i = 0; i < objects.size(); i++){
+                meshes.push_back(objects[i] ? &objects[i]->GetMeshes() : NULL);
+                meshTransforms.push_back(objects[i] ? objects[i]->GetMeshTransforms() : std::vector<glm::mat4>());
+            }
+            std::vector<glm::mat4> transforms;
+            std::vector<unsigned int> instanceObjects;
+            for (unsigned int i = 0; i < scene.Instances.size(); i++){
+                transforms.push_back(InstanceTransform(scene.Instances[i]));
+                instanceObjects.push_back(scene.Instances[i].Object);
+            }
+            gpuCuller->SetInstances(meshes, meshTransforms, transforms, instanceObjects);
+        }
+
+        sceneReady.set_value(resources.Bounds());
+        GpuRegistry().Report();
+
+        DrawProgram objectProgram(objectShader);
+        std::vector<CommandBuffer> commandBuffers(jobs.WorkerCount());
+
+        FrameTimeline timeline;
+        GpuProfiler gpuProfiler;
+        unsigned int width = resolutionWidth;
+        unsigned int height = resolutionHeight;
+
+        std::unique_ptr<OffscreenTarget> offscreen;
+        if (context){
+            offscreen.reset(new OffscreenTarget(width, height));
+            offscreen->Bind();
+        }
+
+        std::vector<std::string> pointLightNames, spotLightNames;
+        for (unsigned int i = 0; i < SCENE_MAX_POINT_LIGHTS; i++) pointLightNames.push_back("pointLights[" + std::to_string(i) + "]");
+        for (unsigned int i = 0; i < SCENE_MAX_SPOT_LIGHTS; i++) spotLightNames.push_back("spotLights[" + std::to_string(i) + "]");
+
+        std::unique_ptr<BenchmarkRecorder> recorder;
+        if (benchmark) recorder.reset(new BenchmarkRecorder(warmupFrames, frameLimit));
+        double previousBegin = -1.0;
+
+        // Streamed draws wait until every object of their cell is uploaded, so cells appear at once.
+        auto drawable = [&](const DrawItem &draw){
+            return objects[draw.Object] && (!streaming || streaming->CellResident(draw.Cell));
+        };
+
+        while (const FramePacket* frame = mailbox.Acquire()){
+            // Draining the rings allocates, so it happens before the frame's allocation check starts.
+            if (frame->Frame % PROFILE_COLLECT_FRAMES == 0){
+                gpuProfiler.FlushToTrace();
+                PROFILE_COLLECT();
+            }
+            if (streaming) streaming->Update(frame->ViewPos, frame->ViewVelocity);
+            if (TextureStreaming().Enabled()){
+                PROFILE_ZONE("texture requests");
+                float pixelScale = frame->Height * 0.5f * frame->Projection[1][1];
+                for (unsigned int i = 0; i < frame->Draws.size(); i++){
+                    if (drawable(frame->Draws[i])) objects[frame->Draws[i].Object]->RequestTextures(TextureStreaming(), frame->Draws[i].Transform, frame->ViewPos, pixelScale);
+                }
+                TextureStreaming().Update();
+            }
+
+            PROFILE_ZONE("render frame");
+            double renderBegin = FrameTimeMs();
+            ThreadFrameArena().Reset();
+            AllocTracker::BeginFrame();
+            ALLOC_SCOPE(ALLOC_RENDER);
+            FRAME_NO_HEAP_ALLOCATIONS("render frame", frame->Frame >= FRAME_ARENA_WARMUP_FRAMES);
+            jobs.PumpMainThread();
+            gpuProfiler.BeginFrame();
+            for (unsigned int i = 0; recorder && i < gpuProfiler.ReadCount(); i++){
+                recorder->RecordGpu(gpuProfiler.ReadFrame(i).Frame, gpuProfiler.ReadFrame(i).Ms);
+            }
+
+            if ((frame->Width != width || frame->Height != height) && frame->Width && frame->Height){
+                width = frame->Width;
+                height = frame->Height;
+                GLState().Viewport(0, 0, width, height);
+                if (gpuCuller) gpuCuller->Resize(width, height);
+                if (offscreen){
+                    offscreen->Resize(width, height);
+                    offscreen->Bind();
+                }
+            }
+
+            {
+                GPU_PROFILE_SCOPE(gpuProfiler, "clear");
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+
+            Shader &shader = gpuCuller ? culledShader : objectShader;
+            shader.use();
+            shader.setMat4("projection", frame->Projection);
+            shader.setMat4("view", frame->View);        
+
+            shader.setDirectionalLight("dirLight");
+            shader.setInt("pointLightCount", frame->PointLights.size());
+            shader.setInt("spotLightCount", frame->SpotLights.size());
+            for (unsigned int i = 0; i < frame->PointLights.size(); i++){
+                const glm::vec3 &color = frame->PointLights[i].Color;
+                shader.setPointLight(pointLightNames[i].c_str(), frame->PointLights[i].Position, glm::vec3(0.05f), color * 0.8f, color);
+            }
+            for (unsigned int i = 0; i < frame->SpotLights.size(); i++){
+                const glm::vec3 &color = frame->SpotLights[i].Color;
+                shader.setSpotLight(spotLightNames[i].c_str(), frame->SpotLights[i].Position, frame->SpotLights[i].Direction, glm::vec3(0.05f), color * 0.8f, color);
+            }
+            shader.setVec3("viewPos", frame->ViewPos);
+
+            gpuProfiler.Begin("opaque");
+            if (gpuCuller){
+                {
+                    GPU_PROFILE_SCOPE(gpuProfiler, "cull early");
+                    gpuCuller->CullEarly(frame->Projection * frame->View);
+                }
+                for (unsigned int i = 0; i < objects.size(); i++){
+                    if (objects[i]) objects[i]->DrawCulled(culledShader, *gpuCuller, 0, i);
+                }
+                {
+                    GPU_PROFILE_SCOPE(gpuProfiler, "hi-z");
+                    gpuCuller->BuildHiZ();
+                }
+                {
+                    GPU_PROFILE_SCOPE(gpuProfiler, "cull late");
+                    gpuCuller->CullLate();
+                }
+                for (unsigned int i = 0; i < objects.size(); i++){
+                    if (objects[i]) objects[i]->DrawCulled(culledShader, *gpuCuller, 1, i);
+                }
+                {
+                    GPU_PROFILE_SCOPE(gpuProfiler, "hi-z rebuild");
+                    gpuCuller->EndFrame();
+                }
+            }else{
+                culler.BeginFrame(frame->Projection * frame->View);
+                for (unsigned int i = 0; i < frame->Draws.size(); i++){
+                    if (drawable(frame->Draws[i])) objects[frame->Draws[i].Object]->SubmitOccluders(culler, frame->Draws[i].Transform);
+                }
+                culler.Rasterize(jobs);
+
+                unsigned int grain = std::max(1u, (unsigned int)((frame->Draws.size() + commandBuffers.size() - 1) / commandBuffers.size()));
+                {
+                    PROFILE_ZONE("record commands");
+                    jobs.ParallelFor(frame->Draws.size(), grain, [&](unsigned int begin, unsigned int end){
+                        CommandBuffer &commands = commandBuffers[begin / grain];
+                        for (unsigned int i = begin; i < end; i++){
+                            if (!drawable(frame->Draws[i])) continue;
+                            objects[frame->Draws[i].Object]->Record(commands, objectProgram, frame->Draws[i].Transform, &culler);
+                        }
+                    });
+                }
+                for (unsigned int i = 0; i < commandBuffers.size(); i++){
+                    commandBuffers[i].Execute();
+                    commandBuffers[i].Reset();
+                }
+            }
+            gpuProfiler.End();
+            gpuProfiler.EndFrame();
+
+            {
+                PROFILE_ZONE("swap buffers");
+                if (offscreen) offscreen->Present();
+                else glfwSwapBuffers(window);
+            }
+            GpuRegistry().EndFrame();
+            GLState().EndFrame();
+            double renderEnd = FrameTimeMs();
+            if (recorder){
+                recorder->Record(frame->Frame, renderEnd - renderBegin, frame->SimulationEnd - frame->SimulationBegin,
+                                 previousBegin >= 0.0 ? renderBegin - previousBegin : -1.0);
+            }
+            previousBegin = renderBegin;
+            if (timeline.Record(*frame, renderBegin, renderEnd)){
+                GLState().Report();
+                gpuProfiler.Report();
+                gpuProfiler.Calibrate();
+                if (streaming) streaming->Report();
+                TextureStreaming().Report();
+                culler.Report();
+                if (gpuCuller) gpuCuller->Report();
+            }
+
+            AllocFrameStats allocations = AllocTracker::EndFrame();
+            if (frame->Frame >= FRAME_ARENA_WARMUP_FRAMES) steadyStateAllocations += allocations.Allocations;
+        }
+        if (recorder){
+            gpuProfiler.Finish();
+            for (unsigned int i = 0; i < gpuProfiler.ReadCount(); i++){
+                recorder->RecordGpu(gpuProfiler.ReadFrame(i).Frame, gpuProfiler.ReadFrame(i).Ms);
+            }
+            recorder->Report();
+            if (jsonPath) recorder->WriteJson(jsonPath);
+            if (csvPath) recorder->WriteCsv(csvPath);
+            if (baselinePath && !recorder->Compare(baselinePath, tolerance)) benchmarkRegressed = true;
+        }
+        gpuProfiler.FlushToTrace();
+        if (offscreen && outputPath) offscreen->WritePPM(outputPath);
+        if (streaming){
+            streaming->Report();
+            streaming.reset();
+        }
+        TextureStreaming().Report();
+        culler.Report();
+        if (gpuCuller) gpuCuller->Report();
     }
 
-    glfwTerminate();    
-    return 0;
+    TextureStreaming().Clear();
+    GpuRegistry().Flush();
+    if (GpuRegistry().LiveCount()){
+        std::cout << "ERROR::GPU::LEAKED_RESOURCES " << GpuRegistry().LiveCount() << " still registered at shutdown" << std::endl;
+        GpuRegistry().Report();
+    }
+    if (window) glfwMakeContextCurrent(NULL);
+    else context->ReleaseCurrent();
 }
 
-void processInput(GLFWwindow* window){ 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS){ 
-        glfwSetWindowShouldClose(window, true);
+void processInput(){ 
+    if (input.KeyDown(GLFW_KEY_ESCAPE)){ 
+        quit = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_W)){ 
         camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_S)){ 
         camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_D)){ 
         camera.ProcessKeyboard(RIGHT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_A)){ 
         camera.ProcessKeyboard(LEFT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_SPACE)){ 
         camera.ProcessKeyboard(UPWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS){ 
+    if (input.KeyDown(GLFW_KEY_LEFT_SHIFT)){ 
         camera.ProcessKeyboard(DOWNWARD, deltaTime);
     }
 }
 
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods){
+    input.Key(key, action);
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos){
+    input.Mouse(xpos, ypos);
+}
+
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset){
+    input.Scroll(xoffset, yoffset);
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height){ 
+    input.Resize(width, height);
+}
+
+void applyMouse(double xpos, double ypos){
     if (firstMouse){
         lastx = xpos, lasty = ypos;
         firstMouse = false;
@@ -142,10 +717,11 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos){
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-void scroll_callback(GLFWwindow *window, double xoffset, double yoffset){
+void applyScroll(double xoffset, double yoffset){
     camera.ProcessScroll((float)yoffset);
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height){ 
-        glViewport(0, 0, width, height);
+void applyResize(int width, int height){ 
+        framebufferWidth = width;
+        framebufferHeight = height;
 }
\ No newline at end of file
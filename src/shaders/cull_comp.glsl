@@ -0,0 +1,114 @@
+#version 460 core
+layout (local_size_x = 64) in;
+
+struct Instance{
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint mesh;
+    uint transform;
+    uint pad0;
+    uint pad1;
+};
+
+struct DrawCommand{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+#define STATE_FRUSTUM_CULLED 0
+#define STATE_EARLY_VISIBLE 1
+#define STATE_OCCLUDED 2
+#define STATE_LATE_VISIBLE 3
+
+layout (std430, binding = 0) readonly buffer Instances{ Instance instances[]; };
+layout (std430, binding = 1) buffer Commands{ DrawCommand commands[]; };
+layout (std430, binding = 2) writeonly buffer VisibleIds{ uint visibleIds[]; };
+layout (std430, binding = 3) buffer States{ uint states[]; };
+layout (std430, binding = 5) buffer Counters{ uint survivors[2]; };
+
+uniform mat4 viewProjection;
+uniform vec4 frustumPlanes[6];
+uniform sampler2D hiz;
+uniform int phase;
+uniform int instanceCount;
+uniform int meshCount;
+
+bool frustumVisible(vec3 bmin, vec3 bmax){
+    for (int i = 0; i < 6; i++){
+        vec4 plane = frustumPlanes[i];
+        vec3 v = vec3(plane.x > 0.0 ? bmax.x : bmin.x,
+                      plane.y > 0.0 ? bmax.y : bmin.y,
+                      plane.z > 0.0 ? bmax.z : bmin.z);
+        if (dot(plane.xyz, v) + plane.w < 0.0) return false;
+    }
+    return true;
+}
+
+bool occlusionVisible(vec3 bmin, vec3 bmax){
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float minZ = 1.0;
+
+    for (int i = 0; i < 8; i++){
+        vec3 corner = vec3((i & 1) != 0 ? bmax.x : bmin.x,
+                           (i & 2) != 0 ? bmax.y : bmin.y,
+                           (i & 4) != 0 ? bmax.z : bmin.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0 || clip.z < -clip.w) return true;
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        minZ = min(minZ, ndc.z * 0.5 + 0.5);
+    }
+
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    ivec2 baseSize = textureSize(hiz, 0);
+    vec2 extent = (uvMax - uvMin) * vec2(baseSize);
+    int lod = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(hiz) - 1);
+
+    // The pyramid is a power of two, every texel of a level covers the same share of the screen.
+    ivec2 levelSize = max(baseSize >> lod, ivec2(1));
+    ivec2 p0 = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1);
+    ivec2 p1 = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+
+    float maxDepth = max(max(texelFetch(hiz, p0, lod).r, texelFetch(hiz, ivec2(p1.x, p0.y), lod).r),
+                         max(texelFetch(hiz, ivec2(p0.x, p1.y), lod).r, texelFetch(hiz, p1, lod).r));
+    return minZ <= maxDepth;
+}
+
+void emit(Instance instance, int drawPhase){
+    uint command = uint(drawPhase * meshCount) + instance.mesh;
+    uint slot = atomicAdd(commands[command].instanceCount, 1);
+    visibleIds[commands[command].baseInstance + slot] = instance.transform;
+    atomicAdd(survivors[drawPhase], 1);
+}
+
+void main(){
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= uint(instanceCount)) return;
+
+    Instance instance = instances[id];
+    vec3 bmin = instance.boundsMin.xyz;
+    vec3 bmax = instance.boundsMax.xyz;
+
+    if (phase == 0){
+        if (!frustumVisible(bmin, bmax)){
+            states[id] = STATE_FRUSTUM_CULLED;
+        }else if (occlusionVisible(bmin, bmax)){
+            states[id] = STATE_EARLY_VISIBLE;
+            emit(instance, 0);
+        }else{
+            states[id] = STATE_OCCLUDED;
+        }
+    }else if (states[id] == STATE_OCCLUDED && occlusionVisible(bmin, bmax)){
+        states[id] = STATE_LATE_VISIBLE;
+        emit(instance, 1);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) uniform writeonly image2D dstLevel;
+
+uniform sampler2D src;
+uniform int srcLevel;
+uniform ivec2 dstSize;
+
+float fetch(ivec2 p, ivec2 srcSize){
+    return texelFetch(src, min(p, srcSize - 1), srcLevel).r;
+}
+
+void main(){
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= dstSize.x || p.y >= dstSize.y) return;
+
+    // The first level is at most the size of the depth buffer, so a texel takes
+    // the farthest of every pixel it overlaps, up to 3x3 of them.
+    if (srcLevel < 0){
+        ivec2 srcSize = textureSize(src, 0);
+        ivec2 first = p * srcSize / dstSize;
+        ivec2 last = ((p + 1) * srcSize + dstSize - 1) / dstSize;
+        float depth = 0.0;
+        for (int y = first.y; y < last.y; y++){
+            for (int x = first.x; x < last.x; x++){
+                depth = max(depth, texelFetch(src, ivec2(x, y), 0).r);
+            }
+        }
+        imageStore(dstLevel, p, vec4(depth));
+        return;
+    }
+
+    // Every level above is a power of two, only a side that already reached 1 is clamped.
+    ivec2 srcSize = textureSize(src, srcLevel);
+    ivec2 s = p * 2;
+    float depth = max(max(fetch(s, srcSize), fetch(s + ivec2(1, 0), srcSize)),
+                      max(fetch(s + ivec2(0, 1), srcSize), fetch(s + ivec2(1, 1), srcSize)));
+
+    imageStore(dstLevel, p, vec4(depth));
+}
@@ -0,0 +1,26 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+layout (std430, binding = 2) readonly buffer VisibleIds{ uint visibleIds[]; };
+layout (std430, binding = 4) readonly buffer Transforms{ mat4 transforms[]; };
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 node;
+
+void main(){
+    mat4 model = transforms[visibleIds[gl_BaseInstance + gl_InstanceID]] * node;
+    mat3 normalMat = mat3(transpose(inverse(model)));
+
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = normalMat * aNormal;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    TexCoords = aTexCoords;
+}
\ No newline at end of file
@@ -47,8 +47,9 @@ struct SpotLight{
     vec3 specular;
 };
 
-#define NR_POINT_LIGHTS 1
-#define NR_SPOT_LIGHTS 1
+// Has to match SCENE_MAX_POINT_LIGHTS and SCENE_MAX_SPOT_LIGHTS in scene.h.
+#define NR_POINT_LIGHTS 32
+#define NR_SPOT_LIGHTS 32
 
 in vec3 Normal;
 in vec3 FragPos;
@@ -57,6 +58,8 @@ in vec2 TexCoords;
 uniform vec3 viewPos;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLights[NR_SPOT_LIGHTS];
+uniform int pointLightCount;
+uniform int spotLightCount;
 uniform DirLight dirLight;
 uniform Material material;
 
@@ -75,10 +78,10 @@ void main(){
 
     vec3 result = vec3(0.0);
     result += CalcDirLight(dirLight, norm, viewDir, diffuse_textures, specular_textures);
-    // for (int i = 0; i < NR_POINT_LIGHTS; i++){
-    //     result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, diffuse_textures, specular_textures);
-    // }
-    for (int i = 0; i < NR_SPOT_LIGHTS; i++){
+    for (int i = 0; i < pointLightCount; i++){
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, diffuse_textures, specular_textures);
+    }
+    for (int i = 0; i < spotLightCount; i++){
         result += CalcSpotLight(spotLights[i], norm, FragPos, viewDir, diffuse_textures, specular_textures);
     }
 
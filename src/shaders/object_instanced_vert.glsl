@@ -0,0 +1,29 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+layout (std430, binding = 6) readonly buffer InstanceTransforms{ mat4 transforms[]; };
+layout (std430, binding = 7) readonly buffer InstanceAttributes{ vec4 attributes[]; };
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+flat out vec4 InstanceData;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 node;
+uniform bool hasInstanceData;
+
+void main(){
+    mat4 model = transforms[gl_InstanceID] * node;
+    mat3 normalMat = mat3(transpose(inverse(model)));
+
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = normalMat * aNormal;
+    InstanceData = hasInstanceData ? attributes[gl_InstanceID] : vec4(1.0);
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    TexCoords = aTexCoords;
+}
\ No newline at end of file
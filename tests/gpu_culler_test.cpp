@@ -0,0 +1,162 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/shader.h>
+#include <custom/mesh.h>
+#include <custom/headless.h>
+#include <custom/gpu_culler.h>
+
+#include <iostream>
+#include <vector>
+
+Mesh makeCube(){
+    std::vector<Vertex> vertices;
+    for (unsigned int i = 0; i < 8; i++){
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+        vertex.Normal = glm::normalize(vertex.Position);
+        vertices.push_back(vertex);
+    }
+    unsigned int faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                              2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    return Mesh(std::move(vertices), std::vector<unsigned int>(faces, faces + 36), std::vector<Texture>());
+}
+
+struct CullScene{
+    const char* Name;
+    unsigned int Width, Height;
+    glm::mat4 Projection, View;
+    std::vector<glm::mat4> Transforms;
+    std::vector<unsigned int> InstanceModels;
+    std::vector<const char*> Names;
+    std::vector<unsigned int> Expected;
+};
+
+// Culls and draws the scene for two frames, checking every cull phase against the CPU
+// reference and, in the second frame with the wall in the pyramid, the early states.
+unsigned int runScene(const CullScene &scene, Shader &shader, std::vector<Mesh> &wall, std::vector<Mesh> &boxes){
+    unsigned int failed = 0;
+    OffscreenTarget target(scene.Width, scene.Height);
+    target.Bind();
+    GLState().Viewport(0, 0, scene.Width, scene.Height);
+
+    GpuCuller culler(scene.Width, scene.Height);
+    culler.SetInstances({&wall, &boxes}, std::vector<std::vector<glm::mat4>>(2), scene.Transforms, scene.InstanceModels);
+
+    shader.use();
+    shader.setMat4("projection", scene.Projection);
+    shader.setMat4("view", scene.View);
+    shader.setMat4("node", glm::mat4(1.0f));
+    // Bound once like in the renderer, the cull passes must not leave their own program bound.
+    auto draw = [&](int phase){
+        culler.Bind();
+        wall[0].DrawIndirect(shader, culler.CommandOffset(phase, culler.MeshBase(0)));
+        boxes[0].DrawIndirect(shader, culler.CommandOffset(phase, culler.MeshBase(1)));
+    };
+    auto verify = [&](unsigned int frame, int phase){
+        unsigned int mismatches = culler.Verify(phase);
+        if (mismatches){
+            std::cout << "ERROR::TEST::GPU_CULL " << scene.Name << " frame " << frame << " phase " << phase << ": " << mismatches << " instances differ from the CPU reference" << std::endl;
+            failed++;
+        }
+    };
+
+    for (unsigned int frame = 0; frame < 2; frame++){
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        culler.CullEarly(scene.Projection * scene.View);
+        verify(frame, 0);
+        std::vector<unsigned int> states = culler.ReadStates();
+        draw(0);
+        culler.BuildHiZ();
+        culler.CullLate();
+        verify(frame, 1);
+        draw(1);
+        culler.EndFrame();
+        target.Present();
+
+        if (frame == 0) continue;
+        const std::vector<GpuInstance> &instances = culler.GetInstances();
+        for (unsigned int i = 0; i < instances.size(); i++){
+            unsigned int t = instances[i].Transform;
+            if (states[i] != scene.Expected[t]){
+                std::cout << "ERROR::TEST::GPU_CULL " << scene.Name << ": " << scene.Names[t] << " is in state " << states[i] << " instead of " << scene.Expected[t] << std::endl;
+                failed++;
+            }
+        }
+    }
+    glFinish();
+    return failed;
+}
+
+glm::mat4 placeBox(glm::vec3 position, glm::vec3 size){
+    return glm::scale(glm::translate(glm::mat4(1.0f), position), size);
+}
+
+// A wall and some boxes as two models on whatever EGL offers (llvmpipe is enough).
+// The second scene has an odd window size, where the pyramid texels no longer cover
+// the window evenly: the box just right of the wall's edge must stay visible.
+// Run from the repository root, the shaders load from src/shaders.
+int main(){
+    HeadlessContext context;
+    if (!context.Valid() || !context.MakeCurrent()) return 1;
+    if (!gladLoadGLLoader(HeadlessContext::Loader())){
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return 1;
+    }
+
+    unsigned int failed = 0;
+    {
+        GLState().Enable(GL_DEPTH_TEST);
+
+        Shader shader("src/shaders/object_culled_vert.glsl", "src/shaders/object_frag.glsl");
+        std::vector<Mesh> wall, boxes;
+        wall.push_back(makeCube());
+        boxes.push_back(makeCube());
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        CullScene square;
+        square.Name = "square";
+        square.Width = square.Height = 128;
+        square.Projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+        square.View = view;
+        square.Transforms = {
+            placeBox(glm::vec3(0.0f), glm::vec3(4.0f, 4.0f, 0.2f)),
+            placeBox(glm::vec3(0.0f, 0.0f, -3.0f), glm::vec3(1.0f)),
+            placeBox(glm::vec3(4.0f, 0.0f, -3.0f), glm::vec3(1.0f)),
+            placeBox(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f)),
+            placeBox(glm::vec3(0.0f, 40.0f, -3.0f), glm::vec3(1.0f)),
+        };
+        square.InstanceModels = {0, 1, 1, 1, 1};
+        square.Names = {"wall", "behind", "beside", "in front", "outside the view"};
+        square.Expected = {CULL_EARLY_VISIBLE, CULL_OCCLUDED, CULL_EARLY_VISIBLE, CULL_EARLY_VISIBLE, CULL_FRUSTUM};
+        failed += runScene(square, shader, wall, boxes);
+
+        // With an orthographic camera x maps straight to the 127 pixel columns: the wall ends
+        // in column 63 and the box spans columns 65 to 83, in the far half of the window.
+        CullScene odd;
+        odd.Name = "odd size";
+        odd.Width = 127;
+        odd.Height = 75;
+        odd.Projection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 100.0f);
+        odd.View = view;
+        odd.Transforms = {
+            placeBox(glm::vec3(-0.745f, 0.0f, 0.0f), glm::vec3(1.51f, 4.0f, 0.2f)),
+            placeBox(glm::vec3(0.17f, 0.0f, -3.0f), glm::vec3(0.28f, 0.4f, 0.4f)),
+            placeBox(glm::vec3(-0.5f, 0.0f, -3.0f), glm::vec3(0.28f, 0.4f, 0.4f)),
+        };
+        odd.InstanceModels = {0, 1, 1};
+        odd.Names = {"wall", "beside the edge", "behind"};
+        odd.Expected = {CULL_EARLY_VISIBLE, CULL_EARLY_VISIBLE, CULL_OCCLUDED};
+        failed += runScene(odd, shader, wall, boxes);
+    }
+    GpuRegistry().Flush();
+    context.ReleaseCurrent();
+
+    if (failed) return 1;
+    std::cout << "TEST::GPU_CULL passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <custom/job_system.h>
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+
+const unsigned int CHAIN_LENGTH = 200;
+const unsigned int TIMEOUT_SECONDS = 20;
+
+unsigned int failed = 0;
+
+void check(bool condition, const char* what){
+    if (condition) return;
+    std::cout << "ERROR::TEST::JOB_SYSTEM " << what << std::endl;
+    failed++;
+}
+
+// A job queued behind its own dependency must neither spin nor deadlock on a single thread.
+void singleThreadDependency(){
+    JobSystem jobs(1);
+    JobCounter counterA, counterB;
+    std::vector<char> order;
+    jobs.Run([&order](){ order.push_back('A'); }, &counterA);
+    jobs.Run([&order](){ order.push_back('B'); }, &counterB, &counterA);
+    jobs.Wait(counterB);
+    check(order.size() == 2 && order[0] == 'A' && order[1] == 'B', "single thread: B ran before its dependency A");
+}
+
+// Every link waits for the one before it. Owners pop the newest link first and thieves
+// take the oldest, so most links find their dependency unfinished and get parked.
+void dependencyChain(){
+    JobSystem jobs(4);
+    std::vector<JobCounter> counters(CHAIN_LENGTH);
+    std::atomic<unsigned int> next(0);
+    std::atomic<bool> ordered(true);
+    for (unsigned int i = 0; i < CHAIN_LENGTH; i++){
+        jobs.Run([&next, &ordered, i](){
+            if (next.fetch_add(1) != i) ordered = false;
+        }, &counters[i], i ? &counters[i - 1] : nullptr);
+    }
+    jobs.Wait(counters[CHAIN_LENGTH - 1]);
+    check(ordered.load() && next.load() == CHAIN_LENGTH, "chain: links ran out of order");
+}
+
+// A worker job depending on a main thread job is released by PumpMainThread.
+void mainThreadDependency(){
+    JobSystem jobs(2);
+    JobCounter mainCounter, counter;
+    std::atomic<bool> mainDone(false), dependentRanAfter(false);
+    jobs.RunOnMainThread([&mainDone](){ mainDone = true; }, &mainCounter);
+    jobs.Run([&](){ dependentRanAfter = mainDone.load(); }, &counter, &mainCounter);
+    jobs.Wait(counter);
+    check(dependentRanAfter.load(), "main thread: dependent job ran before the main thread job");
+}
+
+// One long background job: the other worker has nothing queued and has to sleep instead of spinning.
+void idleWorkersSleep(){
+    JobSystem jobs(3);
+    JobCounter counter;
+    std::clock_t cpuBegin = std::clock();
+    auto begin = std::chrono::steady_clock::now();
+    jobs.RunBackground([](){ std::this_thread::sleep_for(std::chrono::milliseconds(500)); }, &counter);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    jobs.Wait(counter);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double cpu = (double)(std::clock() - cpuBegin) / CLOCKS_PER_SEC;
+    if (cpu > 0.25 * wall){
+        std::cout << "ERROR::TEST::JOB_SYSTEM idle workers used " << cpu << " s of CPU in " << wall << " s" << std::endl;
+        failed++;
+    }
+}
+
+int main(){
+    std::thread([](){
+        std::this_thread::sleep_for(std::chrono::seconds(TIMEOUT_SECONDS));
+        std::cout << "ERROR::TEST::JOB_SYSTEM timed out after " << TIMEOUT_SECONDS << " s" << std::endl;
+        std::_Exit(1);
+    }).detach();
+
+    singleThreadDependency();
+    dependencyChain();
+    mainThreadDependency();
+    idleWorkersSleep();
+
+    if (failed) return 1;
+    std::cout << "TEST::JOB_SYSTEM passed" << std::endl;
+    return 0;
+}
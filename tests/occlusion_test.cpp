@@ -0,0 +1,52 @@
+#include <custom/occlusion.h>
+#include <custom/job_system.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+
+// A 4x4 wall at z = 0 seen from z = 5, boxes behind it have to be culled and
+// everything in front of it, beside it or peeking past its edge kept.
+int main(){
+    JobSystem jobs(2);
+    OcclusionCuller culler;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    culler.BeginFrame(projection * view);
+
+    glm::vec3 wall[4] = {{-2.0f, -2.0f, 0.0f}, {2.0f, -2.0f, 0.0f}, {2.0f, 2.0f, 0.0f}, {-2.0f, 2.0f, 0.0f}};
+    unsigned int indices[6] = {0, 1, 2, 0, 2, 3};
+    culler.AddOccluder(wall, sizeof(glm::vec3), 4, indices, 6, glm::mat4(1.0f));
+    culler.Rasterize(jobs);
+
+    struct Case{ const char* Name; AABB Bounds; bool Visible; };
+    Case cases[] = {
+        {"behind", {glm::vec3(-0.5f, -0.5f, -3.5f), glm::vec3(0.5f, 0.5f, -2.5f)}, false},
+        {"behind off center", {glm::vec3(0.5f, 0.5f, -1.5f), glm::vec3(1.0f, 1.0f, -1.0f)}, false},
+        {"in front", {glm::vec3(-0.5f, -0.5f, 1.5f), glm::vec3(0.5f, 0.5f, 2.5f)}, true},
+        {"beside", {glm::vec3(4.0f, -0.5f, -3.5f), glm::vec3(5.0f, 0.5f, -2.5f)}, true},
+        {"past the edge", {glm::vec3(1.5f, -0.5f, -3.5f), glm::vec3(3.5f, 0.5f, -2.5f)}, true},
+        {"through the wall", {glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f)}, true},
+        {"outside the view", {glm::vec3(-0.5f, 30.0f, -3.5f), glm::vec3(0.5f, 31.0f, -2.5f)}, false},
+    };
+
+    unsigned int failed = 0, hidden = 0;
+    for (const Case &c : cases){
+        bool visible = culler.Test(c.Bounds, glm::mat4(1.0f));
+        hidden += !c.Visible;
+        if (visible != c.Visible){
+            std::cout << "ERROR::TEST::OCCLUSION box " << c.Name << " is " << (visible ? "visible" : "hidden") << std::endl;
+            failed++;
+        }
+    }
+
+    OcclusionStats stats = culler.GetStats();
+    if (stats.OccluderTriangles != 2 || stats.Tested != sizeof(cases) / sizeof(cases[0]) || stats.Culled != hidden){
+        std::cout << "ERROR::TEST::OCCLUSION_STATS " << stats.OccluderTriangles << " triangles, " << stats.Culled << " of " << stats.Tested << " culled" << std::endl;
+        failed++;
+    }
+    if (failed) return 1;
+    std::cout << "TEST::OCCLUSION passed" << std::endl;
+    return 0;
+}
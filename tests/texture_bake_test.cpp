@@ -0,0 +1,90 @@
+#include <custom/texture_baking.h>
+#include <image_loader/stb_image.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+const unsigned int WIDTH = 5;
+const unsigned int HEIGHT = 3;
+
+// Red follows the column and green the row of the file, counted from the top.
+unsigned char texel(unsigned int x, unsigned int row, unsigned int channel){
+    return channel == 0 ? x * 40 : channel == 1 ? row * 80 + 10 : 7;
+}
+
+// An uncompressed 24 bit TGA stored top row first, so the file itself has no flip in it.
+bool writeImage(const std::string &path){
+    unsigned char header[18] = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, WIDTH, 0, HEIGHT, 0, 24, 0x20};
+    std::vector<unsigned char> pixels;
+    for (unsigned int row = 0; row < HEIGHT; row++){
+        for (unsigned int x = 0; x < WIDTH; x++){
+            for (int c = 2; c >= 0; c--) pixels.push_back(texel(x, row, c));
+        }
+    }
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)pixels.data(), pixels.size());
+    return (bool)out;
+}
+
+// Bakes an image the way texture_bake does and reads the bake back: its texels have
+// to sit where the renderer's flipped stb load puts them, bottom row of the file first.
+int main(){
+    std::string image = (std::filesystem::temp_directory_path() / "texture_bake_test.tga").string();
+    if (!writeImage(image)){
+        std::cout << "ERROR::TEST::TEXTURE_BAKE could not write " << image << std::endl;
+        return 1;
+    }
+
+    unsigned int failed = 0;
+    int width, height, components;
+    unsigned char* pixels = LoadBakeSource(image, width, height, components);
+    if (!pixels){
+        std::cout << "ERROR::TEST::TEXTURE_BAKE could not load " << image << std::endl;
+        return 1;
+    }
+    BakeSettings settings;
+    settings.Kind = TEXTURE_KIND_COLOR;
+    settings.Uncompressed = true;
+    settings.Mips = false;
+    Ktx2Texture baked = BakeTexture(image, pixels, width, height, components, settings, NULL);
+    stbi_image_free(pixels);
+
+    Ktx2Texture loaded;
+    if (!baked.Save(BakedTexturePath(image)) || !loaded.Load(BakedTexturePath(image))) return 1;
+    if (loaded.Orientation != BAKED_TEXTURE_ORIENTATION){
+        std::cout << "ERROR::TEST::TEXTURE_BAKE orientation " << loaded.Orientation << " instead of " << BAKED_TEXTURE_ORIENTATION << std::endl;
+        failed++;
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* reference = stbi_load(image.c_str(), &width, &height, &components, 0);
+    const std::vector<unsigned char> &level = loaded.Levels[0].Pixels;
+    if (!reference || loaded.VkFormat != KTX2_R8G8B8_UNORM || level.size() != (size_t)width * height * 3){
+        std::cout << "ERROR::TEST::TEXTURE_BAKE expected an RGB8 " << WIDTH << "x" << HEIGHT << " bake" << std::endl;
+        stbi_image_free(reference);
+        return 1;
+    }
+    for (unsigned int y = 0; y < HEIGHT; y++){
+        for (unsigned int x = 0; x < WIDTH; x++){
+            for (unsigned int c = 0; c < 3; c++){
+                size_t i = ((size_t)y * WIDTH + x) * 3 + c;
+                if (level[i] != reference[i] || level[i] != texel(x, HEIGHT - 1 - y, c)){
+                    std::cout << "ERROR::TEST::TEXTURE_BAKE texel " << x << ", " << y << " channel " << c << " is " << (int)level[i]
+                              << ", the renderer loads " << (int)reference[i] << std::endl;
+                    failed++;
+                }
+            }
+        }
+    }
+    stbi_image_free(reference);
+    std::filesystem::remove(image);
+    std::filesystem::remove(BakedTexturePath(image));
+
+    if (failed) return 1;
+    std::cout << "TEST::TEXTURE_BAKE passed" << std::endl;
+    return 0;
+}